@@ -0,0 +1,192 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifdef BASELINE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "baseline.h"
+#include "object.h"
+#include "vm.h"
+
+typedef enum {
+    STENCIL_OPERAND,
+    STENCIL_CONSTANT,
+    STENCIL_IP,
+    STENCIL_NEXT,
+    STENCIL_TARGET,
+    STENCIL_FUNCTION,
+} StencilHoleKind;
+
+// offset is where the hole's 8 bytes start in the stencil. A jump hole is the
+// address in a movabs that ends in a jmp through its register, jump bytes
+// long from the movabs on, and 0 otherwise.
+typedef struct {
+    int offset;
+    StencilHoleKind kind;
+    int jump;
+    void (*function)(void);
+    int64_t addend;
+} StencilHole;
+
+typedef struct {
+    const uint8_t *code;
+    size_t size;
+    const StencilHole *holes;
+    int holeCount;
+} Stencil;
+
+#include "stencils.h" // generated by clox-extract, see CMakeLists.txt
+
+#define MOVABS_LENGTH 10
+
+static uint32_t readOperand(uint8_t *operand, int width) {
+    uint32_t value = 0;
+    for (int i = 0; i < width; ++i) {
+        value = value << 8 | operand[i];
+    }
+    return value;
+}
+
+// A movabs into a register that the next instruction jumps through becomes a
+// direct jump, and what is left of it a nop, so that the jmp stays where it was.
+static void patchJump(uint8_t *movabs, uint8_t *destination) {
+    int32_t distance = (int32_t) (destination - (movabs + 5));
+    movabs[0] = 0xE9;
+    memcpy(movabs + 1, &distance, sizeof(distance));
+    static const uint8_t nop[MOVABS_LENGTH - 5] = {0x0F, 0x1F, 0x44, 0x00, 0x00};
+    memcpy(movabs + 5, nop, sizeof(nop));
+}
+
+static void patch(Chunk *chunk, int offset, uint8_t *code, const int *native) {
+    OpCode op = chunk->code[offset];
+    const Stencil *stencil = &stencils[op];
+    uint8_t *start = code + native[offset];
+    memcpy(start, stencil->code, stencil->size);
+
+    int width = Chunk_operandWidth(op);
+    uint32_t operand = readOperand(&chunk->code[offset + 1], width);
+    for (int i = 0; i < stencil->holeCount; ++i) {
+        const StencilHole *hole = &stencil->holes[i];
+        uint64_t value = 0;
+        switch (hole->kind) {
+            case STENCIL_OPERAND: value = operand; break;
+            case STENCIL_CONSTANT: value = chunk->constants.values[operand]; break;
+            case STENCIL_IP: value = (uintptr_t) &chunk->code[offset]; break;
+            case STENCIL_NEXT: value = (uintptr_t) (code + native[offset + 1 + width]); break;
+            case STENCIL_TARGET: value = (uintptr_t) (code + native[Chunk_jumpTarget(chunk, offset)]); break;
+            case STENCIL_FUNCTION: value = (uintptr_t) hole->function; break;
+        }
+        value += (uint64_t) hole->addend;
+
+        if (hole->jump > 0) {
+            patchJump(start + hole->offset - 2, (uint8_t *) (uintptr_t) value);
+        } else {
+            memcpy(start + hole->offset, &value, sizeof(value));
+        }
+    }
+}
+
+bool Baseline_compile(Chunk *chunk, BaselineCode *baseline) {
+    // where every instruction's stencil starts in the native code
+    int *native = malloc(sizeof(int) * (chunk->count + 1));
+    if (native == NULL) return false;
+
+    size_t size = 0;
+    OpCode last = OP_RETURN;
+    for (int offset = 0; offset < chunk->count; offset += 1 + Chunk_operandWidth(last)) {
+        last = chunk->code[offset];
+        if (stencils[last].code == NULL) {
+            free(native);
+            return false;
+        }
+        native[offset] = (int) size;
+        size += stencils[last].size;
+    }
+    native[chunk->count] = (int) size;
+    // stencils fall through to the next one, so nothing may come after the last
+    if (chunk->count == 0 || last != OP_RETURN) {
+        free(native);
+        return false;
+    }
+
+    uint8_t *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        free(native);
+        return false;
+    }
+    for (int offset = 0; offset < chunk->count; offset += 1 + Chunk_operandWidth(chunk->code[offset])) {
+        patch(chunk, offset, code, native);
+    }
+    free(native);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size);
+        return false;
+    }
+
+    baseline->function = (BaselineFunction) (void *) code;
+    baseline->code = code;
+    baseline->size = size;
+    return true;
+}
+
+void Baseline_free(BaselineCode *baseline) {
+    munmap(baseline->code, baseline->size);
+    baseline->function = NULL;
+    baseline->code = NULL;
+    baseline->size = 0;
+}
+
+// VM_runtimeError reports the line of the instruction just before vm.ip.
+static void runtimeError(uint8_t *ip, const char *message) {
+    vm.ip = ip + 1;
+    VM_runtimeError("%s", message);
+}
+
+Value *Baseline_add(Value *sp, uint8_t *ip) {
+    vm.stackTop = sp;
+    // two numbers never get here
+    if (!IS_ANY_STRING(sp[-2]) || !IS_ANY_STRING(sp[-1])) {
+        runtimeError(ip, "Operands must be two numbers or two strings.");
+        return NULL;
+    }
+    // both operands stay on the stack while the result is allocated
+    sp[-2] = ObjRope_concatenate(sp[-2], sp[-1]);
+    return sp - 1;
+}
+
+Value *Baseline_equal(Value *sp, bool negated) {
+    vm.stackTop = sp; // comparing a rope flattens it
+    bool equal = Value_equal(sp[-2], sp[-1]);
+    sp[-2] = BOOL_VAL(equal != negated);
+    return sp - 1;
+}
+
+Value *Baseline_print(Value *sp) {
+    vm.stackTop = sp;
+    Value_print(vm.out, sp[-1]);
+    fputc('\n', vm.out);
+    return sp - 1;
+}
+
+int Baseline_undefinedVariable(uint8_t *ip, uint32_t slot) {
+    vm.ip = ip + 1;
+    VM_runtimeError("Undefined variable: '%s'.", vm.globals.names[slot]->chars);
+    return BASELINE_RUNTIME_ERROR;
+}
+
+int Baseline_operandsError(uint8_t *ip) {
+    runtimeError(ip, "Operands must be numbers.");
+    return BASELINE_RUNTIME_ERROR;
+}
+
+int Baseline_operandError(uint8_t *ip) {
+    runtimeError(ip, "Operand must be a number.");
+    return BASELINE_RUNTIME_ERROR;
+}
+
+#endif
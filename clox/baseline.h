@@ -0,0 +1,52 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_BASELINE_H
+#define CLOX_BASELINE_H
+
+#include "chunk.h"
+#include "value.h"
+
+// A copy-and-patch compiler, built with CLOX_BASELINE and turned on with
+// --baseline. Every opcode's handler is written in C in stencils/stencils.c
+// and compiled at build time, on its own, to position-dependent machine code
+// with holes for what the handler reads from the instruction. stencils/extract.c
+// turns that object file into stencils.h. Compiling a chunk is copying each
+// instruction's stencil into one native function and patching in its constant,
+// its local or global slot, and the stencils it continues or jumps to, so the
+// chunk runs without decoding or dispatching anything. There is no warmup: the
+// whole chunk is compiled before it runs, every time.
+
+#define BASELINE_OK 0
+#define BASELINE_RUNTIME_ERROR 1
+
+// Every stencil takes the top of the stack, the stack and the globals in
+// registers, and passes them on to the next one with a tail call.
+typedef int (*BaselineFunction)(Value *sp, Value *stack, Value *globals);
+
+typedef struct {
+    BaselineFunction function;
+    void *code;
+    size_t size;
+} BaselineCode;
+
+// Fails if the chunk has an instruction without a stencil, or if there is no
+// memory to map.
+bool Baseline_compile(Chunk *chunk, BaselineCode *code);
+void Baseline_free(BaselineCode *code);
+
+// What the stencils call for what they do not do themselves. ip is the
+// instruction's address in the chunk, for reporting errors on its line, and
+// the ones that can allocate get the top of the stack so the collector sees
+// everything on it. The stack is pinned while the code runs, so what they
+// push never moves it. They return the new top of the stack, or NULL after a
+// runtime error.
+Value *Baseline_add(Value *sp, uint8_t *ip);
+Value *Baseline_equal(Value *sp, bool negated);
+Value *Baseline_print(Value *sp);
+int Baseline_undefinedVariable(uint8_t *ip, uint32_t slot);
+int Baseline_operandsError(uint8_t *ip);
+int Baseline_operandError(uint8_t *ip);
+
+#endif //CLOX_BASELINE_H
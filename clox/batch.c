@@ -0,0 +1,159 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "cache.h"
+#include "source.h"
+#include "vm.h"
+
+typedef struct {
+    Batch *batch;
+    bool useCache;
+    atomic_int next; // the first script nobody has taken yet
+} Workers;
+
+void Batch_init(Batch *batch) {
+    batch->scripts = NULL;
+    batch->count = 0;
+    batch->capacity = 0;
+}
+
+void Batch_free(Batch *batch) {
+    for (int i = 0; i < batch->count; ++i) {
+        free(batch->scripts[i].path);
+        free(batch->scripts[i].output);
+        free(batch->scripts[i].errors);
+    }
+    free(batch->scripts);
+    Batch_init(batch);
+}
+
+static void addPath(Batch *batch, const char *path, size_t length) {
+    if (batch->count == batch->capacity) {
+        batch->capacity = batch->capacity < 16 ? 16 : batch->capacity * 2;
+        batch->scripts = realloc(batch->scripts, sizeof(BatchScript) * batch->capacity);
+        if (batch->scripts == NULL) exit(1);
+    }
+    char *copy = malloc(length + 1);
+    if (copy == NULL) exit(1);
+    memcpy(copy, path, length);
+    copy[length] = '\0';
+    batch->scripts[batch->count++] = (BatchScript) {copy, NULL, 0, NULL, 0, 0, 0};
+}
+
+void Batch_add(Batch *batch, const char *path) {
+    addPath(batch, path, strlen(path));
+}
+
+bool Batch_addManifest(Batch *batch, const char *manifestPath) {
+    SourceFile manifest;
+    if (!SourceFile_load(manifestPath, &manifest)) return false;
+    const char *end = manifest.chars + manifest.length;
+    for (const char *line = manifest.chars; line < end;) {
+        const char *newline = memchr(line, '\n', end - line);
+        const char *lineEnd = newline != NULL ? newline : end;
+        size_t length = lineEnd - line;
+        if (length > 0 && line[length - 1] == '\r') length--;
+        if (length > 0 && line[0] != '#') addPath(batch, line, length);
+        line = lineEnd + 1;
+    }
+    SourceFile_unload(&manifest);
+    return true;
+}
+
+static int statusOf(InterpretResult result) {
+    switch (result) {
+        case INTERPRET_COMPILE_ERROR: return 65;
+        case INTERPRET_RUNTIME_ERROR: return 70;
+        default: return 0;
+    }
+}
+
+// Runs in a VM of its own, on whichever thread took it.
+static void runScript(BatchScript *script, bool useCache) {
+    FILE *out = open_memstream(&script->output, &script->outputLength);
+    FILE *err = open_memstream(&script->errors, &script->errorsLength);
+    if (out == NULL || err == NULL) exit(1);
+
+    double start = VM_now();
+    VM_init();
+    vm.out = out;
+    vm.err = err;
+    SourceFile file;
+    if (!SourceFile_load(script->path, &file)) {
+        fprintf(err, "Could not read file \"%s\".\n", script->path);
+        script->status = 74;
+    } else if (useCache) {
+        char *cachePath = Cache_pathFor(script->path);
+        script->status = statusOf(VM_interpretCached(file.chars, file.length, cachePath));
+        free(cachePath);
+        SourceFile_unload(&file);
+    } else {
+        script->status = statusOf(VM_interpret(file.chars, file.length));
+        SourceFile_unload(&file);
+    }
+    VM_free();
+    script->time = VM_now() - start;
+
+    fclose(out);
+    fclose(err);
+}
+
+static void *work(void *argument) {
+    Workers *workers = argument;
+    for (;;) {
+        int index = atomic_fetch_add(&workers->next, 1);
+        if (index >= workers->batch->count) return NULL;
+        runScript(&workers->batch->scripts[index], workers->useCache);
+    }
+}
+
+static void report(Batch *batch, int jobs, double elapsed) {
+    int failed = 0;
+    for (int i = 0; i < batch->count; ++i) {
+        BatchScript *script = &batch->scripts[i];
+        printf("== %s: exit %d in %.3f ms\n", script->path, script->status, script->time * 1e3);
+        fwrite(script->output, 1, script->outputLength, stdout);
+        if (script->errorsLength > 0) {
+            printf("-- stderr\n");
+            fwrite(script->errors, 1, script->errorsLength, stdout);
+        }
+        if (script->status != 0) failed++;
+    }
+    printf("== %d scripts, %d failed, in %.3f ms on %d threads: %.1f scripts/s\n",
+           batch->count, failed, elapsed * 1e3, jobs, elapsed > 0 ? batch->count / elapsed : 0.0);
+}
+
+int Batch_run(Batch *batch, int jobs, bool useCache) {
+    if (jobs > batch->count) jobs = batch->count;
+    if (jobs < 1) jobs = 1;
+    pthread_t *threads = malloc(sizeof(pthread_t) * jobs);
+    if (threads == NULL) exit(1);
+    Workers workers = {batch, useCache, 0};
+
+    double start = VM_now();
+    for (int i = 0; i < jobs; ++i) {
+        if (pthread_create(&threads[i], NULL, work, &workers) != 0) {
+            fprintf(stderr, "Could not start worker thread %d.\n", i);
+            exit(71);
+        }
+    }
+    for (int i = 0; i < jobs; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = VM_now() - start;
+    free(threads);
+
+    report(batch, jobs, elapsed);
+    for (int i = 0; i < batch->count; ++i) {
+        if (batch->scripts[i].status != 0) return batch->scripts[i].status;
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_BATCH_H
+#define CLOX_BATCH_H
+
+#include "common.h"
+
+// Many scripts run by one process, on a pool of threads with a VM each. Every
+// script gets a fresh VM, so they never see each other's globals, and what it
+// prints and the errors it reports are captured and reported with its exit
+// status and how long it took, in the order the scripts were added.
+typedef struct {
+    char *path;
+    char *output;
+    size_t outputLength;
+    char *errors;
+    size_t errorsLength;
+    int status; // what clox would exit with after running it alone
+    double time;
+} BatchScript;
+
+typedef struct {
+    BatchScript *scripts;
+    int count;
+    int capacity;
+} Batch;
+
+void Batch_init(Batch *batch);
+void Batch_free(Batch *batch);
+void Batch_add(Batch *batch, const char *path);
+// Adds the scripts a manifest lists, one path per line. Blank lines and lines
+// that start with # are skipped.
+bool Batch_addManifest(Batch *batch, const char *manifestPath);
+// Runs every script on jobs threads and prints a report to stdout. Returns the
+// status of the first script that failed, or 0.
+int Batch_run(Batch *batch, int jobs, bool useCache);
+
+#endif //CLOX_BATCH_H
@@ -0,0 +1,108 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Allocator microbenchmark. Build it with -DCLOX_POOL_ALLOCATOR=ON and OFF to
+// compare the size-class pools against plain malloc behind reallocate().
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "vm.h"
+
+#define SLOTS 4096
+#define OPERATIONS 20000000
+#define RUNS 3
+
+typedef struct {
+    void *pointer;
+    size_t size;
+} Slot;
+
+static Slot slots[SLOTS];
+
+static uint32_t nextRandom(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Allocates and frees blocks the size of short strings in random order.
+static double churn() {
+    uint32_t random = 2463534242u;
+    double start = VM_now();
+    for (int i = 0; i < OPERATIONS; ++i) {
+        Slot *slot = &slots[nextRandom(&random) % SLOTS];
+        if (slot->pointer != NULL) {
+            reallocate(slot->pointer, slot->size, 0);
+            slot->pointer = NULL;
+        } else {
+            slot->size = 8 + nextRandom(&random) % 57;
+            slot->pointer = reallocate(NULL, 0, slot->size);
+        }
+    }
+    double elapsed = VM_now() - start;
+
+    for (int i = 0; i < SLOTS; ++i) {
+        if (slots[i].pointer != NULL) reallocate(slots[i].pointer, slots[i].size, 0);
+        slots[i].pointer = NULL;
+    }
+    return elapsed;
+}
+
+// Grows many small arrays the way chunks, constant pools and tables grow.
+static double grow() {
+    double start = VM_now();
+    int arrays = OPERATIONS / 16;
+    for (int i = 0; i < arrays; ++i) {
+        Value *values = NULL;
+        int capacity = 0;
+        while (capacity < 64) {
+            int oldCapacity = capacity;
+            capacity = GROW_CAPACITY(capacity);
+            values = GROW_ARRAY(Value, values, oldCapacity, capacity);
+        }
+        FREE_ARRAY(Value, values, capacity);
+    }
+    return VM_now() - start;
+}
+
+static double strings() {
+    const char *source =
+            "var s = \"\";\n"
+            "for (var i = 0; i < 300000; i = i + 1) {\n"
+            "  var a = \"ab\" + \"cd\";\n"
+            "  var b = a + \"ef\";\n"
+            "  s = b + a;\n"
+            "}\n";
+    double start = VM_now();
+    VM_interpret(source, strlen(source));
+    return VM_now() - start;
+}
+
+static void report(const char *name, double (*benchmark)(), int operations) {
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        VM_init();
+        double elapsed = benchmark();
+        VM_free();
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    printf("%-10s %10.2f %10.2f\n", name, best * 1e3, best * 1e9 / operations);
+}
+
+int main() {
+#ifdef POOL_ALLOCATOR
+    printf("allocator: size-class pools\n");
+#else
+    printf("allocator: malloc\n");
+#endif
+    printf("%-10s %10s %10s\n", "benchmark", "best ms", "ns/op");
+    report("churn", churn, OPERATIONS);
+    report("grow", grow, OPERATIONS / 16 * 4);
+    report("strings", strings, 300000);
+    return 0;
+}
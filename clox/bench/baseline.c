@@ -0,0 +1,151 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Runs scripts interpreted and with --baseline and compares how long each
+// takes, counting the baseline compiler's time in. Every script leaves its
+// answer in the global result, which has to come out the same both ways. To
+// compare against the switch interpreter, build with CLOX_THREADED_DISPATCH
+// OFF; the first line says which one this build has.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "baseline.h"
+#include "compilers.h"
+#include "object.h"
+#include "vm.h"
+
+#define RUNS 5
+#define COMPILES 1000
+
+typedef struct {
+    const char *name;
+    const char *source;
+} Workload;
+
+static const Workload workloads[] = {
+        {"sum",
+                "var result = 0;\n"
+                "for (var i = 0; i < 5000000; i = i + 1) {\n"
+                "  result = result + i * 2 - i / 4;\n"
+                "}\n"},
+        {"branches",
+                "var result = 0;\n"
+                "{\n"
+                "  var small = 0;\n"
+                "  var large = 0;\n"
+                "  for (var i = 0; i < 5000000; i = i + 1) {\n"
+                "    if (i < 5000000 / 2) small = small + 1; else large = large + i;\n"
+                "  }\n"
+                "  result = small + large;\n"
+                "}\n"},
+        {"leibniz",
+                "var result = 0;\n"
+                "var sign = 1;\n"
+                "for (var term = 0; term < 5000000; term = term + 1) {\n"
+                "  result = result + sign * 4 / (2 * term + 1);\n"
+                "  sign = -sign;\n"
+                "}\n"},
+        {"strings",
+                "var result = 0;\n"
+                "for (var i = 0; i < 1000000; i = i + 1) {\n"
+                "  var s = \"a\" + \"b\";\n"
+                "  if (s == \"ab\" and !(s != \"ab\")) result = result + 1;\n"
+                "}\n"},
+};
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+static bool globalNumber(const char *name, double *value) {
+    size_t length = strlen(name);
+    for (int i = 0; i < vm.globals.count; ++i) {
+        ObjString *global = vm.globals.names[i];
+        if ((size_t) global->length == length && memcmp(global->chars, name, length) == 0) {
+            if (!IS_NUMBER(vm.globals.values[i])) return false;
+            *value = AS_NUMBER(vm.globals.values[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the best time in seconds, or -1 if the script failed.
+static double measure(const Workload *workload, bool baseline, double *result) {
+    compilerOptions.baseline = baseline;
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        VM_init();
+        double start = now();
+        InterpretResult interpreted = VM_interpret(workload->source, strlen(workload->source));
+        double elapsed = now() - start;
+        bool answered = interpreted == INTERPRET_OK && globalNumber("result", result);
+        VM_free();
+
+        if (!answered) return -1;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// Returns the time Baseline_compile takes for the script's chunk, in seconds,
+// and how many bytes of code it makes of how many of bytecode.
+static double measureCompile(const Workload *workload, size_t *bytecode, size_t *native) {
+    VM_init();
+    Chunk chunk;
+    Chunk_init(&chunk);
+    double elapsed = -1;
+    if (compile(workload->source, strlen(workload->source), &chunk)) {
+        BaselineCode code;
+        double start = now();
+        for (int i = 0; i < COMPILES; ++i) {
+            if (!Baseline_compile(&chunk, &code)) break;
+            *native = code.size;
+            Baseline_free(&code);
+            elapsed = (now() - start) / (i + 1);
+        }
+        *bytecode = (size_t) chunk.count;
+    }
+    Chunk_free(&chunk);
+    VM_free();
+    return elapsed;
+}
+
+int main() {
+#ifdef THREADED_DISPATCH
+    printf("run() dispatches with computed gotos\n");
+#else
+    printf("run() dispatches with a switch\n");
+#endif
+    printf("%-10s %12s %10s %12s %8s %12s %14s\n",
+           "workload", "result", "interp ms", "baseline ms", "speedup", "compile us", "bytes");
+
+    size_t count = sizeof(workloads) / sizeof(workloads[0]);
+    for (size_t i = 0; i < count; ++i) {
+        const Workload *workload = &workloads[i];
+        double interpretedResult;
+        double baselineResult;
+        double interpreted = measure(workload, false, &interpretedResult);
+        double baseline = measure(workload, true, &baselineResult);
+        size_t bytecode = 0;
+        size_t native = 0;
+        double compiling = measureCompile(workload, &bytecode, &native);
+        if (interpreted < 0 || baseline < 0 || compiling < 0) {
+            fprintf(stderr, "Workload '%s' failed.\n", workload->name);
+            return 1;
+        }
+        if (interpretedResult != baselineResult) {
+            fprintf(stderr, "Workload '%s' came out %.17g interpreted and %.17g with --baseline.\n",
+                    workload->name, interpretedResult, baselineResult);
+            return 1;
+        }
+        printf("%-10s %12.6g %10.2f %12.2f %7.1fx %12.2f %6zu -> %5zu\n", workload->name, baselineResult,
+               interpreted * 1e3, baseline * 1e3, interpreted / baseline, compiling * 1e6, bytecode, native);
+    }
+    return 0;
+}
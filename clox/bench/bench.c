@@ -0,0 +1,259 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Runs every script of the benchmark corpus, plus a large generated script,
+// a number of times through VM_interpret and prints the wall time and
+// allocations of each as JSON, so that runs of different builds can be diffed.
+//
+//   clox-bench [--runs N] [script.lox...]
+//
+// Without scripts it runs bench/corpus/*.lox. Workloads must not print.
+//
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+
+#define DEFAULT_RUNS 10
+#define GENERATED_GLOBALS 20000
+#define GENERATED_BLOCKS 5000
+
+typedef struct {
+    char *name;
+    char *source;
+} Workload;
+
+typedef struct {
+    Workload *workloads;
+    int count;
+    int capacity;
+} Workloads;
+
+typedef struct {
+    char *chars;
+    size_t length;
+    size_t capacity;
+} Source;
+
+static void addWorkload(Workloads *workloads, const char *name, char *source) {
+    if (workloads->count == workloads->capacity) {
+        workloads->capacity = workloads->capacity < 8 ? 8 : workloads->capacity * 2;
+        workloads->workloads = realloc(workloads->workloads, sizeof(Workload) * workloads->capacity);
+        if (workloads->workloads == NULL) exit(1);
+    }
+    Workload *workload = &workloads->workloads[workloads->count++];
+    workload->name = strdup(name);
+    workload->source = source;
+}
+
+static char *readFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        exit(74);
+    }
+    fseek(file, 0L, SEEK_END);
+    size_t size = ftell(file);
+    rewind(file);
+
+    char *buffer = malloc(size + 1);
+    if (buffer == NULL || fread(buffer, 1, size, file) < size) {
+        fprintf(stderr, "Could not read file \"%s\".\n", path);
+        exit(74);
+    }
+    buffer[size] = '\0';
+    fclose(file);
+    return buffer;
+}
+
+static void addScript(Workloads *workloads, const char *path) {
+    const char *name = strrchr(path, '/');
+    name = name == NULL ? path : name + 1;
+    char *stem = strdup(name);
+    char *extension = strrchr(stem, '.');
+    if (extension != NULL) *extension = '\0';
+    addWorkload(workloads, stem, readFile(path));
+    free(stem);
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+static void addCorpus(Workloads *workloads, const char *directory) {
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Could not open the corpus \"%s\".\n", directory);
+        exit(74);
+    }
+    char **paths = NULL;
+    int count = 0;
+    for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        size_t length = strlen(entry->d_name);
+        if (length < 4 || strcmp(entry->d_name + length - 4, ".lox") != 0) continue;
+        paths = realloc(paths, sizeof(char *) * (count + 1));
+        if (paths == NULL) exit(1);
+        paths[count] = malloc(strlen(directory) + length + 2);
+        if (paths[count] == NULL) exit(1);
+        sprintf(paths[count++], "%s/%s", directory, entry->d_name);
+    }
+    closedir(dir);
+
+    qsort(paths, count, sizeof(char *), compareNames); // readdir has no order
+    for (int i = 0; i < count; ++i) {
+        addScript(workloads, paths[i]);
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+static void appendLine(Source *source, const char *format, ...) {
+    if (source->capacity - source->length < 128) {
+        source->capacity = source->capacity < 1024 ? 1024 : source->capacity * 2;
+        source->chars = realloc(source->chars, source->capacity);
+        if (source->chars == NULL) exit(1);
+    }
+    va_list args;
+    va_start(args, format);
+    source->length += vsnprintf(source->chars + source->length, source->capacity - source->length, format, args);
+    va_end(args);
+    source->chars[source->length++] = '\n';
+    source->chars[source->length] = '\0';
+}
+
+// Mostly compile time: many globals and constants, and blocks that run once.
+static char *generate() {
+    Source source = {NULL, 0, 0};
+    for (int i = 0; i < GENERATED_GLOBALS; ++i) {
+        appendLine(&source, "var g%d = %d.5;", i, i);
+    }
+    for (int i = 0; i < GENERATED_BLOCKS; ++i) {
+        appendLine(&source, "{");
+        appendLine(&source, "  var a = g%d * 2;", i);
+        appendLine(&source, "  var b = \"name%d\";", i);
+        appendLine(&source, "  if (a > g%d and b != \"other\") g%d = a - 1; else g%d = a + 1;", i + 1, i, i);
+        appendLine(&source, "}");
+    }
+    return source.chars;
+}
+
+static int compareTimes(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// The nearest-rank percentile of sorted times.
+static double percentile(double *times, int count, int percent) {
+    int rank = (percent * count + 99) / 100;
+    return times[rank < 1 ? 0 : rank - 1];
+}
+
+static bool measure(Workload *workload, int runs, bool last) {
+    double *times = malloc(sizeof(double) * runs);
+    if (times == NULL) exit(1);
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    for (int run = 0; run < runs; ++run) {
+        VM_init();
+        double start = VM_now();
+        InterpretResult result = VM_interpret(workload->source, strlen(workload->source));
+        times[run] = VM_now() - start;
+        allocations = vm.allocationCount;
+        allocatedBytes = vm.allocatedBytes;
+        VM_free();
+
+        if (result != INTERPRET_OK) {
+            fprintf(stderr, "Workload '%s' failed.\n", workload->name);
+            free(times);
+            return false;
+        }
+    }
+
+    qsort(times, runs, sizeof(double), compareTimes);
+    printf("    {\"name\": \"%s\", \"min_ms\": %.3f, \"median_ms\": %.3f, \"p99_ms\": %.3f, "
+           "\"allocations\": %llu, \"allocated_bytes\": %llu}%s\n",
+           workload->name, times[0] * 1e3, percentile(times, runs, 50) * 1e3, percentile(times, runs, 99) * 1e3,
+           (unsigned long long) allocations, (unsigned long long) allocatedBytes, last ? "" : ",");
+    free(times);
+    return true;
+}
+
+static const char *boolean(bool value) {
+    return value ? "true" : "false";
+}
+
+// The options the numbers depend on, so that diffs show what was compared.
+static void printBuild() {
+    bool nanBoxing = false;
+    bool threadedDispatch = false;
+    bool poolAllocator = false;
+    bool regionAllocation = false;
+    bool shortStrings = false;
+#ifdef NAN_BOXING
+    nanBoxing = true;
+#endif
+#ifdef THREADED_DISPATCH
+    threadedDispatch = true;
+#endif
+#ifdef POOL_ALLOCATOR
+    poolAllocator = true;
+#endif
+#ifdef REGION_ALLOCATION
+    regionAllocation = true;
+#endif
+#ifdef SHORT_STRINGS
+    shortStrings = true;
+#endif
+    printf("  \"build\": {\"nan_boxing\": %s, \"threaded_dispatch\": %s, \"pool_allocator\": %s, "
+           "\"region_allocation\": %s, \"short_strings\": %s},\n",
+           boolean(nanBoxing), boolean(threadedDispatch), boolean(poolAllocator), boolean(regionAllocation),
+           boolean(shortStrings));
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: clox-bench [--runs N] [script.lox...]\n");
+    exit(64);
+}
+
+int main(int argc, const char *argv[]) {
+    int runs = DEFAULT_RUNS;
+    Workloads workloads = {NULL, 0, 0};
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--runs") == 0) {
+            if (i + 1 == argc) usage();
+            runs = atoi(argv[++i]);
+            if (runs < 1) usage();
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else {
+            addScript(&workloads, argv[i]);
+        }
+    }
+    if (workloads.count == 0) {
+        addCorpus(&workloads, CLOX_BENCH_CORPUS);
+        addWorkload(&workloads, "generated", generate());
+    }
+
+    printf("{\n");
+    printBuild();
+    printf("  \"runs\": %d,\n", runs);
+    printf("  \"workloads\": [\n");
+    bool failed = false;
+    for (int i = 0; i < workloads.count && !failed; ++i) {
+        failed = !measure(&workloads.workloads[i], runs, i == workloads.count - 1);
+    }
+    printf("  ]\n");
+    printf("}\n");
+
+    for (int i = 0; i < workloads.count; ++i) {
+        free(workloads.workloads[i].name);
+        free(workloads.workloads[i].source);
+    }
+    free(workloads.workloads);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Measures the average cost of one instruction dispatch in run(). Build it
+// with -DCLOX_THREADED_DISPATCH=ON and OFF to compare the two dispatch modes.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm.h"
+
+#define RUNS 5
+
+typedef struct {
+    const char *name;
+    const char *source;
+} Workload;
+
+static const Workload workloads[] = {
+        {"arithmetic",
+                "{\n"
+                "  var sum = 0;\n"
+                "  for (var i = 0; i < 2000000; i = i + 1) {\n"
+                "    sum = sum + i * 2 - i / 4;\n"
+                "  }\n"
+                "}\n"},
+        {"branches",
+                "{\n"
+                "  var odd = 0;\n"
+                "  var even = 0;\n"
+                "  var flip = false;\n"
+                "  for (var i = 0; i < 1000000; i = i + 1) {\n"
+                "    if (flip) odd = odd + 1; else even = even + 1;\n"
+                "    flip = !flip;\n"
+                "    if (i >= 500000 and even != odd) flip = !flip;\n"
+                "  }\n"
+                "}\n"},
+        {"globals",
+                "var counter = 0;\n"
+                "var limit = 1000000;\n"
+                "while (counter < limit) {\n"
+                "  counter = counter + 1;\n"
+                "}\n"},
+        {"mixed",
+                "var total = 0;\n"
+                "{\n"
+                "  var a = 1;\n"
+                "  var b = 2;\n"
+                "  for (var i = 0; i < 500000; i = i + 1) {\n"
+                "    var c = a + b * -i;\n"
+                "    if (c < 0 or c == nil) total = total - c; else total = total + c;\n"
+                "    a = b;\n"
+                "    b = i;\n"
+                "  }\n"
+                "}\n"},
+};
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+int main() {
+#ifdef THREADED_DISPATCH
+    printf("dispatch: threaded\n");
+#else
+    printf("dispatch: switch\n");
+#endif
+    printf("%-12s %14s %10s %12s\n", "workload", "dispatches", "best ms", "ns/dispatch");
+
+    size_t count = sizeof(workloads) / sizeof(workloads[0]);
+    for (size_t i = 0; i < count; ++i) {
+        double best = -1;
+        uint64_t dispatches = 0;
+        for (int run = 0; run < RUNS; ++run) {
+            VM_init();
+            double start = now();
+            InterpretResult result = VM_interpret(workloads[i].source, strlen(workloads[i].source));
+            double elapsed = now() - start;
+            dispatches = vm.dispatchCount;
+            VM_free();
+
+            if (result != INTERPRET_OK) {
+                fprintf(stderr, "Workload '%s' failed.\n", workloads[i].name);
+                return 1;
+            }
+            if (best < 0 || elapsed < best) best = elapsed;
+        }
+        printf("%-12s %14llu %10.2f %12.3f\n", workloads[i].name,
+               (unsigned long long) dispatches, best * 1e3, best * 1e9 / (double) dispatches);
+    }
+    return 0;
+}
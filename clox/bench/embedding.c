@@ -0,0 +1,86 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Evaluates a small rule, written in Lox, against many inputs through libclox:
+// once compiling it for every evaluation with Clox_interpret, and once running
+// a program compiled up front with Clox_run. Inputs go in and the verdict comes
+// out through globals, and both ways have to agree on every verdict.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "clox.h"
+
+#define EVALUATIONS 200000
+#define RUNS 5
+
+static const char *RULE =
+        "var score = 0;\n"
+        "if (amount > 1000) score = score + 40;\n"
+        "if (amount > 10000) score = score + 30;\n"
+        "if (country == \"SE\" or country == \"NO\") score = score - 10;\n"
+        "if (country == \"unknown\") score = score + 50;\n"
+        "if (attempts > 3) score = score + 5 * attempts;\n"
+        "var approved = score < 50;\n";
+
+static const char *COUNTRIES[] = {"SE", "NO", "DE", "unknown"};
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+// Runs every evaluation and returns the best time, in seconds, and how many
+// were approved.
+static double measure(CloxProgram *program, int *approvals) {
+    double best = -1;
+    size_t ruleLength = strlen(RULE);
+    for (int run = 0; run < RUNS; ++run) {
+        Clox_resetGlobals();
+        *approvals = 0;
+        double start = now();
+        for (int i = 0; i < EVALUATIONS; ++i) {
+            const char *country = COUNTRIES[i % 4];
+            Clox_setNumber("amount", (i * 37) % 20000);
+            Clox_setString("country", country, strlen(country));
+            Clox_setNumber("attempts", i % 7);
+            CloxResult result = program != NULL ? Clox_run(program) : Clox_interpret(RULE, ruleLength);
+            bool approved;
+            if (result != CLOX_OK || !Clox_getBool("approved", &approved)) {
+                fprintf(stderr, "The rule failed.\n");
+                return -1;
+            }
+            *approvals += approved;
+        }
+        double elapsed = now() - start;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int main() {
+    Clox_init();
+    int compiledApprovals;
+    int interpretedApprovals;
+    CloxProgram *program = Clox_compile(RULE, strlen(RULE));
+    if (program == NULL) return 1;
+    double interpreted = measure(NULL, &interpretedApprovals);
+    double compiled = measure(program, &compiledApprovals);
+    Clox_freeProgram(program);
+    Clox_free();
+    if (interpreted < 0 || compiled < 0) return 1;
+    if (interpretedApprovals != compiledApprovals) {
+        fprintf(stderr, "%d approvals compiling every time, %d compiling once.\n",
+                interpretedApprovals, compiledApprovals);
+        return 1;
+    }
+
+    printf("%d evaluations, %d approved\n", EVALUATIONS, compiledApprovals);
+    printf("%-16s %10s %14s\n", "rule", "best ms", "ns/evaluation");
+    printf("%-16s %10.2f %14.1f\n", "Clox_interpret", interpreted * 1e3, interpreted * 1e9 / EVALUATIONS);
+    printf("%-16s %10.2f %14.1f\n", "Clox_run", compiled * 1e3, compiled * 1e9 / EVALUATIONS);
+    return 0;
+}
@@ -0,0 +1,50 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Reports how many bytes the value representation costs in the structures
+// that hold the most values: the VM stack, a constant pool and the globals.
+//
+
+#include <stdio.h>
+
+#include "vm.h"
+#include "object.h"
+#include "memory.h"
+
+#define GLOBAL_COUNT 10000
+
+int main() {
+    VM_init();
+
+    ValueArray constants;
+    ValueArray_init(&constants);
+
+    char name[32];
+    for (int i = 0; i < GLOBAL_COUNT; ++i) {
+        int length = snprintf(name, sizeof(name), "global%d", i);
+        int slot = VM_globalSlot(ObjString_copyFrom(name, length));
+        vm.globals.values[slot] = NUMBER_VAL(i);
+        ValueArray_write(&constants, NUMBER_VAL(i));
+    }
+
+#ifdef NAN_BOXING
+    printf("representation:   nan-boxed\n");
+#else
+    printf("representation:   tagged union\n");
+#endif
+    printf("sizeof(Value):    %zu bytes\n", sizeof(Value));
+    printf("sizeof(Entry):    %zu bytes, and a control byte\n", sizeof(Entry));
+    printf("VM stack:         %zu bytes (%d slots)\n", sizeof(Value) * vm.stackCapacity, vm.stackCapacity);
+    printf("constant pool:    %zu bytes (%d constants)\n",
+           sizeof(Value) * constants.capacity, constants.count);
+    printf("global slots:     %zu bytes (%d values)\n",
+           sizeof(Value) * vm.globals.capacity, vm.globals.count);
+    printf("global names:     %zu bytes (%d entries)\n",
+           (sizeof(Entry) + 1) * vm.globals.slots.capacity, vm.globals.slots.count);
+    printf("strings table:    %zu bytes (%d entries)\n",
+           (sizeof(Entry) + 1) * vm.strings.capacity, vm.strings.count);
+
+    ValueArray_free(&constants);
+    VM_free();
+    return 0;
+}
@@ -0,0 +1,110 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Compiles and runs a 100k-line machine-generated script, the kind of input
+// that needs long constants, long global slots, wide jumps and wide locals.
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compilers.h"
+#include "vm.h"
+
+#define GLOBAL_LINES 70000
+#define RULE_LINES 20000
+#define LOCAL_LINES 1000
+#define LOOP_LINES 8000
+
+typedef struct {
+    char *chars;
+    size_t length;
+    size_t capacity;
+    int lines;
+} Source;
+
+static void appendLine(Source *source, const char *format, ...) {
+    if (source->capacity - source->length < 128) {
+        source->capacity = source->capacity < 1024 ? 1024 : source->capacity * 2;
+        source->chars = realloc(source->chars, source->capacity);
+        if (source->chars == NULL) exit(1);
+    }
+    va_list args;
+    va_start(args, format);
+    source->length += vsnprintf(source->chars + source->length, source->capacity - source->length, format, args);
+    va_end(args);
+    source->chars[source->length++] = '\n';
+    source->chars[source->length] = '\0';
+    source->lines++;
+}
+
+static Source generate() {
+    Source source = {NULL, 0, 0, 0};
+    for (int i = 0; i < GLOBAL_LINES; ++i) {
+        appendLine(&source, "var g%d = %d.5;", i, i);
+    }
+
+    appendLine(&source, "var rule = 0;");
+    appendLine(&source, "if (g1 < g2) {");
+    for (int i = 0; i < RULE_LINES; ++i) {
+        appendLine(&source, "  rule = rule + g%d * 2;", i);
+    }
+    appendLine(&source, "}");
+
+    appendLine(&source, "{");
+    appendLine(&source, "  var l0 = 0;");
+    for (int i = 1; i < LOCAL_LINES; ++i) {
+        appendLine(&source, "  var l%d = l%d + 1;", i, i - 1);
+    }
+    appendLine(&source, "  rule = rule + l%d;", LOCAL_LINES - 1);
+    appendLine(&source, "}");
+
+    appendLine(&source, "var k = 0;");
+    appendLine(&source, "while (k < 3) {");
+    for (int i = 0; i < LOOP_LINES; ++i) {
+        appendLine(&source, "  rule = rule + 1;");
+    }
+    appendLine(&source, "  k = k + 1;");
+    appendLine(&source, "}");
+    appendLine(&source, "print rule;");
+    return source;
+}
+
+int main() {
+    Source source = generate();
+    printf("source:    %d lines, %zu bytes\n", source.lines, source.length);
+
+    VM_init();
+    Chunk chunk;
+    Chunk_init(&chunk);
+    double start = VM_now();
+    bool compiled = compile(source.chars, source.length, &chunk);
+    double compileTime = VM_now() - start;
+    if (!compiled) {
+        fprintf(stderr, "Generated script failed to compile.\n");
+        return 1;
+    }
+    printf("compile:   %.2f ms\n", compileTime * 1e3);
+    printf("chunk:     %d bytes of code, %d constants, %d globals\n",
+           chunk.count, chunk.constants.count, vm.globals.count);
+    printf("lines:     %d runs, %zu bytes (%zu bytes at one int per byte of code)\n",
+           chunk.lineCount, chunk.lineCount * sizeof(LineStart), chunk.count * sizeof(int));
+    Chunk_free(&chunk);
+    VM_free();
+
+    VM_init();
+    start = VM_now();
+    InterpretResult result = VM_interpret(source.chars, source.length);
+    double totalTime = VM_now() - start;
+    VM_free();
+    if (result != INTERPRET_OK) {
+        fprintf(stderr, "Generated script failed to run.\n");
+        return 1;
+    }
+    printf("interpret: %.2f ms (compile and run)\n", totalTime * 1e3);
+
+    free(source.chars);
+    return 0;
+}
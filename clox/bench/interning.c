@@ -0,0 +1,79 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Measures what strings cost the allocator and the interning table: how long
+// interning a string that is already interned takes, how many allocations a
+// new one needs, and how many a script that concatenates short strings makes.
+// Build with CLOX_SHORT_STRINGS ON and OFF to compare.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "vm.h"
+#include "object.h"
+
+#define STRING_COUNT 10000
+#define LOOKUPS 10000000
+#define RUNS 5
+
+static const char *SCRIPT =
+        "var a = \"ab\";\n"
+        "var b = \"cd\";\n"
+        "var matches = 0;\n"
+        "for (var i = 0; i < 200000; i = i + 1) {\n"
+        "  var word = a + b;\n"
+        "  if (word == \"abcd\") matches = matches + 1;\n"
+        "}\n";
+
+static char names[STRING_COUNT][16];
+static int lengths[STRING_COUNT];
+
+// The best time of looking up strings that are all interned already.
+static double measureHits() {
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        double start = VM_now();
+        for (int i = 0; i < LOOKUPS; ++i) {
+            ObjString_copyFrom(names[i % STRING_COUNT], lengths[i % STRING_COUNT]);
+        }
+        double elapsed = VM_now() - start;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int main() {
+#ifdef SHORT_STRINGS
+    printf("with short strings\n");
+#else
+    printf("without short strings\n");
+#endif
+    VM_init();
+
+    // globals keep their names alive, and with them the interned strings
+    for (int i = 0; i < STRING_COUNT; ++i) {
+        lengths[i] = snprintf(names[i], sizeof(names[i]), "string-%d", i);
+    }
+    uint64_t before = vm.allocationCount;
+    for (int i = 0; i < STRING_COUNT; ++i) {
+        VM_globalSlot(ObjString_copyFrom(names[i], lengths[i]));
+    }
+    uint64_t misses = vm.allocationCount - before;
+
+    double hits = measureHits();
+    printf("interning a new string:  %.2f allocations, table and globals growth included\n",
+           (double) misses / STRING_COUNT);
+    printf("interning a known one:   %.1f ns\n", hits * 1e9 / LOOKUPS);
+    VM_free();
+
+    VM_init();
+    before = vm.allocationCount;
+    double start = VM_now();
+    InterpretResult result = VM_interpret(SCRIPT, strlen(SCRIPT));
+    double elapsed = VM_now() - start;
+    printf("short concatenations:    %llu allocations, %.2f ms\n",
+           (unsigned long long) (vm.allocationCount - before), elapsed * 1e3);
+    VM_free();
+    return result == INTERPRET_OK ? 0 : 1;
+}
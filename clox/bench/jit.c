@@ -0,0 +1,175 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Runs numeric loops interpreted and with --jit, and the same loops written in
+// C, and compares how long each takes. Every script leaves its answer in the
+// global result, which has to come out the same as the C version's.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "compilers.h"
+#include "object.h"
+#include "vm.h"
+
+#define RUNS 5
+#define ITERATIONS 5000000
+
+typedef struct {
+    const char *name;
+    const char *source;
+    double (*native)(int iterations);
+} Workload;
+
+static double sum(int iterations) {
+    double result = 0;
+    for (double i = 0; i < iterations; i = i + 1) {
+        result = result + i * 2 - i / 4;
+    }
+    return result;
+}
+
+static double branches(int iterations) {
+    double small = 0;
+    double large = 0;
+    for (double i = 0; i < iterations; i = i + 1) {
+        if (i < iterations / 2) small = small + 1; else large = large + i;
+    }
+    return small + large;
+}
+
+static double leibniz(int iterations) {
+    double result = 0;
+    double sign = 1;
+    for (double term = 0; term < iterations; term = term + 1) {
+        result = result + sign * 4 / (2 * term + 1);
+        sign = -sign;
+    }
+    return result;
+}
+
+static double newton(int iterations) {
+    double result = 0;
+    double x = 1;
+    for (double i = 0; i < iterations; i = i + 1) {
+        x = x - (x * x - 2) / (2 * x);
+        result = result + x;
+    }
+    return result;
+}
+
+static const Workload workloads[] = {
+        {"sum",
+                "var result = 0;\n"
+                "for (var i = 0; i < 5000000; i = i + 1) {\n"
+                "  result = result + i * 2 - i / 4;\n"
+                "}\n", sum},
+        {"branches",
+                "var result = 0;\n"
+                "{\n"
+                "  var small = 0;\n"
+                "  var large = 0;\n"
+                "  for (var i = 0; i < 5000000; i = i + 1) {\n"
+                "    if (i < 5000000 / 2) small = small + 1; else large = large + i;\n"
+                "  }\n"
+                "  result = small + large;\n"
+                "}\n", branches},
+        {"leibniz",
+                "var result = 0;\n"
+                "var sign = 1;\n"
+                "for (var term = 0; term < 5000000; term = term + 1) {\n"
+                "  result = result + sign * 4 / (2 * term + 1);\n"
+                "  sign = -sign;\n"
+                "}\n", leibniz},
+        {"newton",
+                "var result = 0;\n"
+                "{\n"
+                "  var x = 1;\n"
+                "  for (var i = 0; i < 5000000; i = i + 1) {\n"
+                "    x = x - (x * x - 2) / (2 * x);\n"
+                "    result = result + x;\n"
+                "  }\n"
+                "}\n", newton},
+};
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+static bool globalNumber(const char *name, double *value) {
+    size_t length = strlen(name);
+    for (int i = 0; i < vm.globals.count; ++i) {
+        ObjString *global = vm.globals.names[i];
+        if ((size_t) global->length == length && memcmp(global->chars, name, length) == 0) {
+            if (!IS_NUMBER(vm.globals.values[i])) return false;
+            *value = AS_NUMBER(vm.globals.values[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the best time in seconds, or -1 if the script failed.
+static double measure(const Workload *workload, bool jit, double *result) {
+    compilerOptions.jit = jit;
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        VM_init();
+        double start = now();
+        InterpretResult interpreted = VM_interpret(workload->source, strlen(workload->source));
+        double elapsed = now() - start;
+        bool answered = interpreted == INTERPRET_OK && globalNumber("result", result);
+        VM_free();
+
+        if (!answered) return -1;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+static double measureNative(const Workload *workload, double *result) {
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        double start = now();
+        *result = workload->native(ITERATIONS);
+        double elapsed = now() - start;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int main() {
+    printf("%-10s %12s %10s %10s %8s %10s\n", "workload", "result", "interp ms", "jit ms", "speedup", "C ms");
+
+    size_t count = sizeof(workloads) / sizeof(workloads[0]);
+    for (size_t i = 0; i < count; ++i) {
+        const Workload *workload = &workloads[i];
+        double interpretedResult;
+        double jitResult;
+        double interpreted = measure(workload, false, &interpretedResult);
+        double jit = measure(workload, true, &jitResult);
+        if (interpreted < 0 || jit < 0) {
+            fprintf(stderr, "Workload '%s' failed.\n", workload->name);
+            return 1;
+        }
+        if (interpretedResult != jitResult) {
+            fprintf(stderr, "Workload '%s' came out %.17g interpreted and %.17g with --jit.\n",
+                    workload->name, interpretedResult, jitResult);
+            return 1;
+        }
+
+        double nativeResult;
+        double native = measureNative(workload, &nativeResult);
+        if (nativeResult != jitResult) {
+            fprintf(stderr, "Workload '%s' came out %.17g in C.\n", workload->name, nativeResult);
+            return 1;
+        }
+        printf("%-10s %12.6g %10.2f %10.2f %7.1fx %10.2f\n", workload->name, jitResult,
+               interpreted * 1e3, jit * 1e3, interpreted / jit, native * 1e3);
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Writes a few tens of megabytes of Lox to a file and times getting from its
+// path to the first token, and to the last, when it is mapped and when it is
+// streamed into a buffer the way stdin is.
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "scanner.h"
+#include "source.h"
+#include "vm.h"
+
+#define BLOCKS 400000
+#define RUNS 5
+
+static void writeLine(FILE *file, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(file, format, args);
+    va_end(args);
+    fputc('\n', file);
+}
+
+static void generate(FILE *file) {
+    for (int i = 0; i < BLOCKS; ++i) {
+        writeLine(file, "// Block %d adds a little to the total, like the ones before it.", i);
+        writeLine(file, "{");
+        writeLine(file, "    var step = %d.5;", i % 1000);
+        writeLine(file, "    total = total + step * 2; // and then some");
+        writeLine(file, "}");
+    }
+}
+
+static bool load(const char *path, bool mapped, SourceFile *file) {
+    if (mapped) return SourceFile_load(path, file);
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL) return false;
+    bool read = SourceFile_stream(stream, file);
+    fclose(stream);
+    return read;
+}
+
+// The best times to the first token and to the end, in seconds.
+static void measure(const char *path, bool mapped, double *first, double *last) {
+    *first = -1;
+    *last = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        double start = VM_now();
+        SourceFile file;
+        if (!load(path, mapped, &file)) {
+            fprintf(stderr, "Could not load the generated script.\n");
+            exit(1);
+        }
+        Scanner_init(file.chars, file.length);
+        Token token = Scanner_nextToken();
+        double firstElapsed = VM_now() - start;
+        while (token.type != TOKEN_EOF && token.type != TOKEN_ERROR) token = Scanner_nextToken();
+        double lastElapsed = VM_now() - start;
+        SourceFile_unload(&file);
+
+        if (*first < 0 || firstElapsed < *first) *first = firstElapsed;
+        if (*last < 0 || lastElapsed < *last) *last = lastElapsed;
+    }
+}
+
+int main() {
+    char path[] = "/tmp/clox-loadingXXXXXX.lox";
+    int descriptor = mkstemps(path, 4);
+    FILE *file = descriptor < 0 ? NULL : fdopen(descriptor, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not create a script to load.\n");
+        return 1;
+    }
+    generate(file);
+    long size = ftell(file);
+    fclose(file);
+
+    printf("%.1f MB of source\n", size / 1e6);
+    printf("%-10s %14s %14s\n", "loading", "first token ms", "last token ms");
+    double first, last;
+    measure(path, true, &first, &last);
+    printf("%-10s %14.3f %14.2f\n", "mapped", first * 1e3, last * 1e3);
+    measure(path, false, &first, &last);
+    printf("%-10s %14.3f %14.2f\n", "streamed", first * 1e3, last * 1e3);
+
+    remove(path);
+    return 0;
+}
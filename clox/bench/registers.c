@@ -0,0 +1,106 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Runs the same scripts on the stack VM and on the register VM, and compares
+// how many instructions each executes and how long each takes.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "compilers.h"
+#include "vm.h"
+
+#define RUNS 5
+
+typedef struct {
+    const char *name;
+    const char *source;
+} Workload;
+
+static const Workload workloads[] = {
+        {"arithmetic",
+                "{\n"
+                "  var sum = 0;\n"
+                "  for (var i = 0; i < 2000000; i = i + 1) {\n"
+                "    sum = sum + i * 2 - i / 4;\n"
+                "  }\n"
+                "}\n"},
+        {"branches",
+                "{\n"
+                "  var odd = 0;\n"
+                "  var even = 0;\n"
+                "  var flip = false;\n"
+                "  for (var i = 0; i < 1000000; i = i + 1) {\n"
+                "    if (flip) odd = odd + 1; else even = even + 1;\n"
+                "    flip = !flip;\n"
+                "    if (i >= 500000 and even != odd) flip = !flip;\n"
+                "  }\n"
+                "}\n"},
+        {"globals",
+                "var counter = 0;\n"
+                "var limit = 1000000;\n"
+                "while (counter < limit) {\n"
+                "  counter = counter + 1;\n"
+                "}\n"},
+        {"mixed",
+                "var total = 0;\n"
+                "{\n"
+                "  var a = 1;\n"
+                "  var b = 2;\n"
+                "  for (var i = 0; i < 500000; i = i + 1) {\n"
+                "    var c = a + b * -i;\n"
+                "    if (c < 0 or c == nil) total = total - c; else total = total + c;\n"
+                "    a = b;\n"
+                "    b = i;\n"
+                "  }\n"
+                "}\n"},
+};
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+typedef struct {
+    uint64_t instructions;
+    double best;
+} Measurement;
+
+static bool measure(const Workload *workload, bool registerVM, Measurement *measurement) {
+    compilerOptions.registerVM = registerVM;
+    measurement->best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        VM_init();
+        double start = now();
+        InterpretResult result = VM_interpret(workload->source, strlen(workload->source));
+        double elapsed = now() - start;
+        measurement->instructions = vm.dispatchCount;
+        VM_free();
+
+        if (result != INTERPRET_OK) return false;
+        if (measurement->best < 0 || elapsed < measurement->best) measurement->best = elapsed;
+    }
+    return true;
+}
+
+int main() {
+    printf("%-12s %14s %14s %10s %10s %8s\n",
+           "workload", "stack instrs", "reg instrs", "stack ms", "reg ms", "speedup");
+
+    size_t count = sizeof(workloads) / sizeof(workloads[0]);
+    for (size_t i = 0; i < count; ++i) {
+        Measurement stack;
+        Measurement registers;
+        if (!measure(&workloads[i], false, &stack) || !measure(&workloads[i], true, &registers)) {
+            fprintf(stderr, "Workload '%s' failed.\n", workloads[i].name);
+            return 1;
+        }
+        printf("%-12s %14llu %14llu %10.2f %10.2f %7.2fx\n", workloads[i].name,
+               (unsigned long long) stack.instructions, (unsigned long long) registers.instructions,
+               stack.best * 1e3, registers.best * 1e3, stack.best / registers.best);
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Runs many small VM_interpret calls against one VM, the way the REPL or a
+// server handling submitted scripts does, and reports the per-request latency
+// distribution. Build it with -DCLOX_REGION_ALLOCATION=ON and OFF to compare.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+
+#define REQUESTS 20000
+
+static const char *source =
+        "var greeting = \"hello\" + \" \" + \"world\";\n"
+        "var count = 0;\n"
+        "{\n"
+        "  var label = \"item\";\n"
+        "  for (var i = 0; i < 50; i = i + 1) {\n"
+        "    var tmp = label + \"-\" + \"suffix\";\n"
+        "    if (tmp != label) count = count + 1;\n"
+        "  }\n"
+        "}\n"
+        "var last = greeting + \"!\";\n";
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+int main() {
+    static double latencies[REQUESTS];
+
+    VM_init();
+    double start = VM_now();
+    for (int i = 0; i < REQUESTS; ++i) {
+        double requestStart = VM_now();
+        if (VM_interpret(source, strlen(source)) != INTERPRET_OK) {
+            fprintf(stderr, "Request %d failed.\n", i);
+            return 1;
+        }
+        latencies[i] = VM_now() - requestStart;
+    }
+    double total = VM_now() - start;
+    VM_free();
+
+    qsort(latencies, REQUESTS, sizeof(double), compareDoubles);
+#ifdef REGION_ALLOCATION
+    printf("allocation: request regions\n");
+#else
+    printf("allocation: per object\n");
+#endif
+    printf("requests: %d in %.2f ms\n", REQUESTS, total * 1e3);
+    printf("p50:      %.2f us\n", latencies[REQUESTS / 2] * 1e6);
+    printf("p99:      %.2f us\n", latencies[REQUESTS * 99 / 100] * 1e6);
+    printf("max:      %.2f us\n", latencies[REQUESTS - 1] * 1e6);
+    return 0;
+}
@@ -0,0 +1,135 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Tokenizes a few megabytes of generated, indented and commented Lox and
+// reports the scanner's throughput, then times turning its number literals
+// into doubles with Scanner_parseNumber and with strtod. Build with
+// CLOX_SCANNER_SSE2 ON and OFF to compare skipping runs a block at a time.
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scanner.h"
+#include "vm.h"
+
+#define BLOCKS 20000
+#define RUNS 5
+
+typedef struct {
+    char *chars;
+    size_t length;
+    size_t capacity;
+} Source;
+
+static void appendLine(Source *source, const char *format, ...) {
+    size_t needed = source->length + 256;
+    if (needed > source->capacity) {
+        source->capacity = needed * 2;
+        source->chars = realloc(source->chars, source->capacity);
+        if (source->chars == NULL) exit(1);
+    }
+    va_list args;
+    va_start(args, format);
+    source->length += vsnprintf(source->chars + source->length, source->capacity - source->length, format, args);
+    va_end(args);
+    source->chars[source->length++] = '\n';
+    source->chars[source->length] = '\0';
+}
+
+static Source generate() {
+    Source source = {NULL, 0, 0};
+    for (int i = 0; i < BLOCKS; ++i) {
+        appendLine(&source, "// Block %d accumulates a few of the totals, like the ones before it.", i);
+        appendLine(&source, "var accumulated_total_%d = %d.25;", i, i);
+        appendLine(&source, "{");
+        appendLine(&source, "    var running_index = 0;");
+        appendLine(&source, "    while (running_index < %d) {", i % 100);
+        appendLine(&source, "        accumulated_total_%d = accumulated_total_%d + running_index * 1.5;", i, i);
+        appendLine(&source, "        running_index = running_index + 1; // one more");
+        appendLine(&source, "    }");
+        appendLine(&source, "    if (accumulated_total_%d >= 1000000 and true) print \"large\";", i);
+        appendLine(&source, "}");
+    }
+    return source;
+}
+
+static int scan(const char *source, size_t length) {
+    Scanner_init(source, length);
+    int tokens = 0;
+    for (;;) {
+        Token token = Scanner_nextToken();
+        if (token.type == TOKEN_EOF) return tokens;
+        if (token.type == TOKEN_ERROR) {
+            fprintf(stderr, "The generated script does not scan.\n");
+            exit(1);
+        }
+        tokens++;
+    }
+}
+
+static Token *numbersOf(const char *source, size_t length, int *count) {
+    int capacity = 1024;
+    Token *numbers = malloc(sizeof(Token) * capacity);
+    if (numbers == NULL) exit(1);
+    *count = 0;
+    Scanner_init(source, length);
+    for (Token token = Scanner_nextToken(); token.type != TOKEN_EOF; token = Scanner_nextToken()) {
+        if (token.type != TOKEN_NUMBER) continue;
+        if (*count == capacity) {
+            capacity *= 2;
+            numbers = realloc(numbers, sizeof(Token) * capacity);
+            if (numbers == NULL) exit(1);
+        }
+        numbers[(*count)++] = token;
+    }
+    return numbers;
+}
+
+static volatile double sink;
+
+static double parseNumbers(Token *numbers, int count, bool withStrtod) {
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        double sum = 0;
+        double start = VM_now();
+        for (int i = 0; i < count; ++i) {
+            sum += withStrtod ? strtod(numbers[i].start, NULL)
+                              : Scanner_parseNumber(numbers[i].start, numbers[i].length);
+        }
+        double elapsed = VM_now() - start;
+        sink = sum;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best * 1e9 / count;
+}
+
+int main() {
+#if defined(SCANNER_SSE2) && defined(__SSE2__)
+    printf("skipping with SSE2\n");
+#else
+    printf("skipping byte by byte\n");
+#endif
+    Source source = generate();
+
+    int tokens = 0;
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        double start = VM_now();
+        tokens = scan(source.chars, source.length);
+        double elapsed = VM_now() - start;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    printf("source:   %.1f MB, %d tokens\n", source.length / 1e6, tokens);
+    printf("scanning: %.1f MB/s, %.1f M tokens/s\n", source.length / best / 1e6, tokens / best / 1e6);
+
+    int count;
+    Token *numbers = numbersOf(source.chars, source.length, &count);
+    printf("numbers:  %.1f ns with Scanner_parseNumber, %.1f ns with strtod, %d literals\n",
+           parseNumbers(numbers, count, false), parseNumbers(numbers, count, true), count);
+
+    free(numbers);
+    free(source.chars);
+    return 0;
+}
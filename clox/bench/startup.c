@@ -0,0 +1,113 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Measures how long a large script that does little work takes from source to
+// finished, compiled from scratch and loaded from the bytecode cache.
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "vm.h"
+
+#define RUNS 10
+#define BLOCKS 5000
+
+typedef struct {
+    char *chars;
+    size_t length;
+    size_t capacity;
+} Source;
+
+static void appendLine(Source *source, const char *format, ...) {
+    if (source->capacity - source->length < 128) {
+        source->capacity = source->capacity < 1024 ? 1024 : source->capacity * 2;
+        source->chars = realloc(source->chars, source->capacity);
+        if (source->chars == NULL) exit(1);
+    }
+    va_list args;
+    va_start(args, format);
+    source->length += vsnprintf(source->chars + source->length, source->capacity - source->length, format, args);
+    va_end(args);
+    source->chars[source->length++] = '\n';
+    source->chars[source->length] = '\0';
+}
+
+static Source generate() {
+    Source source = {NULL, 0, 0};
+    for (int i = 0; i < BLOCKS; ++i) {
+        appendLine(&source, "var g%d = %d * 2 + 1;", i, i);
+        appendLine(&source, "{");
+        appendLine(&source, "  var a = g%d;", i);
+        appendLine(&source, "  var b = \"name%d\";", i);
+        appendLine(&source, "  if (a > %d and b != \"other\") a = a - 1; else a = a + 1;", i);
+        appendLine(&source, "}");
+    }
+    return source;
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+typedef enum {
+    NO_CACHE,
+    COLD_CACHE,
+    CACHE_HIT,
+} Mode;
+
+static double measure(Source *source, const char *cachePath, Mode mode) {
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        if (mode == COLD_CACHE) remove(cachePath);
+
+        VM_init();
+        double start = now();
+        InterpretResult result = mode == NO_CACHE
+                                 ? VM_interpret(source->chars, source->length)
+                                 : VM_interpretCached(source->chars, source->length, cachePath);
+        double elapsed = now() - start;
+        VM_free();
+
+        if (result != INTERPRET_OK) {
+            fprintf(stderr, "The generated script failed.\n");
+            exit(1);
+        }
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int main() {
+    Source source = generate();
+    char sourcePath[] = "/tmp/clox-startupXXXXXX.lox";
+    int file = mkstemps(sourcePath, 4);
+    if (file < 0) {
+        fprintf(stderr, "Could not create a script to cache.\n");
+        return 1;
+    }
+    close(file);
+    char *cachePath = Cache_pathFor(sourcePath);
+
+    double compiled = measure(&source, cachePath, NO_CACHE);
+    double cold = measure(&source, cachePath, COLD_CACHE);
+    double hit = measure(&source, cachePath, CACHE_HIT);
+
+    printf("%d lines, %zu bytes of source\n", BLOCKS * 6, source.length);
+    printf("%-12s %10s %8s\n", "startup", "best ms", "speedup");
+    printf("%-12s %10.2f %7.2fx\n", "no cache", compiled * 1e3, 1.0);
+    printf("%-12s %10.2f %7.2fx\n", "cold cache", cold * 1e3, compiled / cold);
+    printf("%-12s %10.2f %7.2fx\n", "cache hit", hit * 1e3, compiled / hit);
+
+    remove(cachePath);
+    remove(sourcePath);
+    free(cachePath);
+    free(source.chars);
+    return 0;
+}
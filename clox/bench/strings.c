@@ -0,0 +1,67 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Builds a string by appending to it in a loop, for a doubling number of
+// appends, and compares it once at the end so that it has to be put together.
+// Copying on every append makes each doubling take about four times as long,
+// ropes about twice as long. Build with CLOX_ROPES ON and OFF to compare.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+
+#define RUNS 5
+#define MIN_APPENDS 1000
+#define MAX_APPENDS 16000
+
+static const char *SCRIPT =
+        "var text = \"\";\n"
+        "for (var i = 0; i < %d; i = i + 1) {\n"
+        "  text = text + \"abcdefgh\";\n"
+        "}\n"
+        "var built = text == \"\";\n";
+
+static double measure(int appends) {
+    char source[256];
+    snprintf(source, sizeof(source), SCRIPT, appends);
+
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        VM_init();
+        double start = VM_now();
+        InterpretResult result = VM_interpret(source, strlen(source));
+        double elapsed = VM_now() - start;
+        VM_free();
+
+        if (result != INTERPRET_OK) {
+            fprintf(stderr, "The string building script failed.\n");
+            exit(1);
+        }
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int main() {
+#ifdef ROPES
+    printf("with ropes\n");
+#else
+    printf("without ropes\n");
+#endif
+    printf("%-8s %10s %10s %12s\n", "appends", "length", "best ms", "vs previous");
+    double previous = -1;
+    for (int appends = MIN_APPENDS; appends <= MAX_APPENDS; appends *= 2) {
+        double best = measure(appends);
+        if (previous < 0) {
+            printf("%-8d %10d %10.2f %12s\n", appends, appends * 8, best * 1e3, "");
+        } else {
+            printf("%-8d %10d %10.2f %11.2fx\n", appends, appends * 8, best * 1e3, best / previous);
+        }
+        previous = best;
+        fflush(stdout); // the copying runs take a while
+    }
+    return 0;
+}
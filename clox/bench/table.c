@@ -0,0 +1,95 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Times Table lookups that hit, lookups that miss and interning lookups in
+// vm.strings, for a small table and one that is far bigger than the caches.
+// Build with CLOX_TABLE_SSE2 ON and OFF to compare probing a group of control
+// bytes at once with probing them one by one.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vm.h"
+#include "object.h"
+#include "table.h"
+
+#define LOOKUPS 10000000
+#define RUNS 5
+
+typedef enum {
+    LOOKUP_HIT,
+    LOOKUP_MISS,
+    LOOKUP_INTERN,
+} Lookup;
+
+static volatile int sink;
+
+// Looks keys up in an order that jumps all over the table.
+static double measure(Table *table, ObjString **keys, int count, Lookup lookup) {
+    double best = -1;
+    for (int run = 0; run < RUNS; ++run) {
+        int found = 0;
+        double start = VM_now();
+        for (int i = 0; i < LOOKUPS; ++i) {
+            ObjString *key = keys[(int) (((int64_t) i * 7919) % count)];
+            Value value;
+            if (lookup == LOOKUP_INTERN) {
+                found += Table_findString(&vm.strings, key->chars, key->length, key->hash) != NULL;
+            } else {
+                found += Table_get(table, key, &value);
+            }
+        }
+        double elapsed = VM_now() - start;
+        sink = found;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    return best * 1e9 / LOOKUPS;
+}
+
+static void measureSize(int count) {
+    VM_init();
+    ObjString **present = malloc(sizeof(ObjString *) * count);
+    ObjString **absent = malloc(sizeof(ObjString *) * count);
+    if (present == NULL || absent == NULL) exit(1);
+
+    // globals keep every key alive, only the present ones go in the table
+    char name[32];
+    for (int i = 0; i < 2 * count; ++i) {
+        int length = snprintf(name, sizeof(name), "key-%d", i);
+        ObjString *key = ObjString_copyFrom(name, length);
+        VM_globalSlot(key);
+        if (i % 2 == 0) {
+            present[i / 2] = key;
+        } else {
+            absent[i / 2] = key;
+        }
+    }
+    Table table;
+    Table_init(&table);
+    for (int i = 0; i < count; ++i) {
+        Table_set(&table, present[i], NUMBER_VAL(i));
+    }
+
+    printf("%-8d %8.1f %8.1f %8.1f\n", count,
+           measure(&table, present, count, LOOKUP_HIT),
+           measure(&table, absent, count, LOOKUP_MISS),
+           measure(&table, present, count, LOOKUP_INTERN));
+
+    Table_free(&table);
+    free(present);
+    free(absent);
+    VM_free();
+}
+
+int main() {
+#if defined(TABLE_SSE2) && defined(__SSE2__)
+    printf("probing with SSE2\n");
+#else
+    printf("probing byte by byte\n");
+#endif
+    printf("%-8s %8s %8s %8s  (ns per lookup)\n", "keys", "hit", "miss", "intern");
+    measureSize(1000);
+    measureSize(200000);
+    return 0;
+}
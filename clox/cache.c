@@ -0,0 +1,334 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "compilers.h"
+#include "memory.h"
+#include "object.h"
+#include "vm.h"
+
+// Bump whenever the bytecode or this layout changes, so older caches are ignored.
+#define CACHE_VERSION 3
+
+#define OPTION_FOLD     1
+#define OPTION_PEEPHOLE 2
+
+#define CONSTANT_NUMBER 0
+#define CONSTANT_STRING 1
+
+// The file is the header, the line table, the code, then the constants and
+// the global names in slot order. The line table comes first so that it stays
+// aligned. Constants are a tag byte followed by the number's 8 bytes or the
+// string's 4-byte length and its characters. A global name is a 4-byte length
+// and its characters. Everything is in the byte order of the machine that
+// wrote it, since the magic number would not match on any other.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t sourceLength;
+    uint32_t options;
+    uint32_t codeCount;
+    uint32_t lineCount;
+    uint32_t constantCount;
+    uint32_t globalCount;
+} CacheHeader;
+
+#define CACHE_MAGIC 0x43584f4c // "LOXC" when read little-endian
+
+typedef struct {
+    const uint8_t *current;
+    const uint8_t *end;
+} Reader;
+
+static uint64_t hashSource(const char *source, size_t length) {
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (uint8_t) source[i];
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+static uint32_t currentOptions() {
+    uint32_t options = 0;
+    if (compilerOptions.fold) options |= OPTION_FOLD;
+    if (compilerOptions.peephole) options |= OPTION_PEEPHOLE;
+    return options;
+}
+
+char *Cache_pathFor(const char *sourcePath) {
+    size_t length = strlen(sourcePath);
+    char *path = malloc(length + sizeof(".loxc"));
+    if (path == NULL) exit(74);
+    memcpy(path, sourcePath, length + 1);
+    if (length >= 4 && strcmp(sourcePath + length - 4, ".lox") == 0) {
+        strcpy(path + length, "c");
+    } else {
+        strcpy(path + length, ".loxc");
+    }
+    return path;
+}
+
+static bool readBytes(Reader *reader, void *into, size_t size) {
+    if ((size_t) (reader->end - reader->current) < size) return false;
+    memcpy(into, reader->current, size);
+    reader->current += size;
+    return true;
+}
+
+static bool readChars(Reader *reader, const char **chars, int *length) {
+    uint32_t count;
+    if (!readBytes(reader, &count, sizeof(count))) return false;
+    if ((size_t) (reader->end - reader->current) < count) return false;
+    *chars = (const char *) reader->current;
+    *length = (int) count;
+    reader->current += count;
+    return true;
+}
+
+static bool readConstants(Reader *reader, Chunk *chunk, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t tag;
+        if (!readBytes(reader, &tag, sizeof(tag))) return false;
+
+        Value value;
+        if (tag == CONSTANT_NUMBER) {
+            double number;
+            if (!readBytes(reader, &number, sizeof(number))) return false;
+            value = NUMBER_VAL(number);
+        } else if (tag == CONSTANT_STRING) {
+            const char *chars;
+            int length;
+            if (!readChars(reader, &chars, &length)) return false;
+            value = ObjString_valueFrom(chars, length);
+        } else {
+            return false;
+        }
+
+        VM_push(value); // growing the constant pool might collect the value
+        ValueArray_write(&chunk->constants, value);
+        VM_pop();
+    }
+    return true;
+}
+
+static bool readGlobals(Reader *reader, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        const char *chars;
+        int length;
+        if (!readChars(reader, &chars, &length)) return false;
+        // the code refers to globals by slot, so they must end up where they were compiled
+        if (VM_globalSlot(ObjString_copyFrom(chars, length)) != (int) i) return false;
+    }
+    return true;
+}
+
+static uint32_t readOperand(const uint8_t *operand, int width) {
+    uint32_t value = 0;
+    for (int i = 0; i < width; ++i) {
+        value = value << 8 | operand[i];
+    }
+    return value;
+}
+
+// Whether the code is something the compiler could have written: whole
+// instructions with known opcodes, constants and globals the file has, jumps
+// that land on an instruction and an OP_RETURN at the end. Nothing else keeps
+// a damaged cache from running off the code or out of the constant pool.
+static bool validCode(Chunk *chunk, uint32_t constantCount, uint32_t globalCount) {
+    if (chunk->count == 0) return false;
+    bool *starts = ALLOCATE_SCOPED(bool, chunk->count);
+    memset(starts, 0, sizeof(bool) * chunk->count);
+
+    bool valid = true;
+    OpCode last = OP_RETURN;
+    for (int offset = 0; valid && offset < chunk->count; offset += 1 + Chunk_operandWidth(last)) {
+        starts[offset] = true;
+        if (chunk->code[offset] >= OPCODE_COUNT) {
+            valid = false;
+            break;
+        }
+        last = chunk->code[offset];
+        int width = Chunk_operandWidth(last);
+        if (chunk->count - offset - 1 < width) {
+            valid = false;
+            break;
+        }
+        uint32_t operand = readOperand(&chunk->code[offset + 1], width);
+        switch (last) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG:
+                valid = operand < constantCount;
+                break;
+            case OP_GET_GLOBAL:
+            case OP_GET_GLOBAL_LONG:
+            case OP_DEFINE_GLOBAL:
+            case OP_DEFINE_GLOBAL_LONG:
+            case OP_SET_GLOBAL:
+            case OP_SET_GLOBAL_LONG:
+                valid = operand < globalCount;
+                break;
+            default:
+                break;
+        }
+    }
+    valid = valid && last == OP_RETURN;
+
+    for (int offset = 0; valid && offset < chunk->count; offset += 1 + Chunk_operandWidth(chunk->code[offset])) {
+        OpCode op = chunk->code[offset];
+        if (op == OP_JUMP || op == OP_JUMP_LONG || op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_FALSE_LONG ||
+            op == OP_LOOP || op == OP_LOOP_LONG) {
+            int target = Chunk_jumpTarget(chunk, offset);
+            valid = target >= 0 && target < chunk->count && starts[target];
+        }
+    }
+
+    FREE_SCOPED_ARRAY(bool, starts, chunk->count);
+    return valid;
+}
+
+// Locals are read straight off the stack, so none may lie above what the chunk reserves.
+static bool validLocals(Chunk *chunk) {
+    for (int offset = 0; offset < chunk->count; offset += 1 + Chunk_operandWidth(chunk->code[offset])) {
+        OpCode op = chunk->code[offset];
+        if (op == OP_GET_LOCAL || op == OP_GET_LOCAL_LONG || op == OP_SET_LOCAL || op == OP_SET_LOCAL_LONG ||
+            op == OP_SET_LOCAL_POP) {
+            uint32_t local = readOperand(&chunk->code[offset + 1], Chunk_operandWidth(op));
+            if (local >= (uint32_t) chunk->maxStack) return false;
+        }
+    }
+    return true;
+}
+
+bool Cache_load(const char *cachePath, const char *source, size_t length, Chunk *chunk, CacheMapping *mapping) {
+    int file = open(cachePath, O_RDONLY);
+    if (file < 0) return false;
+    struct stat status;
+    if (fstat(file, &status) != 0 || (size_t) status.st_size < sizeof(CacheHeader)) {
+        close(file);
+        return false;
+    }
+    mapping->size = status.st_size;
+    mapping->mapping = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping->mapping == MAP_FAILED) return false;
+
+    const uint8_t *bytes = mapping->mapping;
+    const CacheHeader *header = mapping->mapping;
+    size_t linesSize = sizeof(LineStart) * (size_t) header->lineCount;
+    if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+        header->sourceLength != length || header->sourceHash != hashSource(source, length) ||
+        header->options != currentOptions() ||
+        mapping->size - sizeof(CacheHeader) < linesSize + header->codeCount ||
+        (header->lineCount == 0 && header->codeCount > 0) || header->codeCount > INT_MAX) {
+        munmap(mapping->mapping, mapping->size);
+        return false;
+    }
+
+    chunk->lines = (LineStart *) (bytes + sizeof(CacheHeader));
+    chunk->lineCount = (int) header->lineCount;
+    chunk->code = (uint8_t *) bytes + sizeof(CacheHeader) + linesSize;
+    chunk->count = (int) header->codeCount;
+    if (!validCode(chunk, header->constantCount, header->globalCount)) {
+        Cache_unload(chunk, mapping);
+        return false;
+    }
+    // worked out again rather than stored, so that a wrong one can't let the stack overflow
+    Chunk_computeMaxStack(chunk);
+    if (!validLocals(chunk)) {
+        Cache_unload(chunk, mapping);
+        return false;
+    }
+
+    Reader reader = {chunk->code + chunk->count, bytes + mapping->size};
+    if (!readConstants(&reader, chunk, header->constantCount) || !readGlobals(&reader, header->globalCount)) {
+        Cache_unload(chunk, mapping);
+        return false;
+    }
+    return true;
+}
+
+void Cache_unload(Chunk *chunk, CacheMapping *mapping) {
+    // the code and lines belong to the mapping, not to the allocator
+    chunk->code = NULL;
+    chunk->lines = NULL;
+    Chunk_free(chunk);
+    munmap(mapping->mapping, mapping->size);
+}
+
+static void writeChars(FILE *file, const char *chars, int length) {
+    uint32_t count = (uint32_t) length;
+    fwrite(&count, sizeof(count), 1, file);
+    fwrite(chars, 1, count, file);
+}
+
+bool Cache_write(const char *cachePath, const char *source, size_t length, Chunk *chunk) {
+    for (int i = 0; i < chunk->constants.count; ++i) {
+        Value value = chunk->constants.values[i];
+        if (!IS_NUMBER(value) && !IS_FLAT_STRING(value)) return false;
+    }
+
+    // written next to it first, so that nobody ever maps half a cache, and
+    // under a name of its own, so that runs on other threads can write it too
+    size_t pathLength = strlen(cachePath);
+    char *partialPath = malloc(pathLength + sizeof(".XXXXXX"));
+    if (partialPath == NULL) return false;
+    memcpy(partialPath, cachePath, pathLength);
+    strcpy(partialPath + pathLength, ".XXXXXX");
+    int descriptor = mkstemp(partialPath);
+    FILE *file = descriptor < 0 ? NULL : fdopen(descriptor, "wb");
+    if (file == NULL) {
+        if (descriptor >= 0) {
+            close(descriptor);
+            remove(partialPath);
+        }
+        free(partialPath);
+        return false;
+    }
+    fchmod(descriptor, 0644); // mkstemp only lets the owner read it
+
+    CacheHeader header = {
+            CACHE_MAGIC, CACHE_VERSION, hashSource(source, length), length, currentOptions(),
+            (uint32_t) chunk->count, (uint32_t) chunk->lineCount, (uint32_t) chunk->constants.count,
+            (uint32_t) vm.globals.count,
+    };
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(chunk->lines, sizeof(LineStart), chunk->lineCount, file);
+    fwrite(chunk->code, 1, chunk->count, file);
+    for (int i = 0; i < chunk->constants.count; ++i) {
+        Value value = chunk->constants.values[i];
+        uint8_t tag = IS_NUMBER(value) ? CONSTANT_NUMBER : CONSTANT_STRING;
+        fwrite(&tag, sizeof(tag), 1, file);
+        if (IS_NUMBER(value)) {
+            double number = AS_NUMBER(value);
+            fwrite(&number, sizeof(number), 1, file);
+        } else {
+            char buffer[SHORT_STRING_MAX];
+            int charCount;
+            const char *chars = ObjString_charsOf(value, buffer, &charCount);
+            writeChars(file, chars, charCount);
+        }
+    }
+    for (int i = 0; i < vm.globals.count; ++i) {
+        writeChars(file, vm.globals.names[i]->chars, vm.globals.names[i]->length);
+    }
+
+    bool written = !ferror(file);
+    written = fclose(file) == 0 && written;
+    written = written && rename(partialPath, cachePath) == 0;
+    if (!written) remove(partialPath);
+    free(partialPath);
+    return written;
+}
@@ -0,0 +1,32 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_CACHE_H
+#define CLOX_CACHE_H
+
+#include "chunk.h"
+
+// Compiled scripts are cached next to their source, script.lox in script.loxc.
+// A cache file holds one chunk: its code and line table, which are used
+// straight from the mapped file, and its constants and the names of the globals
+// it refers to, which are interned again when it is loaded. It is only used for
+// the exact source and compiler options it was written for.
+typedef struct {
+    void *mapping;
+    size_t size;
+} CacheMapping;
+
+// The cache path for a source path. The caller frees it.
+char *Cache_pathFor(const char *sourcePath);
+
+// Maps the cached chunk into an initialized chunk. Fails, leaving the chunk
+// empty, unless the cache was written for this source and the same options,
+// its code is whole and only refers to what the file has, and its globals get
+// the slots they were compiled for.
+bool Cache_load(const char *cachePath, const char *source, size_t length, Chunk *chunk, CacheMapping *mapping);
+void Cache_unload(Chunk *chunk, CacheMapping *mapping);
+// Writes a chunk that was just compiled from source, replacing any older cache.
+bool Cache_write(const char *cachePath, const char *source, size_t length, Chunk *chunk);
+
+#endif //CLOX_CACHE_H
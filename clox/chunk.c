@@ -2,37 +2,274 @@
 // Created by Fredrik Bystam on 2023-09-01.
 //
 
+#include <string.h>
+
 #include "chunk.h"
 #include "memory.h"
+#include "object.h"
+#include "vm.h"
+
+#define CONSTANT_INDEX_MAX_LOAD 0.5
 
 void Chunk_init(Chunk *chunk) {
     chunk->count = 0;
     chunk->capacity = 0;
     chunk->code = NULL;
+    chunk->lineCount = 0;
+    chunk->lineCapacity = 0;
     chunk->lines = NULL;
     ValueArray_init(&chunk->constants);
+    chunk->constantIndex = NULL;
+    chunk->constantIndexCapacity = 0;
+    chunk->maxStack = 0;
 }
 
 void Chunk_write(Chunk *chunk, uint8_t byte, int line) {
     if (chunk->count >= chunk->capacity) {
         int oldCapacity = chunk->capacity;
         chunk->capacity = GROW_CAPACITY(oldCapacity);
-        chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
-        chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, chunk->capacity);
+        chunk->code = GROW_SCOPED_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
     }
     chunk->code[chunk->count] = byte;
-    chunk->lines[chunk->count] = line;
     chunk->count++;
+
+    if (chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].line == line) {
+        return; // still on the same line
+    }
+    if (chunk->lineCount >= chunk->lineCapacity) {
+        int oldCapacity = chunk->lineCapacity;
+        chunk->lineCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->lines = GROW_SCOPED_ARRAY(LineStart, chunk->lines, oldCapacity, chunk->lineCapacity);
+    }
+    LineStart *lineStart = &chunk->lines[chunk->lineCount++];
+    lineStart->offset = chunk->count - 1;
+    lineStart->line = line;
+}
+
+// The new byte belongs to the same line as the one before it.
+void Chunk_insert(Chunk *chunk, int offset, uint8_t byte) {
+    Chunk_write(chunk, 0, chunk->lines[chunk->lineCount - 1].line); // makes room for one more byte
+    memmove(chunk->code + offset + 1, chunk->code + offset, chunk->count - offset - 1);
+    chunk->code[offset] = byte;
+    for (int i = 1; i < chunk->lineCount; ++i) {
+        if (chunk->lines[i].offset >= offset) chunk->lines[i].offset++;
+    }
+}
+
+int Chunk_operandWidth(OpCode op) {
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_GET_GLOBAL:
+        case OP_DEFINE_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_POP:
+            return 1;
+        case OP_GET_LOCAL_LONG:
+        case OP_SET_LOCAL_LONG:
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_LOOP:
+            return 2;
+        case OP_CONSTANT_LONG:
+        case OP_GET_GLOBAL_LONG:
+        case OP_DEFINE_GLOBAL_LONG:
+        case OP_SET_GLOBAL_LONG:
+        case OP_JUMP_LONG:
+        case OP_JUMP_IF_FALSE_LONG:
+        case OP_LOOP_LONG:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+// Drops the code from count onwards, so it can be emitted again.
+void Chunk_truncate(Chunk *chunk, int count) {
+    chunk->count = count;
+    while (chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].offset >= count) {
+        chunk->lineCount--;
+    }
+}
+
+static bool isLoop(OpCode op) {
+    return op == OP_LOOP || op == OP_LOOP_LONG;
+}
+
+static bool isJump(OpCode op) {
+    return op == OP_JUMP || op == OP_JUMP_LONG || op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_FALSE_LONG || isLoop(op);
+}
+
+int Chunk_jumpTarget(Chunk *chunk, int offset) {
+    OpCode op = chunk->code[offset];
+    int width = Chunk_operandWidth(op);
+    int distance = 0;
+    for (int i = 1; i <= width; ++i) {
+        distance = (distance << 8) | chunk->code[offset + i];
+    }
+    int next = offset + 1 + width;
+    return isLoop(op) ? next - distance : next + distance;
+}
+
+// How many values the opcode leaves on the stack compared to before it.
+static int stackEffect(OpCode op) {
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_CONSTANT_LONG:
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_GLOBAL:
+        case OP_GET_GLOBAL_LONG:
+        case OP_GET_LOCAL:
+        case OP_GET_LOCAL_LONG:
+            return 1;
+        case OP_POP:
+        case OP_DEFINE_GLOBAL:
+        case OP_DEFINE_GLOBAL_LONG:
+        case OP_SET_LOCAL_POP:
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+        case OP_GREATER:
+        case OP_GREATER_EQUAL:
+        case OP_LESS:
+        case OP_LESS_EQUAL:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_PRINT:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+// The compiler keeps the stack the same height along every path into an
+// instruction, so one pass in code order finds it everywhere. The only catch
+// is code right after an unconditional jump: falling through doesn't get
+// there, so its height is the one a forward jump to it arrives with. Code
+// that only a loop jumps back to, like a for loop's increment, starts at the
+// height of the jump just before it, since jumps don't change the height.
+void Chunk_computeMaxStack(Chunk *chunk) {
+    int *heights = ALLOCATE_SCOPED(int, chunk->count + 1);
+    for (int offset = 0; offset <= chunk->count; ++offset) {
+        heights[offset] = -1;
+    }
+
+    int height = 0;
+    int maxStack = 0;
+    for (int offset = 0; offset < chunk->count; offset += 1 + Chunk_operandWidth(chunk->code[offset])) {
+        if (heights[offset] >= 0) height = heights[offset];
+        OpCode op = chunk->code[offset];
+        height += stackEffect(op);
+        if (height > maxStack) maxStack = height;
+        if (isJump(op) && !isLoop(op)) heights[Chunk_jumpTarget(chunk, offset)] = height;
+    }
+    chunk->maxStack = maxStack;
+
+    FREE_SCOPED_ARRAY(int, heights, chunk->count + 1);
+}
+
+int LineStart_find(LineStart *lines, int count, int offset) {
+    int low = 0;
+    int high = count - 1;
+    while (low < high) { // find the last run starting at or before offset
+        int mid = low + (high - low + 1) / 2;
+        if (lines[mid].offset > offset) {
+            high = mid - 1;
+        } else {
+            low = mid;
+        }
+    }
+    return lines[low].line;
+}
+
+int Chunk_getLine(Chunk *chunk, int offset) {
+    return LineStart_find(chunk->lines, chunk->lineCount, offset);
+}
+
+// Numbers are compared by their bits, so 0 and -0 stay apart and a NaN
+// constant can still be reused. Strings are interned, so their pointer will
+// do, and short strings are all bits as well.
+static bool isReusable(Value value) {
+    return IS_NUMBER(value) || IS_FLAT_STRING(value);
+}
+
+static uint64_t constantBits(Value value) {
+    if (IS_NUMBER(value)) {
+        double number = AS_NUMBER(value);
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return bits;
+    }
+    if (IS_SHORT_STRING(value)) {
+        char chars[SHORT_STRING_MAX] = {0};
+        uint64_t bits = 0;
+        memcpy(&bits, chars, ShortString_read(value, chars));
+        return bits;
+    }
+    return (uint64_t) (uintptr_t) AS_OBJ(value);
+}
+
+static bool sameConstant(Value a, Value b) {
+    return IS_NUMBER(a) == IS_NUMBER(b) && IS_SHORT_STRING(a) == IS_SHORT_STRING(b) &&
+           constantBits(a) == constantBits(b);
+}
+
+static int *findIndexSlot(Chunk *chunk, Value value) {
+    uint32_t mask = chunk->constantIndexCapacity - 1;
+    uint32_t index = (uint32_t) ((constantBits(value) * 0x9E3779B97F4A7C15u) >> 32) & mask;
+    for (;;) {
+        int *slot = chunk->constantIndex + index;
+        if (*slot == -1 || sameConstant(chunk->constants.values[*slot], value)) {
+            return slot;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+static void growConstantIndex(Chunk *chunk) {
+    FREE_SCOPED_ARRAY(int, chunk->constantIndex, chunk->constantIndexCapacity);
+    chunk->constantIndexCapacity = GROW_CAPACITY(chunk->constantIndexCapacity);
+    chunk->constantIndex = ALLOCATE_SCOPED(int, chunk->constantIndexCapacity);
+    for (int i = 0; i < chunk->constantIndexCapacity; ++i) {
+        chunk->constantIndex[i] = -1;
+    }
+    for (int i = 0; i < chunk->constants.count; ++i) {
+        if (isReusable(chunk->constants.values[i])) {
+            *findIndexSlot(chunk, chunk->constants.values[i]) = i;
+        }
+    }
 }
 
 int Chunk_addConstant(Chunk *chunk, Value value) {
+    bool reusable = isReusable(value);
+    if (reusable && chunk->constantIndexCapacity > 0) {
+        int *slot = findIndexSlot(chunk, value);
+        if (*slot != -1) return *slot;
+    }
+
+    VM_push(value); // growing the constant pool might collect the value
     ValueArray_write(&chunk->constants, value);
-    return chunk->constants.count - 1;
+    VM_pop();
+    int constant = chunk->constants.count - 1;
+
+    if (reusable) {
+        if (constant + 1 > chunk->constantIndexCapacity * CONSTANT_INDEX_MAX_LOAD) {
+            growConstantIndex(chunk); // also indexes the new constant
+        } else {
+            *findIndexSlot(chunk, value) = constant;
+        }
+    }
+    return constant;
 }
 
 void Chunk_free(Chunk *chunk) {
-    FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+    FREE_SCOPED_ARRAY(uint8_t, chunk->code, chunk->capacity);
+    FREE_SCOPED_ARRAY(LineStart, chunk->lines, chunk->lineCapacity);
     ValueArray_free(&chunk->constants);
+    FREE_SCOPED_ARRAY(int, chunk->constantIndex, chunk->constantIndexCapacity);
     Chunk_init(chunk);
 }
-
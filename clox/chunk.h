@@ -8,20 +8,35 @@
 #include "common.h"
 #include "value.h"
 
+// Opcodes ending in _LONG are wide variants of the ones without, for scripts
+// that outgrow the single byte or short operand: constants, globals and jumps
+// take a 24-bit operand, locals a 16-bit one. Every operand is big-endian.
+// OP_SET_LOCAL_POP and the comparisons after OP_EQUAL are only produced by the
+// peephole optimizer, each standing for a pair the compiler emits.
 typedef enum {
     OP_CONSTANT,
+    OP_CONSTANT_LONG,
     OP_NIL,
     OP_TRUE,
     OP_FALSE,
     OP_POP,
     OP_GET_GLOBAL,
+    OP_GET_GLOBAL_LONG,
     OP_GET_LOCAL,
+    OP_GET_LOCAL_LONG,
     OP_DEFINE_GLOBAL,
+    OP_DEFINE_GLOBAL_LONG,
     OP_SET_GLOBAL,
+    OP_SET_GLOBAL_LONG,
     OP_SET_LOCAL,
+    OP_SET_LOCAL_LONG,
+    OP_SET_LOCAL_POP,
     OP_EQUAL,
+    OP_NOT_EQUAL,
     OP_GREATER,
+    OP_GREATER_EQUAL,
     OP_LESS,
+    OP_LESS_EQUAL,
     OP_ADD,
     OP_SUBTRACT,
     OP_MULTIPLY,
@@ -30,21 +45,51 @@ typedef enum {
     OP_NEGATE,
     OP_PRINT,
     OP_JUMP,
+    OP_JUMP_LONG,
     OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_FALSE_LONG,
     OP_LOOP,
+    OP_LOOP_LONG,
     OP_RETURN,
 } OpCode;
 
+#define OPCODE_COUNT (OP_RETURN + 1) // OP_RETURN stays last
+
+// The first byte of a run of bytecode that was compiled from the same line.
+typedef struct {
+    int offset;
+    int line;
+} LineStart;
+
 typedef struct {
     int count;
     int capacity;
     uint8_t *code;
-    int *lines;
+    // one entry per change of line, in increasing offset order
+    int lineCount;
+    int lineCapacity;
+    LineStart *lines;
     ValueArray constants;
+    // open-addressed index of number and string constants, used to reuse them
+    int *constantIndex;
+    int constantIndexCapacity;
+    // the most values the code has on the stack at once, locals included, see Chunk_computeMaxStack
+    int maxStack;
 } Chunk;
 
 void Chunk_init(Chunk *chunk);
 void Chunk_write(Chunk *chunk, uint8_t byte, int line);
+void Chunk_insert(Chunk *chunk, int offset, uint8_t byte);
+void Chunk_truncate(Chunk *chunk, int count);
+int Chunk_getLine(Chunk *chunk, int offset);
+// How many bytes of operand follow the opcode.
+int Chunk_operandWidth(OpCode op);
+// Where the jump or loop at offset lands.
+int Chunk_jumpTarget(Chunk *chunk, int offset);
+// Sets maxStack from the finished code, so the VM can make room for it up front.
+void Chunk_computeMaxStack(Chunk *chunk);
+// The line of the run that offset falls in, given runs in increasing offset order.
+int LineStart_find(LineStart *lines, int count, int offset);
 int Chunk_addConstant(Chunk *chunk, Value value);
 void Chunk_free(Chunk *chunk);
 
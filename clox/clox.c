@@ -0,0 +1,112 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#include <string.h>
+
+#include "clox.h"
+#include "object.h"
+#include "vm.h"
+
+static CloxResult resultOf(InterpretResult result) {
+    switch (result) {
+        case INTERPRET_COMPILE_ERROR: return CLOX_COMPILE_ERROR;
+        case INTERPRET_RUNTIME_ERROR: return CLOX_RUNTIME_ERROR;
+        default: return CLOX_OK;
+    }
+}
+
+void Clox_init() {
+    VM_init();
+}
+
+void Clox_free() {
+    VM_free();
+}
+
+void Clox_setOutput(FILE *out, FILE *err) {
+    vm.out = out;
+    vm.err = err;
+}
+
+CloxResult Clox_interpret(const char *source, size_t length) {
+    return resultOf(VM_interpret(source, length));
+}
+
+CloxProgram *Clox_compile(const char *source, size_t length) {
+    return VM_compileProgram(source, length);
+}
+
+CloxResult Clox_run(CloxProgram *program) {
+    return resultOf(VM_runProgram(program));
+}
+
+void Clox_freeProgram(CloxProgram *program) {
+    VM_freeProgram(program);
+}
+
+void Clox_resetGlobals() {
+    VM_resetGlobals();
+}
+
+static int slotOf(const char *name) {
+    return VM_globalSlot(ObjString_copyFrom(name, (int) strlen(name)));
+}
+
+// The value is on the stack while the name is interned and given a slot.
+static void setGlobal(const char *name, Value value) {
+    VM_push(value);
+    int slot = slotOf(name);
+    vm.globals.values[slot] = VM_pop();
+}
+
+void Clox_setNil(const char *name) {
+    setGlobal(name, NIL_VAL);
+}
+
+void Clox_setBool(const char *name, bool value) {
+    setGlobal(name, BOOL_VAL(value));
+}
+
+void Clox_setNumber(const char *name, double value) {
+    setGlobal(name, NUMBER_VAL(value));
+}
+
+void Clox_setString(const char *name, const char *chars, size_t length) {
+    setGlobal(name, ObjString_valueFrom(chars, (int) length));
+}
+
+// Looks the name up without giving it a slot, so asking about a global never defines one.
+static bool getGlobal(const char *name, Value *value) {
+    Value slot;
+    if (!Table_get(&vm.globals.slots, ObjString_copyFrom(name, (int) strlen(name)), &slot)) return false;
+    *value = vm.globals.values[(int) AS_NUMBER(slot)];
+    return true;
+}
+
+bool Clox_getBool(const char *name, bool *value) {
+    Value global;
+    if (!getGlobal(name, &global) || !IS_BOOL(global)) return false;
+    *value = AS_BOOL(global);
+    return true;
+}
+
+bool Clox_getNumber(const char *name, double *value) {
+    Value global;
+    if (!getGlobal(name, &global) || !IS_NUMBER(global)) return false;
+    *value = AS_NUMBER(global);
+    return true;
+}
+
+int Clox_getString(const char *name, char *buffer, int capacity) {
+    Value global;
+    if (!getGlobal(name, &global) || !IS_ANY_STRING(global)) return -1;
+    if (IS_ROPE(global)) global = OBJ_VAL(ObjRope_flatten(AS_ROPE(global)));
+
+    char shortChars[SHORT_STRING_MAX];
+    int length;
+    const char *chars = ObjString_charsOf(global, shortChars, &length);
+    int copied = length < capacity ? length : capacity;
+    if (copied > 0) memcpy(buffer, chars, copied);
+    return length;
+}
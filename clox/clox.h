@@ -0,0 +1,50 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_CLOX_H
+#define CLOX_CLOX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// libclox, for running Lox from C. A thread that uses it has a VM of its own
+// between Clox_init and Clox_free. Scripts are compiled once into programs
+// that run any number of times, and talk to the caller through globals, which
+// keep their values from one run to the next until Clox_resetGlobals.
+typedef struct VMProgram CloxProgram;
+
+typedef enum {
+    CLOX_OK,
+    CLOX_COMPILE_ERROR,
+    CLOX_RUNTIME_ERROR,
+} CloxResult;
+
+void Clox_init();
+// Frees the VM and every program compiled on it.
+void Clox_free();
+// Where print writes to and where errors are reported, after Clox_init set
+// them to stdout and stderr.
+void Clox_setOutput(FILE *out, FILE *err);
+
+// Compiles and runs source in one go.
+CloxResult Clox_interpret(const char *source, size_t length);
+// NULL if source does not compile.
+CloxProgram *Clox_compile(const char *source, size_t length);
+CloxResult Clox_run(CloxProgram *program);
+void Clox_freeProgram(CloxProgram *program);
+
+void Clox_resetGlobals();
+void Clox_setNil(const char *name);
+void Clox_setBool(const char *name, bool value);
+void Clox_setNumber(const char *name, double value);
+void Clox_setString(const char *name, const char *chars, size_t length);
+// The getters fail unless the global is defined and has the type asked for.
+bool Clox_getBool(const char *name, bool *value);
+bool Clox_getNumber(const char *name, double *value);
+// Copies up to capacity characters of a string global into buffer, without a
+// NUL, and returns its whole length, or -1. A capacity below 1 copies nothing.
+int Clox_getString(const char *name, char *buffer, int capacity);
+
+#endif //CLOX_CLOX_H
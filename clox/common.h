@@ -9,9 +9,11 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define DEBUG_PRINT_CODE
+// DEBUG_PRINT_CODE is set from CMake, see CLOX_DEBUG_PRINT_CODE
 // #define DEBUG_TRACE_EXECUTION
 
 #define UINT8_COUNT (UINT8_MAX + 1)
+#define UINT16_COUNT (UINT16_MAX + 1)
+#define UINT24_MAX 0xFFFFFF
 
 #endif
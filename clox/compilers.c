@@ -2,12 +2,17 @@
 // Created by Fredrik Bystam on 2023-09-04.
 //
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "compilers.h"
 #include "scanner.h"
 #include "object.h"
+#include "memory.h"
+#include "optimizer.h"
+#include "registers.h"
+#include "vm.h"
 
 #ifdef DEBUG_PRINT_CODE
 #include "debug.h"
@@ -50,14 +55,21 @@ typedef struct {
 } Local;
 
 typedef struct {
-    Local locals[UINT8_COUNT];
+    Local *locals;
+    int localCapacity;
     int localCount;
     int scopeDepth;
+    // what constant folding needs to know about the code just emitted
+    int operandStart;   // where the left operand of the infix rule being compiled starts
+    int numberEnd;      // the end of the last instruction that always leaves a number
+    int jumpTarget;     // where the last patched jump lands
 } Compiler;
 
-Parser parser;
-Compiler* current = NULL;
-Chunk *compilingChunk;
+CompilerOptions compilerOptions = {true, true, false, false, false, false, false};
+
+_Thread_local Parser parser;
+_Thread_local Compiler* current = NULL;
+_Thread_local Chunk *compilingChunk = NULL;
 
 static void initCompiler(Compiler *compiler);
 static void advance();
@@ -68,9 +80,9 @@ static void endCompiler();
 
 static void statement();
 static void declaration();
-static uint8_t parseVariable(const char *errorMessage);
-static uint8_t identifierConstant(Token *name);
-static void defineVariable(uint8_t global);
+static int parseVariable(const char *errorMessage);
+static int globalSlot(Token *name);
+static void defineVariable(int global);
 static void declareVariable();
 static void namedVariable(Token name, bool canAssign);
 static bool identifiersEqual(Token *a, Token *b);
@@ -81,8 +93,18 @@ static void errorAt(Token* token, const char* message);
 static void errorAtCurrent(const char* message);
 static void error(const char* message);
 
-bool compile(const char *source, Chunk *chunk) {
-    Scanner_init(source);
+static bool compileChunk(const char *source, size_t length, Chunk *chunk, RegisterCode *registers);
+
+bool compile(const char *source, size_t length, Chunk *chunk) {
+    return compileChunk(source, length, chunk, NULL);
+}
+
+bool compileRegisters(const char *source, size_t length, Chunk *chunk, RegisterCode *registers) {
+    return compileChunk(source, length, chunk, registers);
+}
+
+static bool compileChunk(const char *source, size_t length, Chunk *chunk, RegisterCode *registers) {
+    Scanner_init(source, length);
     compilingChunk = chunk;
     Compiler compiler;
     initCompiler(&compiler);
@@ -96,14 +118,34 @@ bool compile(const char *source, Chunk *chunk) {
     }
 
     endCompiler();
+    if (registers != NULL && !parser.hadError) {
+        Registers_lower(chunk, registers); // while the chunk's constants are still GC roots
+#ifdef DEBUG_PRINT_CODE
+        RegisterCode_disassemble(registers, chunk, "registers");
+#endif
+    }
+    FREE_SCOPED_ARRAY(Local, compiler.locals, compiler.localCapacity);
+    compilingChunk = NULL;
     return !parser.hadError;
 }
 
+void markCompilerRoots() {
+    if (compilingChunk == NULL) return;
+    for (int i = 0; i < compilingChunk->constants.count; ++i) {
+        markValue(compilingChunk->constants.values[i]);
+    }
+}
+
 // ===== BUILDING BLOCKS =====
 
 static void initCompiler(Compiler *compiler) {
+    compiler->locals = NULL;
+    compiler->localCapacity = 0;
     compiler->localCount = 0;
     compiler->scopeDepth = 0;
+    compiler->operandStart = 0;
+    compiler->numberEnd = -1;
+    compiler->jumpTarget = -1;
     current = compiler;
 }
 
@@ -149,6 +191,43 @@ static void emitBytes(uint8_t byte1, uint8_t byte2) {
     emitByte(byte2);
 }
 
+static void emitIndexed(OpCode op, OpCode longOp, int index) {
+    if (index <= UINT8_MAX) {
+        emitBytes(op, (uint8_t) index);
+    } else {
+        emitByte(longOp);
+        emitByte((index >> 16) & 0xFF);
+        emitByte((index >> 8) & 0xFF);
+        emitByte(index & 0xFF);
+    }
+}
+
+static void emitLocal(OpCode op, OpCode longOp, int slot) {
+    if (slot <= UINT8_MAX) {
+        emitBytes(op, (uint8_t) slot);
+    } else {
+        emitByte(longOp);
+        emitByte((slot >> 8) & 0xFF);
+        emitByte(slot & 0xFF);
+    }
+}
+
+static OpCode longJump(OpCode instruction) {
+    switch (instruction) {
+        case OP_JUMP: return OP_JUMP_LONG;
+        case OP_JUMP_IF_FALSE: return OP_JUMP_IF_FALSE_LONG;
+        default: return instruction; // unreachable
+    }
+}
+
+// Widening a jump inserts a byte into code that is already emitted, which
+// stretches any jump crossing that point: a loop whose exit jump is patched
+// after its back edge, or an if/or that patched its first jump over the second.
+// Short jumps leave room for that many bytes so stretching never overflows them.
+#define JUMP_STRETCH 2
+
+// Forward jumps are emitted in their short form, since we don't know how far
+// they go yet. See patchJump for how they are widened.
 static int emitJump(OpCode instruction) {
     emitByte(instruction);
     emitByte(0xFF);
@@ -156,36 +235,87 @@ static int emitJump(OpCode instruction) {
     return currentChunk()->count - 2;
 }
 
-static void patchJump(int offset) {
-    int jump = currentChunk()->count - (offset + 2);
-    if (jump > UINT16_MAX) {
-        error("Too much code to jump over");
+// Returns how many bytes the patch inserted into the chunk. Jumps that lie
+// entirely after the insertion point move along with their targets, but the
+// caller has to shift any offset it still holds past it and stretch any
+// jump that crosses it.
+static int patchJump(int offset) {
+    Chunk *chunk = currentChunk();
+    int jump = chunk->count - (offset + 2);
+    if (jump <= UINT16_MAX - JUMP_STRETCH) {
+        chunk->code[offset] = (jump >> 8) & 0xFF;
+        chunk->code[offset + 1] = jump & 0xFF;
+        current->jumpTarget = chunk->count;
+        return 0;
     }
-    currentChunk()->code[offset] = (jump >> 8) & 0xFF;
-    currentChunk()->code[offset + 1] = jump & 0xFF;
-}
-
-static void emitLoop(int loopStart) {
-    emitByte(OP_LOOP);
 
-    int offset = currentChunk()->count - (loopStart - 2);
-    if (offset > UINT16_MAX) error("Loop body too large.");
+    // too far for a short jump, so it becomes the long form by growing its operand in place
+    chunk->code[offset - 1] = longJump(chunk->code[offset - 1]);
+    Chunk_insert(chunk, offset, 0);
+    current->jumpTarget = chunk->count;
+    jump = chunk->count - (offset + 3);
+    if (jump > UINT24_MAX - JUMP_STRETCH) {
+        error("Too much code to jump over.");
+    }
+    chunk->code[offset] = (jump >> 16) & 0xFF;
+    chunk->code[offset + 1] = (jump >> 8) & 0xFF;
+    chunk->code[offset + 2] = jump & 0xFF;
+    return 1;
+}
+
+// Returns the offset of the operand, like emitJump.
+static int emitLoop(int loopStart) {
+    int offset = currentChunk()->count + 3 - loopStart;
+    if (offset <= UINT16_MAX - JUMP_STRETCH) {
+        emitByte(OP_LOOP);
+        emitByte((offset >> 8) & 0xFF);
+        emitByte(offset & 0xFF);
+        return currentChunk()->count - 2;
+    }
 
+    offset++; // the operand of the long form is one byte wider
+    if (offset > UINT24_MAX - JUMP_STRETCH) error("Loop body too large.");
+    emitByte(OP_LOOP_LONG);
+    emitByte((offset >> 16) & 0xFF);
     emitByte((offset >> 8) & 0xFF);
     emitByte(offset & 0xFF);
+    return currentChunk()->count - 3;
+}
+
+// Makes an already patched jump cover the bytes a later patchJump inserted.
+static void stretchJump(int offset, int inserted) {
+    if (inserted == 0) return;
+    uint8_t *code = currentChunk()->code;
+    switch (code[offset - 1]) {
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_LOOP: {
+            int jump = ((code[offset] << 8) | code[offset + 1]) + inserted;
+            code[offset] = (jump >> 8) & 0xFF;
+            code[offset + 1] = jump & 0xFF;
+            break;
+        }
+        default: {
+            int jump = ((code[offset] << 16) | (code[offset + 1] << 8) | code[offset + 2]) + inserted;
+            code[offset] = (jump >> 16) & 0xFF;
+            code[offset + 1] = (jump >> 8) & 0xFF;
+            code[offset + 2] = jump & 0xFF;
+            break;
+        }
+    }
 }
 
-static uint8_t makeConstant(Value value) {
+static int makeConstant(Value value) {
     int constant = Chunk_addConstant(currentChunk(), value);
-    if (constant > UINT8_MAX) {
+    if (constant > UINT24_MAX) {
         error("Too many constants in one chunk.");
         return 0;
     }
 
-    return (uint8_t)constant;
+    return constant;
 }
 static void emitConstant(Value value) {
-    emitBytes(OP_CONSTANT, makeConstant(value));
+    emitIndexed(OP_CONSTANT, OP_CONSTANT_LONG, makeConstant(value));
 }
 
 static void emitReturn() {
@@ -193,15 +323,144 @@ static void emitReturn() {
 }
 
 static void endCompiler() {
+    emitReturn();
+    if (!parser.hadError && compilerOptions.peephole) {
+        OptimizerStats stats = Optimizer_peephole(currentChunk());
+        if (compilerOptions.peepholeStats) {
+            fprintf(stderr, "peephole: %d -> %d instructions (%d removed), %d fused, %d jumps threaded\n",
+                    stats.instructionsBefore, stats.instructionsAfter,
+                    stats.instructionsBefore - stats.instructionsAfter, stats.fused, stats.threaded);
+        }
+    }
+    if (!parser.hadError) {
+        Chunk_computeMaxStack(currentChunk());
+    }
 #ifdef DEBUG_PRINT_CODE
     if (!parser.hadError) {
         Chunk_disassemble(currentChunk(), "code");
     }
 #endif
-    emitReturn();
 }
 
 
+// ===== CONSTANT FOLDING =====
+
+// Operators are folded after both operands have been emitted, by looking at
+// the code they compiled to. An operand is a literal if it compiled to exactly
+// one literal instruction, and nothing jumps into the middle of a single
+// instruction, so replacing it is always safe.
+static bool literalBetween(int start, int end, Value *value) {
+    Chunk *chunk = currentChunk();
+    if (start >= end) return false;
+    switch (chunk->code[start]) {
+        case OP_NIL: *value = NIL_VAL; return end == start + 1;
+        case OP_TRUE: *value = BOOL_VAL(true); return end == start + 1;
+        case OP_FALSE: *value = BOOL_VAL(false); return end == start + 1;
+        case OP_CONSTANT:
+            if (end != start + 2) return false;
+            *value = chunk->constants.values[chunk->code[start + 1]];
+            return true;
+        case OP_CONSTANT_LONG:
+            if (end != start + 4) return false;
+            *value = chunk->constants.values[(chunk->code[start + 1] << 16) |
+                                             (chunk->code[start + 2] << 8) | chunk->code[start + 3]];
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The code ending at end always leaves a number if its last instruction does,
+// unless a jump lands right after it with some other value on the stack.
+static bool isNumberEndingAt(int end) {
+    return current->numberEnd == end && current->jumpTarget != end;
+}
+
+static void removeCode(int start) {
+    Chunk_truncate(currentChunk(), start);
+    if (current->numberEnd > start) current->numberEnd = -1;
+}
+
+static void emitLiteral(Value value) {
+    if (IS_NIL(value)) {
+        emitByte(OP_NIL);
+    } else if (IS_BOOL(value)) {
+        emitByte(AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+    } else {
+        emitConstant(value);
+    }
+    if (IS_NUMBER(value)) current->numberEnd = currentChunk()->count;
+}
+
+static bool foldNumbers(TokenType operatorType, double a, double b, Value *result) {
+    switch (operatorType) {
+        case TOKEN_PLUS: *result = NUMBER_VAL(a + b); return true;
+        case TOKEN_MINUS: *result = NUMBER_VAL(a - b); return true;
+        case TOKEN_STAR: *result = NUMBER_VAL(a * b); return true;
+        case TOKEN_SLASH: *result = NUMBER_VAL(a / b); return true;
+        case TOKEN_LESS: *result = BOOL_VAL(a < b); return true;
+        case TOKEN_LESS_EQUAL: *result = BOOL_VAL(!(a > b)); return true; // as OP_GREATER, OP_NOT would
+        case TOKEN_GREATER: *result = BOOL_VAL(a > b); return true;
+        case TOKEN_GREATER_EQUAL: *result = BOOL_VAL(!(a < b)); return true;
+        default: return false;
+    }
+}
+
+// x * 1, x / 1 and x - 0 are x for every number, -0 and NaN included, so the
+// operator can go when x is known to be a number. x + 0 is not: -0 + 0 is 0.
+static bool foldIdentity(TokenType operatorType, int rightStart, Value right) {
+    if (!IS_NUMBER(right)) return false;
+    double b = AS_NUMBER(right);
+    bool identity = (b == 1 && (operatorType == TOKEN_STAR || operatorType == TOKEN_SLASH)) ||
+                    (b == 0 && !signbit(b) && operatorType == TOKEN_MINUS);
+    if (!identity) return false;
+    removeCode(rightStart);
+    return true;
+}
+
+static bool foldBinary(TokenType operatorType, int leftStart, int rightStart, bool leftIsNumber) {
+    Value a;
+    Value b;
+    if (!literalBetween(rightStart, currentChunk()->count, &b)) return false;
+    if (!literalBetween(leftStart, rightStart, &a)) {
+        return leftIsNumber && foldIdentity(operatorType, rightStart, b);
+    }
+
+    Value result;
+    if (operatorType == TOKEN_EQUAL_EQUAL) {
+        result = BOOL_VAL(Value_equal(a, b));
+    } else if (operatorType == TOKEN_BANG_EQUAL) {
+        result = BOOL_VAL(!Value_equal(a, b));
+    } else if (operatorType == TOKEN_PLUS && IS_FLAT_STRING(a) && IS_FLAT_STRING(b)) {
+        // both strings are still constants of the chunk, which keeps them alive
+        result = ObjString_concatenate(a, b);
+    } else if (!IS_NUMBER(a) || !IS_NUMBER(b) || !foldNumbers(operatorType, AS_NUMBER(a), AS_NUMBER(b), &result)) {
+        return false; // left for the runtime, which reports the error
+    }
+
+    removeCode(leftStart);
+    emitLiteral(result);
+    return true;
+}
+
+static bool foldUnary(TokenType operatorType, int operandStart) {
+    Value value;
+    if (!literalBetween(operandStart, currentChunk()->count, &value)) return false;
+
+    Value result;
+    if (operatorType == TOKEN_BANG) {
+        result = BOOL_VAL(IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value)));
+    } else if (operatorType == TOKEN_MINUS && IS_NUMBER(value)) {
+        result = NUMBER_VAL(-AS_NUMBER(value));
+    } else {
+        return false;
+    }
+
+    removeCode(operandStart);
+    emitLiteral(result);
+    return true;
+}
+
 // ===== EXPRESSIONS =====
 
 ParseRule *getRule(TokenType tokenType) {
@@ -217,6 +476,7 @@ static void parsePrecedence(Precedence precedence) {
     }
 
     bool canAssign = precedence <= PREC_ASSIGNMENT;
+    int start = currentChunk()->count;
     prefixRule(canAssign); // parse left (maybe only) side
 
     // When input precedence is low, this will most likely hit and keep calling recursively
@@ -242,21 +502,21 @@ static void parsePrecedence(Precedence precedence) {
     while (precedence <= getRule(parser.current.type)->precedence) {
         advance(); // consume operator
         ParseFn infixRule = getRule(parser.previous.type)->infix;
+        current->operandStart = start;
         infixRule(canAssign); // parse right side
     }
 }
 
 static void number(bool canAssign) {
-    double value = strtod(parser.previous.start, NULL);
+    double value = Scanner_parseNumber(parser.previous.start, parser.previous.length);
     emitConstant(NUMBER_VAL(value));
 }
 
 static void string(bool canAssign) {
-    ObjString *obj = ObjString_copyFrom(
+    emitConstant(ObjString_valueFrom(
             parser.previous.start + 1, // trim leading "
             parser.previous.length - 2 // trim trailing "
-    );
-    emitConstant(OBJ_VAL(obj));
+    ));
 }
 
 static void variable(bool canAssign) {
@@ -269,10 +529,17 @@ static void grouping(bool canAssign) {
 }
 
 static void binary(bool canAssign) {
+    int leftStart = current->operandStart;
+    int rightStart = currentChunk()->count;
+    bool leftIsNumber = isNumberEndingAt(rightStart);
     TokenType operatorType = parser.previous.type;
     ParseRule *rule = getRule(operatorType);
     parsePrecedence((Precedence)rule->precedence + 1); // parse deeper, but only for "more important" rules
 
+    if (compilerOptions.fold && foldBinary(operatorType, leftStart, rightStart, leftIsNumber)) {
+        return;
+    }
+
     switch (operatorType) {
         case TOKEN_BANG_EQUAL: emitBytes(OP_EQUAL, OP_NOT); break;
         case TOKEN_EQUAL_EQUAL: emitByte(OP_EQUAL); break;
@@ -286,6 +553,9 @@ static void binary(bool canAssign) {
         case TOKEN_SLASH: emitByte(OP_DIVIDE); break;
         default: break; // unreachable
     }
+    if (operatorType == TOKEN_MINUS || operatorType == TOKEN_STAR || operatorType == TOKEN_SLASH) {
+        current->numberEnd = currentChunk()->count;
+    }
 }
 
 static void and_(bool canAssign) {
@@ -301,20 +571,28 @@ static void or_(bool canAssign) {
     int elseJump = emitJump(OP_JUMP_IF_FALSE);
     int endJump = emitJump(OP_JUMP); // otherwise we should skip the RHS.
 
-    patchJump(elseJump); // B starts here
+    endJump += patchJump(elseJump); // B starts here
     emitByte(OP_POP); // get rid of A value
     parsePrecedence(PREC_OR); // parse B
 
-    patchJump(endJump);
+    stretchJump(elseJump, patchJump(endJump));
 }
 
 static void unary(bool canAssign) {
     TokenType operatorType = parser.previous.type;
+    int operandStart = currentChunk()->count;
 
     parsePrecedence(PREC_UNARY);
 
+    if (compilerOptions.fold && foldUnary(operatorType, operandStart)) {
+        return;
+    }
+
     switch (operatorType) {
-        case TOKEN_MINUS: emitByte(OP_NEGATE); break;
+        case TOKEN_MINUS:
+            emitByte(OP_NEGATE);
+            current->numberEnd = currentChunk()->count;
+            break;
         case TOKEN_BANG: emitByte(OP_NOT); break;
         default: break;
     }
@@ -356,7 +634,7 @@ static void expressionStatement() {
 }
 
 static void varDeclaration() {
-    uint8_t global = parseVariable("Expected variable name.");
+    int global = parseVariable("Expected variable name.");
 
     if (match(TOKEN_EQUAL)) { // initial value
         expression();
@@ -368,22 +646,32 @@ static void varDeclaration() {
     defineVariable(global);
 }
 
-static uint8_t parseVariable(const char *errorMessage) {
+static int parseVariable(const char *errorMessage) {
     consume(TOKEN_IDENTIFIER, errorMessage);
     declareVariable();
     if (current->scopeDepth > 0) return 0;
-    return identifierConstant(&parser.previous);
+    return globalSlot(&parser.previous);
 }
 
-static uint8_t identifierConstant(Token *name) {
-    return makeConstant(OBJ_VAL(ObjString_copyFrom(name->start, name->length)));
+static int globalSlot(Token *name) {
+    int slot = VM_globalSlot(ObjString_copyFrom(name->start, name->length));
+    if (slot > UINT24_MAX) {
+        error("Too many global variables.");
+        return 0;
+    }
+    return slot;
 }
 
 static void addLocal(Token name) {
-    if (current->localCount == UINT8_COUNT) {
+    if (current->localCount == UINT16_COUNT) {
         error("Too many local variables in function");
         return;
     }
+    if (current->localCapacity < current->localCount + 1) {
+        int oldCapacity = current->localCapacity;
+        current->localCapacity = GROW_CAPACITY(oldCapacity);
+        current->locals = GROW_SCOPED_ARRAY(Local, current->locals, oldCapacity, current->localCapacity);
+    }
     Local *local = &current->locals[current->localCount++];
     local->name = name;
     local->depth = -1;
@@ -393,12 +681,12 @@ static void markInitialized() {
     current->locals[current->localCount - 1].depth = current->scopeDepth;
 }
 
-static void defineVariable(uint8_t global) {
+static void defineVariable(int global) {
     if (current->scopeDepth > 0) {
         markInitialized();
         return;
     }
-    emitBytes(OP_DEFINE_GLOBAL, global);
+    emitIndexed(OP_DEFINE_GLOBAL, OP_DEFINE_GLOBAL_LONG, global);
 }
 
 static void declareVariable() {
@@ -429,23 +717,23 @@ static int resolveLocal(Token *token) {
 }
 
 static void namedVariable(Token name, bool canAssign) {
-    OpCode setOp;
-    OpCode getOp;
     int arg = resolveLocal(&name);
     if (arg != -1) {
-        setOp = OP_SET_LOCAL;
-        getOp = OP_GET_LOCAL;
-    } else {
-        arg = identifierConstant(&name);
-        setOp = OP_SET_GLOBAL;
-        getOp = OP_GET_GLOBAL;
+        if (canAssign && match(TOKEN_EQUAL)) {
+            expression();
+            emitLocal(OP_SET_LOCAL, OP_SET_LOCAL_LONG, arg);
+        } else {
+            emitLocal(OP_GET_LOCAL, OP_GET_LOCAL_LONG, arg);
+        }
+        return;
     }
 
+    arg = globalSlot(&name);
     if (canAssign && match(TOKEN_EQUAL)) {
         expression();
-        emitBytes(setOp, (uint8_t) arg);
+        emitIndexed(OP_SET_GLOBAL, OP_SET_GLOBAL_LONG, arg);
     } else {
-        emitBytes(getOp, (uint8_t) arg);
+        emitIndexed(OP_GET_GLOBAL, OP_GET_GLOBAL_LONG, arg);
     }
 }
 
@@ -474,13 +762,13 @@ static void ifStatement() {
     emitByte(OP_POP);
     statement();
     int elseJump = emitJump(OP_JUMP);
-    patchJump(thenJump);
+    elseJump += patchJump(thenJump);
     emitByte(OP_POP);
 
     if (match(TOKEN_ELSE)) {
         statement();
     }
-    patchJump(thenJump);
+    stretchJump(thenJump, patchJump(elseJump)); // the then branch jumps past elseJump
 }
 
 static void whileStatement() {
@@ -492,9 +780,10 @@ static void whileStatement() {
     int exitJump = emitJump(OP_JUMP_IF_FALSE);
     emitByte(OP_POP); // get rid of condition value
     statement();
-    emitLoop(loopStart);
+    int loop = emitLoop(loopStart);
 
-    patchJump(exitJump);
+    int inserted = patchJump(exitJump);
+    stretchJump(loop + inserted, inserted);
     emitByte(OP_POP); // get rid of condition value
 }
 
@@ -518,22 +807,28 @@ static void forStatement() {
         emitByte(OP_POP);
     }
 
+    int incrementLoop = -1;
     if (!match(TOKEN_RIGHT_PAREN)) { // increment clause
         int bodyJump = emitJump(OP_JUMP);
         int incrementStart = currentChunk()->count;
         expression();
+        emitByte(OP_POP); // get rid of increment value
         consume(TOKEN_RIGHT_PAREN, "Expected ')' after 'for' declaration.");
 
-        emitLoop(loopStart);
-        loopStart = incrementStart;
-        patchJump(bodyJump);
+        incrementLoop = emitLoop(loopStart);
+        int inserted = patchJump(bodyJump);
+        incrementLoop += inserted;
+        stretchJump(incrementLoop, inserted);
+        loopStart = incrementStart + inserted;
     }
 
     statement();
-    emitLoop(loopStart);
+    int bodyLoop = emitLoop(loopStart);
 
     if (exitJump != -1) {
-        patchJump(exitJump);
+        // the exit jump sits between the condition and whichever loop jumps back to it
+        int inserted = patchJump(exitJump);
+        stretchJump(incrementLoop != -1 ? incrementLoop + inserted : bodyLoop + inserted, inserted);
         emitByte(OP_POP);
     }
     endScope();
@@ -579,17 +874,17 @@ static void error(const char *message) {
 static void errorAt(Token *token, const char *message) {
     if (parser.panicMode) return;
     parser.panicMode = true;
-    fprintf(stderr, "[line %d] Error", token->line);
+    fprintf(vm.err, "[line %d] Error", token->line);
 
     if (token->type == TOKEN_EOF) {
-        fprintf(stderr, " at end");
+        fprintf(vm.err, " at end");
     } else if (token->type == TOKEN_ERROR) {
         // Nothing.
     } else {
-        fprintf(stderr, " at '%.*s'", token->length, token->start);
+        fprintf(vm.err, " at '%.*s'", token->length, token->start);
     }
 
-    fprintf(stderr, ": %s\n", message);
+    fprintf(vm.err, ": %s\n", message);
     parser.hadError = true;
 }
 
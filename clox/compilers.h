@@ -6,7 +6,25 @@
 #define CLOX_COMPILERS_H
 
 #include "chunk.h"
+#include "registers.h"
 
-bool compile(const char *source, Chunk *chunk);
+typedef struct {
+    bool fold;           // fold operators on literals while compiling
+    bool peephole;       // run the peephole optimizer over every compiled chunk
+    bool peepholeStats;  // report what it did on stderr
+    bool registerVM;     // lower every chunk to register code and run that instead
+    bool jit;            // compile hot loops of stack code to native code, see jit.h
+    bool jitStats;       // report what the JIT did on stderr
+    bool baseline;       // compile every chunk of stack code to native code first, see baseline.h
+} CompilerOptions;
+
+// Shared by every thread, so they are set before any of them compiles.
+extern CompilerOptions compilerOptions;
+
+// source is length characters long and does not have to be NUL-terminated.
+bool compile(const char *source, size_t length, Chunk *chunk);
+// Compiles to stack code in chunk, then to register code that uses its constants.
+bool compileRegisters(const char *source, size_t length, Chunk *chunk, RegisterCode *registers);
+void markCompilerRoots();
 
 #endif //CLOX_COMPILERS_H
@@ -6,15 +6,54 @@
 
 #include "debug.h"
 #include "value.h"
+#include "vm.h"
 
 static int constantInstruction(const char* name, Chunk* chunk, int offset) {
     uint8_t constant = chunk->code[offset + 1];
     printf("%-16s %4d '", name, constant);
-    Value_print(chunk->constants.values[constant]);
+    Value_print(stdout, chunk->constants.values[constant]);
     printf("'\n");
     return offset + 2;
 }
 
+static int readLong(Chunk *chunk, int offset) {
+    return (chunk->code[offset] << 16) | (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+}
+
+static int constantLongInstruction(const char* name, Chunk* chunk, int offset) {
+    int constant = readLong(chunk, offset + 1);
+    printf("%-16s %4d '", name, constant);
+    Value_print(stdout, chunk->constants.values[constant]);
+    printf("'\n");
+    return offset + 4;
+}
+
+static int globalLongInstruction(const char* name, Chunk* chunk, int offset) {
+    int slot = readLong(chunk, offset + 1);
+    printf("%-16s %4d '%s'\n", name, slot, vm.globals.names[slot]->chars);
+    return offset + 4;
+}
+
+static int shortInstruction(const char* name, Chunk* chunk, int offset) {
+    int slot = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    printf("%-16s %4d\n", name, slot);
+    return offset + 3;
+}
+
+static int jumpLongInstruction(const char* name, int sign,
+                               Chunk* chunk, int offset) {
+    int jump = readLong(chunk, offset + 1);
+    printf("%-16s %4d -> %d\n", name, offset,
+           offset + 4 + sign * jump);
+    return offset + 4;
+}
+
+static int globalInstruction(const char* name, Chunk* chunk, int offset) {
+    uint8_t slot = chunk->code[offset + 1];
+    printf("%-16s %4d '%s'\n", name, slot, vm.globals.names[slot]->chars);
+    return offset + 2;
+}
+
 static int byteInstruction(const char* name, Chunk* chunk, int offset) {
     uint8_t slot = chunk->code[offset + 1];
     printf("%-16s %4d\n", name, slot);
@@ -48,16 +87,19 @@ void Chunk_disassemble(Chunk *chunk, const char *name) {
 
 int Chunk_disassembleInstruction(Chunk *chunk, int offset) {
     printf("%04d ", offset);
-    if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1]) {
+    int line = Chunk_getLine(chunk, offset);
+    if (offset > 0 && line == Chunk_getLine(chunk, offset - 1)) {
         printf("   | ");
     } else {
-        printf("%4d ", chunk->lines[offset]);
+        printf("%4d ", line);
     }
 
     uint8_t instruction = chunk->code[offset];
     switch (instruction) {
         case OP_CONSTANT:
             return constantInstruction("OP_CONSTANT", chunk, offset);
+        case OP_CONSTANT_LONG:
+            return constantLongInstruction("OP_CONSTANT_LONG", chunk, offset);
         case OP_NIL:
             return simpleInstruction("OP_NIL", offset);
         case OP_TRUE:
@@ -67,21 +109,39 @@ int Chunk_disassembleInstruction(Chunk *chunk, int offset) {
         case OP_POP:
             return simpleInstruction("OP_POP", offset);
         case OP_DEFINE_GLOBAL:
-            return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+            return globalInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+        case OP_DEFINE_GLOBAL_LONG:
+            return globalLongInstruction("OP_DEFINE_GLOBAL_LONG", chunk, offset);
         case OP_GET_LOCAL:
             return byteInstruction("OP_GET_LOCAL", chunk, offset);
+        case OP_GET_LOCAL_LONG:
+            return shortInstruction("OP_GET_LOCAL_LONG", chunk, offset);
         case OP_SET_LOCAL:
             return byteInstruction("OP_SET_LOCAL", chunk, offset);
+        case OP_SET_LOCAL_LONG:
+            return shortInstruction("OP_SET_LOCAL_LONG", chunk, offset);
+        case OP_SET_LOCAL_POP:
+            return byteInstruction("OP_SET_LOCAL_POP", chunk, offset);
         case OP_GET_GLOBAL:
-            return constantInstruction("OP_GET_GLOBAL", chunk, offset);
+            return globalInstruction("OP_GET_GLOBAL", chunk, offset);
+        case OP_GET_GLOBAL_LONG:
+            return globalLongInstruction("OP_GET_GLOBAL_LONG", chunk, offset);
         case OP_SET_GLOBAL:
-            return constantInstruction("OP_SET_GLOBAL", chunk, offset);
+            return globalInstruction("OP_SET_GLOBAL", chunk, offset);
+        case OP_SET_GLOBAL_LONG:
+            return globalLongInstruction("OP_SET_GLOBAL_LONG", chunk, offset);
         case OP_EQUAL:
             return simpleInstruction("OP_EQUAL", offset);
+        case OP_NOT_EQUAL:
+            return simpleInstruction("OP_NOT_EQUAL", offset);
         case OP_GREATER:
             return simpleInstruction("OP_GREATER", offset);
+        case OP_GREATER_EQUAL:
+            return simpleInstruction("OP_GREATER_EQUAL", offset);
         case OP_LESS:
             return simpleInstruction("OP_LESS", offset);
+        case OP_LESS_EQUAL:
+            return simpleInstruction("OP_LESS_EQUAL", offset);
         case OP_ADD:
             return simpleInstruction("OP_ADD", offset);
         case OP_SUBTRACT:
@@ -98,14 +158,150 @@ int Chunk_disassembleInstruction(Chunk *chunk, int offset) {
             return simpleInstruction("OP_PRINT", offset);
         case OP_JUMP:
             return jumpInstruction("OP_JUMP", 1, chunk, offset);
+        case OP_JUMP_LONG:
+            return jumpLongInstruction("OP_JUMP_LONG", 1, chunk, offset);
         case OP_JUMP_IF_FALSE:
             return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+        case OP_JUMP_IF_FALSE_LONG:
+            return jumpLongInstruction("OP_JUMP_IF_FALSE_LONG", 1, chunk, offset);
         case OP_LOOP:
             return jumpInstruction("OP_LOOP", -1, chunk, offset);
+        case OP_LOOP_LONG:
+            return jumpLongInstruction("OP_LOOP_LONG", -1, chunk, offset);
         case OP_RETURN:
             return simpleInstruction("OP_RETURN", offset);
         default:
             printf("Unknown opcode: %d\n", instruction);
             return offset + 1;
     }
-}
\ No newline at end of file
+}
+
+const char *OpCode_name(OpCode op) {
+    switch (op) {
+        case OP_CONSTANT: return "OP_CONSTANT";
+        case OP_CONSTANT_LONG: return "OP_CONSTANT_LONG";
+        case OP_NIL: return "OP_NIL";
+        case OP_TRUE: return "OP_TRUE";
+        case OP_FALSE: return "OP_FALSE";
+        case OP_POP: return "OP_POP";
+        case OP_GET_GLOBAL: return "OP_GET_GLOBAL";
+        case OP_GET_GLOBAL_LONG: return "OP_GET_GLOBAL_LONG";
+        case OP_GET_LOCAL: return "OP_GET_LOCAL";
+        case OP_GET_LOCAL_LONG: return "OP_GET_LOCAL_LONG";
+        case OP_DEFINE_GLOBAL: return "OP_DEFINE_GLOBAL";
+        case OP_DEFINE_GLOBAL_LONG: return "OP_DEFINE_GLOBAL_LONG";
+        case OP_SET_GLOBAL: return "OP_SET_GLOBAL";
+        case OP_SET_GLOBAL_LONG: return "OP_SET_GLOBAL_LONG";
+        case OP_SET_LOCAL: return "OP_SET_LOCAL";
+        case OP_SET_LOCAL_LONG: return "OP_SET_LOCAL_LONG";
+        case OP_SET_LOCAL_POP: return "OP_SET_LOCAL_POP";
+        case OP_EQUAL: return "OP_EQUAL";
+        case OP_NOT_EQUAL: return "OP_NOT_EQUAL";
+        case OP_GREATER: return "OP_GREATER";
+        case OP_GREATER_EQUAL: return "OP_GREATER_EQUAL";
+        case OP_LESS: return "OP_LESS";
+        case OP_LESS_EQUAL: return "OP_LESS_EQUAL";
+        case OP_ADD: return "OP_ADD";
+        case OP_SUBTRACT: return "OP_SUBTRACT";
+        case OP_MULTIPLY: return "OP_MULTIPLY";
+        case OP_DIVIDE: return "OP_DIVIDE";
+        case OP_NOT: return "OP_NOT";
+        case OP_NEGATE: return "OP_NEGATE";
+        case OP_PRINT: return "OP_PRINT";
+        case OP_JUMP: return "OP_JUMP";
+        case OP_JUMP_LONG: return "OP_JUMP_LONG";
+        case OP_JUMP_IF_FALSE: return "OP_JUMP_IF_FALSE";
+        case OP_JUMP_IF_FALSE_LONG: return "OP_JUMP_IF_FALSE_LONG";
+        case OP_LOOP: return "OP_LOOP";
+        case OP_LOOP_LONG: return "OP_LOOP_LONG";
+        case OP_RETURN: return "OP_RETURN";
+    }
+    return "OP_UNKNOWN";
+}
+
+static void registerOperand(Chunk *chunk, int operand) {
+    if (operand >= 0) {
+        printf(" r%d", operand);
+    } else {
+        printf(" k%d'", ~operand);
+        Value_print(stdout, chunk->constants.values[~operand]);
+        printf("'");
+    }
+}
+
+static const char *registerOpName(RegisterOpCode op) {
+    switch (op) {
+        case REG_MOVE: return "REG_MOVE";
+        case REG_GET_GLOBAL: return "REG_GET_GLOBAL";
+        case REG_DEFINE_GLOBAL: return "REG_DEFINE_GLOBAL";
+        case REG_SET_GLOBAL: return "REG_SET_GLOBAL";
+        case REG_EQUAL: return "REG_EQUAL";
+        case REG_NOT_EQUAL: return "REG_NOT_EQUAL";
+        case REG_GREATER: return "REG_GREATER";
+        case REG_GREATER_EQUAL: return "REG_GREATER_EQUAL";
+        case REG_LESS: return "REG_LESS";
+        case REG_LESS_EQUAL: return "REG_LESS_EQUAL";
+        case REG_ADD: return "REG_ADD";
+        case REG_SUBTRACT: return "REG_SUBTRACT";
+        case REG_MULTIPLY: return "REG_MULTIPLY";
+        case REG_DIVIDE: return "REG_DIVIDE";
+        case REG_NOT: return "REG_NOT";
+        case REG_NEGATE: return "REG_NEGATE";
+        case REG_PRINT: return "REG_PRINT";
+        case REG_JUMP: return "REG_JUMP";
+        case REG_JUMP_IF_FALSE: return "REG_JUMP_IF_FALSE";
+        case REG_RETURN: return "REG_RETURN";
+    }
+    return "Unknown opcode";
+}
+
+void RegisterCode_disassemble(RegisterCode *code, Chunk *chunk, const char *name) {
+    printf("== %s (%d registers) ==\n", name, code->frameSize);
+
+    for (int i = 0; i < code->count; ++i) {
+        RegisterInstruction *instruction = &code->code[i];
+        int line = RegisterCode_getLine(code, i);
+        printf("%04d ", i);
+        if (i > 0 && line == RegisterCode_getLine(code, i - 1)) {
+            printf("   | ");
+        } else {
+            printf("%4d ", line);
+        }
+        printf("%-18s", registerOpName(instruction->op));
+
+        switch (instruction->op) {
+            case REG_MOVE:
+            case REG_NOT:
+            case REG_NEGATE:
+                printf(" r%d", instruction->a);
+                registerOperand(chunk, instruction->b);
+                break;
+            case REG_GET_GLOBAL:
+                printf(" r%d '%s'", instruction->a, vm.globals.names[instruction->b]->chars);
+                break;
+            case REG_DEFINE_GLOBAL:
+            case REG_SET_GLOBAL:
+                printf(" '%s'", vm.globals.names[instruction->a]->chars);
+                registerOperand(chunk, instruction->b);
+                break;
+            case REG_PRINT:
+                registerOperand(chunk, instruction->a);
+                break;
+            case REG_JUMP:
+                printf(" -> %d", instruction->b);
+                break;
+            case REG_JUMP_IF_FALSE:
+                registerOperand(chunk, instruction->a);
+                printf(" -> %d", instruction->b);
+                break;
+            case REG_RETURN:
+                break;
+            default:
+                printf(" r%d", instruction->a);
+                registerOperand(chunk, instruction->b);
+                registerOperand(chunk, instruction->c);
+                break;
+        }
+        printf("\n");
+    }
+}
@@ -6,8 +6,11 @@
 #define clox_debug_h
 
 #include "chunk.h"
+#include "registers.h"
 
 void Chunk_disassemble(Chunk *chunk, const char *name);
 int Chunk_disassembleInstruction(Chunk *chunk, int offset);
+const char *OpCode_name(OpCode op);
+void RegisterCode_disassemble(RegisterCode *code, Chunk *chunk, const char *name);
 
 #endif //clox_debug_h
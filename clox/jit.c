@@ -0,0 +1,909 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifdef JIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "compilers.h"
+#include "vm.h"
+
+#define HOT_LOOP 50            // back-edges to a header before it is recorded
+#define MAX_TRACE_LENGTH 1000  // instructions in one iteration
+#define MAX_ENTRY_FAILURES 100 // entries refused before the trace is dropped
+#define HOT_EXIT 50            // times a side exit is taken before the loop is recorded again
+#define MAX_RETRACES 4
+// Slots live in xmm0 and up, the trace's stack right above them, and xmm15 is
+// scratch, so a trace that needs more registers than that is not compiled.
+#define MAX_SLOTS 12
+#define MAX_DEPTH 12
+#define SCRATCH 15
+
+// A local below the loop's stack height, or a global, that the trace keeps in
+// a register and writes back when it leaves.
+typedef struct {
+    bool global;
+    uint32_t index;
+    bool readFirst; // read before the trace writes it, so it has to be a number on entry
+    bool written;
+} TraceSlot;
+
+typedef struct {
+    uint8_t *ip;
+    OpCode op;
+    uint32_t operand;
+    bool truthy;   // for a conditional jump, what it saw while recording
+    uint8_t *other; // and where it goes when it sees the opposite
+} TraceOp;
+
+// One iteration of a loop, from its header back to it.
+typedef struct {
+    uint8_t *header;
+    int base; // the stack height at the header, where the iteration's own locals start
+    TraceOp ops[MAX_TRACE_LENGTH];
+    int count;
+    TraceSlot slots[MAX_SLOTS];
+    int slotCount;
+    int maxDepth;
+} Recording;
+
+// Where the interpreter resumes after the trace leaves, and with what stack height.
+typedef struct {
+    uint8_t *resume;
+    int height;
+    bool inLoop; // a branch that went the other way, rather than the loop ending
+    int taken;
+} TraceExit;
+
+// Returns 0 if a slot did not hold what the trace needs on entry, and one more
+// than the index of the exit it left by otherwise.
+typedef int (*TraceFunction)(Value *stack, Value *globals);
+
+typedef struct {
+    TraceFunction function;
+    void *code;
+    size_t size;
+    int base;
+    TraceExit *exits;
+    int exitCount;
+    int entryFailures;
+} Trace;
+
+typedef struct {
+    uint8_t *header; // NULL for a free bucket
+    int count;
+    Trace *trace;
+    int retraces;
+    bool rejected; // could not be compiled, or kept refusing entry
+} Loop;
+
+typedef struct {
+    int compiled;
+    int rejected;
+    int retraced;
+    uint64_t runs;
+    uint64_t entryFailures;
+} JitStats;
+
+typedef struct {
+    Loop *loops;
+    int count;
+    int capacity;
+    JitStats stats;
+} Jit;
+
+static _Thread_local Jit jit;
+
+static bool isFalsy(Value value) {
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+// Recording runs one iteration without changing anything: the slots and the
+// stack it works on are copies, so it can give up halfway.
+
+static int findSlot(Recording *recording, bool global, uint32_t index) {
+    for (int i = 0; i < recording->slotCount; ++i) {
+        TraceSlot *slot = &recording->slots[i];
+        if (slot->global == global && slot->index == index) return i;
+    }
+    if (recording->slotCount == MAX_SLOTS) return -1;
+    recording->slots[recording->slotCount] = (TraceSlot) {global, index, false, false};
+    return recording->slotCount++;
+}
+
+static Value slotValue(Recording *recording, Value *values, int slot) {
+    if (recording->slots[slot].readFirst || recording->slots[slot].written) return values[slot];
+    TraceSlot *traced = &recording->slots[slot];
+    return traced->global ? vm.globals.values[traced->index] : vm.stack[traced->index];
+}
+
+static bool record(Recording *recording) {
+    Value values[MAX_SLOTS];
+    Value stack[MAX_DEPTH];
+    int depth = 0;
+    uint8_t *ip = recording->header;
+
+#define PUSH(value) do { if (depth == MAX_DEPTH) return false; stack[depth++] = (value); } while (false)
+#define POP() (stack[--depth])
+#define NUMBERS() (IS_NUMBER(stack[depth - 1]) && IS_NUMBER(stack[depth - 2]))
+
+    for (;;) {
+        if (recording->count == MAX_TRACE_LENGTH) return false;
+        TraceOp *traced = &recording->ops[recording->count++];
+        OpCode op = *ip;
+        int width = Chunk_operandWidth(op);
+        uint32_t operand = 0;
+        for (int i = 1; i <= width; ++i) {
+            operand = operand << 8 | ip[i];
+        }
+        *traced = (TraceOp) {ip, op, operand, false, NULL};
+        uint8_t *next = ip + 1 + width;
+
+        switch (op) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG: {
+                Value constant = vm.chunk->constants.values[operand];
+                if (!IS_NUMBER(constant)) return false;
+                PUSH(constant);
+                break;
+            }
+            case OP_NIL: PUSH(NIL_VAL); break;
+            case OP_TRUE: PUSH(TRUE_VAL); break;
+            case OP_FALSE: PUSH(FALSE_VAL); break;
+            case OP_POP:
+                if (depth == 0) return false;
+                depth--;
+                break;
+
+            case OP_GET_LOCAL:
+            case OP_GET_LOCAL_LONG:
+            case OP_GET_GLOBAL:
+            case OP_GET_GLOBAL_LONG: {
+                bool global = op == OP_GET_GLOBAL || op == OP_GET_GLOBAL_LONG;
+                if (!global && (int) operand >= recording->base) {
+                    if ((int) operand - recording->base >= depth) return false;
+                    PUSH(stack[operand - recording->base]);
+                    break;
+                }
+                int slot = findSlot(recording, global, operand);
+                if (slot < 0) return false;
+                Value value = slotValue(recording, values, slot);
+                if (!IS_NUMBER(value)) return false;
+                if (!recording->slots[slot].written) recording->slots[slot].readFirst = true;
+                values[slot] = value;
+                PUSH(value);
+                break;
+            }
+            case OP_SET_LOCAL:
+            case OP_SET_LOCAL_LONG:
+            case OP_SET_LOCAL_POP:
+            case OP_SET_GLOBAL:
+            case OP_SET_GLOBAL_LONG: {
+                bool global = op == OP_SET_GLOBAL || op == OP_SET_GLOBAL_LONG;
+                if (depth == 0) return false;
+                Value value = stack[depth - 1];
+                if (!global && (int) operand >= recording->base) {
+                    if ((int) operand - recording->base >= depth) return false;
+                    stack[operand - recording->base] = value;
+                } else {
+                    int slot = findSlot(recording, global, operand);
+                    if (slot < 0 || !IS_NUMBER(value)) return false;
+                    // assigning an undefined global is an error the trace does not check for
+                    if (global && !recording->slots[slot].readFirst && !recording->slots[slot].written &&
+                        IS_UNDEFINED(vm.globals.values[operand])) {
+                        return false;
+                    }
+                    recording->slots[slot].written = true;
+                    values[slot] = value;
+                }
+                if (op == OP_SET_LOCAL_POP) depth--;
+                break;
+            }
+
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+            case OP_GREATER:
+            case OP_GREATER_EQUAL:
+            case OP_LESS:
+            case OP_LESS_EQUAL:
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE: {
+                if (depth < 2 || !NUMBERS()) return false;
+                double b = AS_NUMBER(POP());
+                double a = AS_NUMBER(POP());
+                switch (op) {
+                    case OP_EQUAL: PUSH(BOOL_VAL(a == b)); break;
+                    case OP_NOT_EQUAL: PUSH(BOOL_VAL(a != b)); break;
+                    case OP_GREATER: PUSH(BOOL_VAL(a > b)); break;
+                    case OP_GREATER_EQUAL: PUSH(BOOL_VAL(!(a < b))); break;
+                    case OP_LESS: PUSH(BOOL_VAL(a < b)); break;
+                    case OP_LESS_EQUAL: PUSH(BOOL_VAL(!(a > b))); break;
+                    case OP_ADD: PUSH(NUMBER_VAL(a + b)); break;
+                    case OP_SUBTRACT: PUSH(NUMBER_VAL(a - b)); break;
+                    case OP_MULTIPLY: PUSH(NUMBER_VAL(a * b)); break;
+                    default: PUSH(NUMBER_VAL(a / b)); break;
+                }
+                break;
+            }
+            case OP_NEGATE:
+                if (depth == 0 || !IS_NUMBER(stack[depth - 1])) return false;
+                stack[depth - 1] = NUMBER_VAL(-AS_NUMBER(stack[depth - 1]));
+                break;
+            case OP_NOT:
+                if (depth == 0) return false;
+                stack[depth - 1] = BOOL_VAL(isFalsy(stack[depth - 1]));
+                break;
+
+            case OP_JUMP:
+            case OP_JUMP_LONG:
+                next += operand;
+                break;
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_FALSE_LONG:
+                if (depth == 0) return false;
+                traced->truthy = !isFalsy(stack[depth - 1]);
+                traced->other = traced->truthy ? next + operand : next;
+                if (!traced->truthy) next += operand;
+                break;
+            case OP_LOOP:
+            case OP_LOOP_LONG:
+                next -= operand;
+                if (next == recording->header) return depth == 0;
+                // a for loop's body jumps back to its increment, which is fine the
+                // first time, but a loop inside this one gets a trace of its own
+                for (int i = 0; i < recording->count; ++i) {
+                    if (recording->ops[i].ip == next) return false;
+                }
+                break;
+
+            default: // printing, defining globals and returning stay in the interpreter
+                return false;
+        }
+        if (depth > recording->maxDepth) recording->maxDepth = depth;
+        ip = next;
+    }
+
+#undef PUSH
+#undef POP
+#undef NUMBERS
+}
+
+// x86-64 machine code, for the few instructions traces are made of.
+
+enum {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RSI = 6, // globals
+    RDI = 7, // stack
+};
+
+enum {
+    CC_NOT_PARITY = 0xB,
+    CC_PARITY = 0xA,
+    CC_EQUAL = 0x4,
+    CC_NOT_EQUAL = 0x5,
+    CC_BELOW_EQUAL = 0x6,
+    CC_ABOVE = 0x7,
+};
+
+typedef struct {
+    uint8_t *code;
+    int count;
+    int capacity;
+} Assembler;
+
+static void emit(Assembler *assembler, uint8_t byte) {
+    if (assembler->count == assembler->capacity) {
+        assembler->capacity = assembler->capacity < 256 ? 256 : assembler->capacity * 2;
+        assembler->code = realloc(assembler->code, assembler->capacity);
+        if (assembler->code == NULL) exit(1);
+    }
+    assembler->code[assembler->count++] = byte;
+}
+
+static void emit32(Assembler *assembler, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        emit(assembler, (uint8_t) (value >> (8 * i)));
+    }
+}
+
+static void emit64(Assembler *assembler, uint64_t value) {
+    emit32(assembler, (uint32_t) value);
+    emit32(assembler, (uint32_t) (value >> 32));
+}
+
+// An SSE2 instruction between two xmm registers.
+static void emitSse(Assembler *assembler, uint8_t prefix, uint8_t opcode, int reg, int rm) {
+    emit(assembler, prefix);
+    if (reg >= 8 || rm >= 8) emit(assembler, 0x40 | (reg >> 3) << 2 | (rm >> 3));
+    emit(assembler, 0x0F);
+    emit(assembler, opcode);
+    emit(assembler, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// An SSE2 instruction between an xmm register and the Value at [base + displacement].
+static void emitSseMemory(Assembler *assembler, uint8_t prefix, uint8_t opcode, int reg, int base, int32_t displacement) {
+    emit(assembler, prefix);
+    if (reg >= 8) emit(assembler, 0x44);
+    emit(assembler, 0x0F);
+    emit(assembler, opcode);
+    emit(assembler, 0x80 | (reg & 7) << 3 | base);
+    emit32(assembler, (uint32_t) displacement);
+}
+
+static void emitMovImmediate(Assembler *assembler, int reg, uint64_t value) {
+    emit(assembler, 0x48);
+    emit(assembler, 0xB8 + reg);
+    emit64(assembler, value);
+}
+
+// movq xmm, rax
+static void emitMovXmmRax(Assembler *assembler, int xmm) {
+    emit(assembler, 0x66);
+    emit(assembler, 0x48 | (xmm >> 3) << 2);
+    emit(assembler, 0x0F);
+    emit(assembler, 0x6E);
+    emit(assembler, 0xC0 | (xmm & 7) << 3);
+}
+
+// movq rax, xmm
+static void emitMovRaxXmm(Assembler *assembler, int xmm) {
+    emit(assembler, 0x66);
+    emit(assembler, 0x48 | (xmm >> 3) << 2);
+    emit(assembler, 0x0F);
+    emit(assembler, 0x7E);
+    emit(assembler, 0xC0 | (xmm & 7) << 3);
+}
+
+// mov rax, [base + displacement] with opcode 0x8B, the other way with 0x89.
+static void emitMovRaxMemory(Assembler *assembler, uint8_t opcode, int base, int32_t displacement) {
+    emit(assembler, 0x48);
+    emit(assembler, opcode);
+    emit(assembler, 0x80 | base);
+    emit32(assembler, (uint32_t) displacement);
+}
+
+// and rax, rdx with opcode 0x21, cmp rax, reg with 0x39.
+static void emitRaxOp(Assembler *assembler, uint8_t opcode, int reg) {
+    emit(assembler, 0x48);
+    emit(assembler, opcode);
+    emit(assembler, 0xC0 | reg << 3);
+}
+
+// A conditional jump to be patched, at the offset this returns, once its target is known.
+static int emitJump(Assembler *assembler, int condition) {
+    emit(assembler, 0x0F);
+    emit(assembler, 0x80 | condition);
+    emit32(assembler, 0);
+    return assembler->count - 4;
+}
+
+static void patchJump(Assembler *assembler, int patch, int target) {
+    uint32_t distance = (uint32_t) (target - (patch + 4));
+    memcpy(&assembler->code[patch], &distance, 4);
+}
+
+static void emitJumpTo(Assembler *assembler, int condition, int target) {
+    patchJump(assembler, emitJump(assembler, condition), target);
+}
+
+static void emitLoopTo(Assembler *assembler, int target) {
+    emit(assembler, 0xE9);
+    emit32(assembler, (uint32_t) (target - (assembler->count + 4)));
+}
+
+#define MOVSD_LOAD 0x10
+#define MOVSD_STORE 0x11
+#define UCOMISD 0x2E
+#define MOVAPD 0x28
+#define XORPD 0x57
+#define ADDSD 0x58
+#define MULSD 0x59
+#define SUBSD 0x5C
+#define DIVSD 0x5E
+
+// Compiling keeps the trace's stack in registers too, or as constants and
+// comparisons that only exist at compile time.
+
+typedef enum {
+    VALUE_NUMBER,    // in its register
+    VALUE_BOOLEAN,   // true or false, boxed, in its register
+    VALUE_CONSTANT,  // nil, true or false
+    VALUE_CONDITION, // ucomisd left, right has not been emitted yet
+} TraceValueKind;
+
+typedef struct {
+    TraceValueKind kind;
+    Value constant;
+    int condition; // what has to hold after ucomisd for the comparison to be true
+    int left;
+    int right;
+} TraceValue;
+
+typedef struct {
+    int patches[2];
+    int patchCount;
+    uint8_t *resume;
+    int depth;
+    TraceValue stack[MAX_DEPTH];
+} PendingExit;
+
+typedef struct {
+    Recording *recording;
+    Assembler assembler;
+    TraceValue stack[MAX_DEPTH];
+    int depth;
+    PendingExit *exits;
+    int exitCount;
+    int exitCapacity;
+} TraceCompiler;
+
+static int slotRegister(int slot) {
+    return slot;
+}
+
+static int stackRegister(TraceCompiler *compiler, int position) {
+    return compiler->recording->slotCount + position;
+}
+
+static int slotBase(TraceSlot *slot) {
+    return slot->global ? RSI : RDI;
+}
+
+static int32_t slotDisplacement(TraceSlot *slot) {
+    return (int32_t) (slot->index * sizeof(Value));
+}
+
+static TraceValue conditionValue(int condition, int left, int right) {
+    return (TraceValue) {.kind = VALUE_CONDITION, .condition = condition, .left = left, .right = right};
+}
+
+static bool inRegister(TraceValue *value) {
+    return value->kind == VALUE_NUMBER || value->kind == VALUE_BOOLEAN;
+}
+
+static int negate(int condition) {
+    switch (condition) {
+        case CC_ABOVE: return CC_BELOW_EQUAL;
+        case CC_BELOW_EQUAL: return CC_ABOVE;
+        case CC_EQUAL: return CC_NOT_EQUAL;
+        default: return CC_EQUAL;
+    }
+}
+
+// Jumps when condition holds, with equality after a ucomisd meaning equal and
+// ordered, since NaN is not equal to anything. Returns how many jumps it took.
+static int emitJumpsWhen(Assembler *assembler, int condition, bool compared, int *patches) {
+    if (compared && condition == CC_EQUAL) {
+        emit(assembler, 0x0F);
+        emit(assembler, 0x80 | CC_NOT_EQUAL);
+        emit32(assembler, 6); // over the jump below
+        patches[0] = emitJump(assembler, CC_NOT_PARITY);
+        return 1;
+    }
+    if (compared && condition == CC_NOT_EQUAL) {
+        patches[0] = emitJump(assembler, CC_NOT_EQUAL);
+        patches[1] = emitJump(assembler, CC_PARITY);
+        return 2;
+    }
+    patches[0] = emitJump(assembler, condition);
+    return 1;
+}
+
+// Leaves the trace when condition holds, at resume with the trace's stack as
+// it is now, except for its top.
+static void emitExit(TraceCompiler *compiler, int condition, bool compared, uint8_t *resume, TraceValue top) {
+    if (compiler->exitCount == compiler->exitCapacity) {
+        compiler->exitCapacity = compiler->exitCapacity < 8 ? 8 : compiler->exitCapacity * 2;
+        compiler->exits = realloc(compiler->exits, sizeof(PendingExit) * compiler->exitCapacity);
+        if (compiler->exits == NULL) exit(1);
+    }
+    PendingExit *pending = &compiler->exits[compiler->exitCount++];
+    pending->patchCount = emitJumpsWhen(&compiler->assembler, condition, compared, pending->patches);
+    pending->resume = resume;
+    pending->depth = compiler->depth;
+    memcpy(pending->stack, compiler->stack, sizeof(TraceValue) * compiler->depth);
+    pending->stack[compiler->depth - 1] = top;
+}
+
+// Boxes the comparison on top of the trace's stack into true or false, for
+// when it is used as a value instead of by a jump.
+static void emitBoolean(TraceCompiler *compiler) {
+    Assembler *assembler = &compiler->assembler;
+    TraceValue *top = &compiler->stack[compiler->depth - 1];
+    int patches[2];
+    emitMovImmediate(assembler, RAX, TRUE_VAL);
+    emitSse(assembler, 0x66, UCOMISD, top->left, top->right);
+    int patchCount = emitJumpsWhen(assembler, top->condition, true, patches);
+    emitMovImmediate(assembler, RAX, FALSE_VAL);
+    for (int i = 0; i < patchCount; ++i) {
+        patchJump(assembler, patches[i], assembler->count);
+    }
+    emitMovXmmRax(assembler, stackRegister(compiler, compiler->depth - 1));
+    *top = (TraceValue) {.kind = VALUE_BOOLEAN};
+}
+
+static bool compileOp(TraceCompiler *compiler, TraceOp *traced) {
+    Assembler *assembler = &compiler->assembler;
+    Recording *recording = compiler->recording;
+    TraceValue *stack = compiler->stack;
+    int depth = compiler->depth;
+    OpCode op = traced->op;
+
+    // a comparison is only left in the flags if a jump uses it straight away
+    if (depth > 0 && stack[depth - 1].kind == VALUE_CONDITION &&
+        op != OP_NOT && op != OP_POP && op != OP_JUMP_IF_FALSE && op != OP_JUMP_IF_FALSE_LONG) {
+        emitBoolean(compiler);
+    }
+
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_CONSTANT_LONG:
+            emitMovImmediate(assembler, RAX, vm.chunk->constants.values[traced->operand]);
+            emitMovXmmRax(assembler, stackRegister(compiler, depth));
+            stack[compiler->depth++] = (TraceValue) {.kind = VALUE_NUMBER};
+            return true;
+        case OP_NIL:
+            stack[compiler->depth++] = (TraceValue) {.kind = VALUE_CONSTANT, .constant = NIL_VAL};
+            return true;
+        case OP_TRUE:
+            stack[compiler->depth++] = (TraceValue) {.kind = VALUE_CONSTANT, .constant = TRUE_VAL};
+            return true;
+        case OP_FALSE:
+            stack[compiler->depth++] = (TraceValue) {.kind = VALUE_CONSTANT, .constant = FALSE_VAL};
+            return true;
+        case OP_POP:
+            compiler->depth--;
+            return true;
+
+        case OP_GET_LOCAL:
+        case OP_GET_LOCAL_LONG:
+        case OP_GET_GLOBAL:
+        case OP_GET_GLOBAL_LONG: {
+            bool global = op == OP_GET_GLOBAL || op == OP_GET_GLOBAL_LONG;
+            if (!global && (int) traced->operand >= recording->base) {
+                int position = (int) traced->operand - recording->base;
+                if (inRegister(&stack[position])) {
+                    emitSse(assembler, 0x66, MOVAPD, stackRegister(compiler, depth), stackRegister(compiler, position));
+                }
+                stack[compiler->depth++] = stack[position];
+                return true;
+            }
+            int slot = findSlot(recording, global, traced->operand);
+            emitSse(assembler, 0x66, MOVAPD, stackRegister(compiler, depth), slotRegister(slot));
+            stack[compiler->depth++] = (TraceValue) {.kind = VALUE_NUMBER};
+            return true;
+        }
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_LONG:
+        case OP_SET_LOCAL_POP:
+        case OP_SET_GLOBAL:
+        case OP_SET_GLOBAL_LONG: {
+            bool global = op == OP_SET_GLOBAL || op == OP_SET_GLOBAL_LONG;
+            int top = depth - 1;
+            if (!global && (int) traced->operand >= recording->base) {
+                int position = (int) traced->operand - recording->base;
+                if (inRegister(&stack[top]) && position != top) {
+                    emitSse(assembler, 0x66, MOVAPD, stackRegister(compiler, position), stackRegister(compiler, top));
+                }
+                stack[position] = stack[top];
+            } else {
+                if (stack[top].kind != VALUE_NUMBER) return false;
+                int slot = findSlot(recording, global, traced->operand);
+                emitSse(assembler, 0x66, MOVAPD, slotRegister(slot), stackRegister(compiler, top));
+            }
+            if (op == OP_SET_LOCAL_POP) compiler->depth--;
+            return true;
+        }
+
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+        case OP_GREATER:
+        case OP_GREATER_EQUAL:
+        case OP_LESS:
+        case OP_LESS_EQUAL:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE: {
+            if (stack[depth - 1].kind != VALUE_NUMBER || stack[depth - 2].kind != VALUE_NUMBER) return false;
+            int a = stackRegister(compiler, depth - 2);
+            int b = stackRegister(compiler, depth - 1);
+            TraceValue *result = &stack[depth - 2];
+            compiler->depth--;
+            // LESS compares the other way round, and LESS_EQUAL is not GREATER,
+            // so that comparisons with NaN come out like they do in run()
+            switch (op) {
+                case OP_EQUAL: *result = conditionValue(CC_EQUAL, a, b); return true;
+                case OP_NOT_EQUAL: *result = conditionValue(CC_NOT_EQUAL, a, b); return true;
+                case OP_GREATER: *result = conditionValue(CC_ABOVE, a, b); return true;
+                case OP_GREATER_EQUAL: *result = conditionValue(CC_BELOW_EQUAL, b, a); return true;
+                case OP_LESS: *result = conditionValue(CC_ABOVE, b, a); return true;
+                case OP_LESS_EQUAL: *result = conditionValue(CC_BELOW_EQUAL, a, b); return true;
+                case OP_ADD: emitSse(assembler, 0xF2, ADDSD, a, b); return true;
+                case OP_SUBTRACT: emitSse(assembler, 0xF2, SUBSD, a, b); return true;
+                case OP_MULTIPLY: emitSse(assembler, 0xF2, MULSD, a, b); return true;
+                default: emitSse(assembler, 0xF2, DIVSD, a, b); return true;
+            }
+        }
+        case OP_NEGATE:
+            if (stack[depth - 1].kind != VALUE_NUMBER) return false;
+            emitMovImmediate(assembler, RAX, SIGN_BIT);
+            emitMovXmmRax(assembler, SCRATCH);
+            emitSse(assembler, 0x66, XORPD, stackRegister(compiler, depth - 1), SCRATCH);
+            return true;
+        case OP_NOT: {
+            TraceValue *top = &stack[depth - 1];
+            if (top->kind == VALUE_CONDITION) {
+                top->condition = negate(top->condition);
+            } else if (top->kind == VALUE_BOOLEAN) {
+                emitMovImmediate(assembler, RAX, TRUE_VAL ^ FALSE_VAL);
+                emitMovXmmRax(assembler, SCRATCH);
+                emitSse(assembler, 0x66, XORPD, stackRegister(compiler, depth - 1), SCRATCH);
+            } else {
+                Value value = top->kind == VALUE_NUMBER ? NUMBER_VAL(0) : top->constant;
+                *top = (TraceValue) {.kind = VALUE_CONSTANT, .constant = BOOL_VAL(isFalsy(value))};
+            }
+            return true;
+        }
+
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_FALSE_LONG: {
+            TraceValue *top = &stack[depth - 1];
+            TraceValue other = {.kind = VALUE_CONSTANT, .constant = BOOL_VAL(!traced->truthy)};
+            if (top->kind == VALUE_CONDITION) {
+                emitSse(assembler, 0x66, UCOMISD, top->left, top->right);
+                int leaving = traced->truthy ? negate(top->condition) : top->condition;
+                emitExit(compiler, leaving, true, traced->other, other);
+            } else if (top->kind == VALUE_BOOLEAN) {
+                emitMovRaxXmm(assembler, stackRegister(compiler, depth - 1));
+                emitMovImmediate(assembler, RCX, TRUE_VAL);
+                emitRaxOp(assembler, 0x39, RCX);
+                emitExit(compiler, traced->truthy ? CC_NOT_EQUAL : CC_EQUAL, false, traced->other, other);
+            } else {
+                return true; // goes the same way every time
+            }
+            *top = (TraceValue) {.kind = VALUE_CONSTANT, .constant = BOOL_VAL(traced->truthy)};
+            return true;
+        }
+        case OP_JUMP:
+        case OP_JUMP_LONG:
+        case OP_LOOP:
+        case OP_LOOP_LONG:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Writes back every slot and the trace's stack as it was at the exit, then
+// returns which exit it was.
+static void emitExitStub(TraceCompiler *compiler, PendingExit *pending, int index) {
+    Assembler *assembler = &compiler->assembler;
+    Recording *recording = compiler->recording;
+    for (int i = 0; i < pending->patchCount; ++i) {
+        patchJump(assembler, pending->patches[i], assembler->count);
+    }
+    for (int i = 0; i < recording->slotCount; ++i) {
+        TraceSlot *slot = &recording->slots[i];
+        if (!slot->written) continue;
+        emitSseMemory(assembler, 0xF2, MOVSD_STORE, slotRegister(i), slotBase(slot), slotDisplacement(slot));
+    }
+    for (int position = 0; position < pending->depth; ++position) {
+        TraceValue *entry = &pending->stack[position];
+        int32_t displacement = (int32_t) ((recording->base + position) * sizeof(Value));
+        if (inRegister(entry)) {
+            emitSseMemory(assembler, 0xF2, MOVSD_STORE, stackRegister(compiler, position), RDI, displacement);
+        } else {
+            emitMovImmediate(assembler, RAX, entry->constant);
+            emitMovRaxMemory(assembler, 0x89, RDI, displacement);
+        }
+    }
+    emit(assembler, 0xB8); // mov eax, index + 1
+    emit32(assembler, (uint32_t) index + 1);
+    emit(assembler, 0xC3);
+}
+
+static void emitEntry(TraceCompiler *compiler) {
+    Assembler *assembler = &compiler->assembler;
+    Recording *recording = compiler->recording;
+    // the function starts after this, so that refusing entry can jump back to it
+    emit(assembler, 0x31); // xor eax, eax
+    emit(assembler, 0xC0);
+    emit(assembler, 0xC3);
+
+    emitMovImmediate(assembler, RDX, QNAN);
+    emitMovImmediate(assembler, RCX, UNDEFINED_VAL);
+    for (int i = 0; i < recording->slotCount; ++i) {
+        TraceSlot *slot = &recording->slots[i];
+        if (slot->readFirst) {
+            emitMovRaxMemory(assembler, 0x8B, slotBase(slot), slotDisplacement(slot));
+            emitRaxOp(assembler, 0x21, RDX);
+            emitRaxOp(assembler, 0x39, RDX);
+            emitJumpTo(assembler, CC_EQUAL, 0);
+        } else if (slot->global) {
+            emitMovRaxMemory(assembler, 0x8B, slotBase(slot), slotDisplacement(slot));
+            emitRaxOp(assembler, 0x39, RCX);
+            emitJumpTo(assembler, CC_EQUAL, 0);
+        }
+    }
+    for (int i = 0; i < recording->slotCount; ++i) {
+        TraceSlot *slot = &recording->slots[i];
+        emitSseMemory(assembler, 0xF2, MOVSD_LOAD, slotRegister(i), slotBase(slot), slotDisplacement(slot));
+    }
+}
+
+static Trace *compileTrace(Recording *recording) {
+    if (recording->slotCount + recording->maxDepth > SCRATCH) return NULL;
+    TraceCompiler compiler = {recording, {NULL, 0, 0}, {{0}}, 0, NULL, 0, 0};
+    Assembler *assembler = &compiler.assembler;
+
+    emitEntry(&compiler);
+    int loop = assembler->count;
+    bool compiled = true;
+    for (int i = 0; i < recording->count && compiled; ++i) {
+        compiled = compileOp(&compiler, &recording->ops[i]);
+    }
+    Trace *trace = NULL;
+    if (compiled) {
+        emitLoopTo(assembler, loop);
+        for (int i = 0; i < compiler.exitCount; ++i) {
+            emitExitStub(&compiler, &compiler.exits[i], i);
+        }
+        trace = malloc(sizeof(Trace));
+        if (trace == NULL) exit(1);
+        trace->size = assembler->count;
+        trace->code = mmap(NULL, trace->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (trace->code == MAP_FAILED) {
+            free(trace);
+            trace = NULL;
+        } else {
+            memcpy(trace->code, assembler->code, assembler->count);
+            if (mprotect(trace->code, trace->size, PROT_READ | PROT_EXEC) != 0) {
+                munmap(trace->code, trace->size);
+                free(trace);
+                free(assembler->code);
+                free(compiler.exits);
+                return NULL;
+            }
+            trace->function = (TraceFunction) ((uint8_t *) trace->code + 3);
+            trace->base = recording->base;
+            trace->entryFailures = 0;
+            trace->exitCount = compiler.exitCount;
+            trace->exits = malloc(sizeof(TraceExit) * (compiler.exitCount > 0 ? compiler.exitCount : 1));
+            if (trace->exits == NULL) exit(1);
+            uint8_t *end = recording->ops[recording->count - 1].ip;
+            for (int i = 0; i < compiler.exitCount; ++i) {
+                PendingExit *pending = &compiler.exits[i];
+                bool inLoop = pending->resume >= recording->header && pending->resume <= end;
+                trace->exits[i] = (TraceExit) {pending->resume, recording->base + pending->depth, inLoop, 0};
+            }
+        }
+    }
+    free(assembler->code);
+    free(compiler.exits);
+    return trace;
+}
+
+static void freeTrace(Trace *trace) {
+    munmap(trace->code, trace->size);
+    free(trace->exits);
+    free(trace);
+}
+
+static uint32_t hashHeader(uint8_t *header) {
+    uint64_t hash = (uint64_t) (uintptr_t) header * 0x9E3779B97F4A7C15u;
+    return (uint32_t) (hash >> 32);
+}
+
+static Loop *findLoop(uint8_t *header) {
+    if (jit.count + 1 > jit.capacity * 3 / 4) {
+        Loop *old = jit.loops;
+        int oldCapacity = jit.capacity;
+        jit.capacity = oldCapacity < 16 ? 16 : oldCapacity * 2;
+        jit.loops = calloc(jit.capacity, sizeof(Loop));
+        if (jit.loops == NULL) exit(1);
+        jit.count = 0;
+        for (int i = 0; i < oldCapacity; ++i) {
+            if (old[i].header == NULL) continue;
+            *findLoop(old[i].header) = old[i];
+        }
+        free(old);
+    }
+    uint32_t index = hashHeader(header) & (jit.capacity - 1);
+    for (;;) {
+        Loop *loop = &jit.loops[index];
+        if (loop->header == header) return loop;
+        if (loop->header == NULL) {
+            *loop = (Loop) {header, 0, NULL, 0, false};
+            jit.count++;
+            return loop;
+        }
+        index = (index + 1) & (jit.capacity - 1);
+    }
+}
+
+static Trace *recordTrace(uint8_t *header) {
+    Recording *recording = malloc(sizeof(Recording));
+    if (recording == NULL) exit(1);
+    recording->header = header;
+    recording->base = (int) (vm.stackTop - vm.stack);
+    recording->count = 0;
+    recording->slotCount = 0;
+    recording->maxDepth = 0;
+    Trace *trace = record(recording) ? compileTrace(recording) : NULL;
+    free(recording);
+    return trace;
+}
+
+uint8_t *Jit_backEdge(uint8_t *header) {
+    Loop *loop = findLoop(header);
+    if (loop->trace == NULL) {
+        if (loop->rejected || ++loop->count < HOT_LOOP) return header;
+        loop->trace = recordTrace(header);
+        if (loop->trace == NULL) {
+            loop->rejected = true;
+            jit.stats.rejected++;
+            return header;
+        }
+        jit.stats.compiled++;
+    }
+
+    Trace *trace = loop->trace;
+    if (vm.stackTop - vm.stack != trace->base) return header;
+    int exitIndex = trace->function(vm.stack, vm.globals.values);
+    if (exitIndex == 0) {
+        jit.stats.entryFailures++;
+        if (++trace->entryFailures == MAX_ENTRY_FAILURES) {
+            freeTrace(trace);
+            loop->trace = NULL;
+            loop->rejected = true;
+        }
+        return header;
+    }
+    jit.stats.runs++;
+    TraceExit *left = &trace->exits[exitIndex - 1];
+    vm.stackTop = vm.stack + left->height;
+    uint8_t *resume = left->resume;
+    // a branch that keeps going the other way now gets recorded that way instead
+    if (left->inLoop && ++left->taken == HOT_EXIT && loop->retraces < MAX_RETRACES) {
+        freeTrace(trace);
+        loop->trace = NULL;
+        loop->count = 0;
+        loop->retraces++;
+        jit.stats.retraced++;
+    }
+    return resume;
+}
+
+void Jit_reset() {
+    for (int i = 0; i < jit.capacity; ++i) {
+        if (jit.loops[i].trace != NULL) freeTrace(jit.loops[i].trace);
+    }
+    free(jit.loops);
+    jit.loops = NULL;
+    jit.count = 0;
+    jit.capacity = 0;
+
+    if (compilerOptions.jitStats) {
+        JitStats *stats = &jit.stats;
+        fprintf(stderr, "-- jit stats --\n");
+        fprintf(stderr, "traces compiled: %d\n", stats->compiled);
+        fprintf(stderr, "loops rejected:  %d\n", stats->rejected);
+        fprintf(stderr, "traces redone:   %d\n", stats->retraced);
+        fprintf(stderr, "trace runs:      %llu\n", (unsigned long long) stats->runs);
+        fprintf(stderr, "entries refused: %llu\n", (unsigned long long) stats->entryFailures);
+    }
+    jit.stats = (JitStats) {0};
+}
+
+#endif
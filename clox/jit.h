@@ -0,0 +1,25 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_JIT_H
+#define CLOX_JIT_H
+
+#include "common.h"
+
+// A tracing JIT for x86-64 with NaN boxing, built with CLOX_JIT and turned on
+// with --jit. Back-edges count how often they reach their loop header. Once a
+// header is hot, one iteration from it is recorded as the linear trace of
+// bytecode it runs and the way each branch went, and compiled to native code
+// that keeps the variables it touches in registers. The trace checks once on
+// entry that the variables it reads hold numbers, and leaves as soon as a
+// branch goes the other way, writing everything back for the interpreter.
+
+// Called with the header a back-edge just jumped to. Returns where the
+// interpreter carries on, which is wherever the trace left, if one ran.
+uint8_t *Jit_backEdge(uint8_t *header);
+// Drops every trace, since they point into the chunk that just ran, and
+// reports what the JIT did with --jit-stats.
+void Jit_reset();
+
+#endif //CLOX_JIT_H
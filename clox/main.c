@@ -2,44 +2,70 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "batch.h"
+#include "cache.h"
+#include "compilers.h"
+#include "profiler.h"
+#include "source.h"
 #include "vm.h"
 
-static char *readFile(const char *path) {
-    FILE *file = fopen(path, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "Could not open file \"%s\".\n", path);
-        exit(74);
-    }
+#define PROFILE_PATH "clox-profile.json"
+#define STDIN_PATH "-"
 
-    fseek(file, 0L, SEEK_END);
-    size_t fileSize = ftell(file);
-    rewind(file);
+static bool useCache = true;
 
-    char *buffer = malloc(fileSize + 1);
-    if (buffer == NULL) {
-        fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
-        exit(74);
-    }
-    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-    if (bytesRead < fileSize) {
-        fprintf(stderr, "Could not read file \"%s\".", path);
+// Maps path, or reads stdin when it is "-".
+static void loadFile(const char *path, SourceFile *file) {
+    bool loaded = strcmp(path, STDIN_PATH) == 0
+                  ? SourceFile_stream(stdin, file)
+                  : SourceFile_load(path, file);
+    if (!loaded) {
+        fprintf(stderr, "Could not read file \"%s\".\n", path);
         exit(74);
     }
-    buffer[bytesRead] = '\0';
-
-    fclose(file);
-    return buffer;
 }
 
 static void runFile(const char *path) {
-    char *source = readFile(path);
-    InterpretResult result = VM_interpret(source);
-    free(source);
+    SourceFile file;
+    loadFile(path, &file);
+    InterpretResult result;
+    // stdin has no path to cache next to
+    if (useCache && strcmp(path, STDIN_PATH) != 0) {
+        char *cachePath = Cache_pathFor(path);
+        result = VM_interpretCached(file.chars, file.length, cachePath);
+        free(cachePath);
+    } else {
+        result = VM_interpret(file.chars, file.length);
+    }
+    SourceFile_unload(&file);
 
     if (result == INTERPRET_COMPILE_ERROR) exit(65);
     if (result == INTERPRET_RUNTIME_ERROR) exit(70);
 }
 
+// Only writes the cache, so that the first run doesn't have to.
+static void compileFile(const char *path) {
+    SourceFile file;
+    loadFile(path, &file);
+    char *cachePath = Cache_pathFor(path);
+    Chunk chunk;
+    Chunk_init(&chunk);
+
+    bool compiled = compile(file.chars, file.length, &chunk);
+    bool written = compiled && Cache_write(cachePath, file.chars, file.length, &chunk);
+    if (compiled && !written) {
+        fprintf(stderr, "Could not write \"%s\".\n", cachePath);
+    }
+
+    Chunk_free(&chunk);
+    free(cachePath);
+    SourceFile_unload(&file);
+    if (!compiled) exit(65);
+    if (!written) exit(74);
+}
+
 static void repl() {
     char line[1024];
     for (;;) {
@@ -49,23 +75,130 @@ static void repl() {
             break;
         }
 
-        VM_interpret(line);
+        VM_interpret(line, strlen(line));
     }
 }
 
+static void usage() {
+    fprintf(stderr, "Usage: clox [--no-fold] [--no-peephole] [--peephole-stats] [--register-vm] [--no-cache] [--compile]\n"
+                    "            [--profile-ops] [--profile-cycles] [--jit] [--jit-stats] [--baseline]\n"
+                    "            [path | -]\n"
+                    "       clox [options] [--jobs N] [--manifest list] [path...]\n");
+    exit(64);
+}
+
+#ifdef PROFILE_OPS
+// Registered with atexit, since runFile exits directly when the script fails.
+static void reportProfile() {
+    Profiler_report(PROFILE_PATH);
+}
+#endif
+
+static void startProfile(bool timed) {
+#ifdef PROFILE_OPS
+    atexit(reportProfile);
+    Profiler_start(timed);
+#else
+    (void) timed;
+    fprintf(stderr, "clox was built without CLOX_PROFILE_OPS.\n");
+    exit(64);
+#endif
+}
+
+static void requireJit() {
+#ifndef JIT
+    fprintf(stderr, "clox was built without CLOX_JIT.\n");
+    exit(64);
+#endif
+}
+
+static void requireBaseline() {
+#ifndef BASELINE
+    fprintf(stderr, "clox was built without CLOX_BASELINE.\n");
+    exit(64);
+#endif
+}
+
 int main(int argc, const char *argv[]) {
+    Batch batch;
+    Batch_init(&batch);
+    bool batchMode = false;
+    int jobs = 0;
+    bool compileOnly = false;
+    bool profile = false;
+    bool profileCycles = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--no-fold") == 0) {
+            compilerOptions.fold = false;
+        } else if (strcmp(argv[i], "--no-peephole") == 0) {
+            compilerOptions.peephole = false;
+        } else if (strcmp(argv[i], "--peephole-stats") == 0) {
+            compilerOptions.peepholeStats = true;
+        } else if (strcmp(argv[i], "--register-vm") == 0) {
+            compilerOptions.registerVM = true;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            useCache = false;
+        } else if (strcmp(argv[i], "--compile") == 0) {
+            compileOnly = true;
+        } else if (strcmp(argv[i], "--profile-ops") == 0) {
+            profile = true;
+        } else if (strcmp(argv[i], "--profile-cycles") == 0) {
+            profile = true;
+            profileCycles = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            requireJit();
+            compilerOptions.jit = true;
+        } else if (strcmp(argv[i], "--jit-stats") == 0) {
+            requireJit();
+            compilerOptions.jitStats = true;
+        } else if (strcmp(argv[i], "--baseline") == 0) {
+            requireBaseline();
+            compilerOptions.baseline = true;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) usage();
+            batchMode = true;
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            if (!Batch_addManifest(&batch, argv[++i])) {
+                fprintf(stderr, "Could not read manifest \"%s\".\n", argv[i]);
+                exit(74);
+            }
+            batchMode = true;
+        } else if (argv[i][0] != '-' || strcmp(argv[i], STDIN_PATH) == 0) {
+            Batch_add(&batch, argv[i]);
+        } else {
+            usage();
+        }
+    }
+
+    // more than one script, or asking for a batch, runs them all on a thread pool
+    if (batchMode || batch.count > 1) {
+        // each script's profile would be on its own thread, and only one of them could read stdin
+        if (compileOnly || profile || batch.count == 0) usage();
+        for (int i = 0; i < batch.count; ++i) {
+            if (strcmp(batch.scripts[i].path, STDIN_PATH) == 0) usage();
+        }
+        if (jobs == 0) jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        int status = Batch_run(&batch, jobs, useCache);
+        Batch_free(&batch);
+        return status;
+    }
+    const char *path = batch.count == 1 ? batch.scripts[0].path : NULL;
+    if (profile) startProfile(profileCycles);
+
     VM_init();
 
-    if (argc == 1) {
+    if (compileOnly) {
+        if (path == NULL || strcmp(path, STDIN_PATH) == 0) usage();
+        compileFile(path);
+    } else if (path == NULL) {
         repl();
-    } else if (argc == 2) {
-        runFile(argv[1]);
     } else {
-        fprintf(stderr, "Usage: clox [path]\\n");
-        exit(64);
+        runFile(path);
     }
 
 
      VM_free();
+    Batch_free(&batch);
     return 0;
 }
\ No newline at end of file
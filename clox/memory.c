@@ -3,14 +3,75 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
 #include "memory.h"
 #include "value.h"
 #include "object.h"
+#include "compilers.h"
 #include "vm.h"
 
+#ifdef POOL_ALLOCATOR
+#include "pool.h"
+#endif
+
+#ifdef DEBUG_LOG_GC
+#include <stdio.h>
+#endif
+
+// the next collection runs when the heap has grown to this many times what survived the last one
+#define GC_HEAP_GROW_FACTOR 2
+#define GC_MIN_HEAP (1024 * 1024)
+
 static void freeObject(Obj *object);
 
-void *reallocate(void *pointer, size_t oldSize, size_t newSize) {
+#ifdef VM_COUNT_ALLOCATIONS
+#define COUNT_ALLOCATION(oldSize, newSize) \
+    do { \
+        if ((newSize) > (oldSize)) { \
+            vm.allocationCount++; \
+            vm.allocatedBytes += (newSize) - (oldSize); \
+        } \
+    } while (false)
+#else
+#define COUNT_ALLOCATION(oldSize, newSize) ((void)0)
+#endif
+
+#ifdef POOL_ALLOCATOR
+// Relies on every caller passing the size it originally asked for as oldSize,
+// which is what tells us whether a block came from a pool or from malloc.
+static void *poolReallocate(void *pointer, size_t oldSize, size_t newSize) {
+    bool oldPooled = pointer != NULL && oldSize <= POOL_MAX_SIZE;
+    bool newPooled = newSize <= POOL_MAX_SIZE;
+
+    if (newSize == 0) {
+        if (oldPooled) Pool_free(pointer, oldSize);
+        else free(pointer);
+        return NULL;
+    }
+    if (!oldPooled && !newPooled) {
+        void *result = realloc(pointer, newSize);
+        if (result == NULL) exit(1);
+        return result;
+    }
+    if (oldPooled && newPooled && POOL_CLASS(oldSize) == POOL_CLASS(newSize)) {
+        return pointer;
+    }
+
+    void *result = newPooled ? Pool_alloc(newSize) : malloc(newSize);
+    if (result == NULL) exit(1);
+    if (pointer != NULL) {
+        memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+        if (oldPooled) Pool_free(pointer, oldSize);
+        else free(pointer);
+    }
+    return result;
+}
+#endif
+
+static void *resize(void *pointer, size_t oldSize, size_t newSize) {
+#ifdef POOL_ALLOCATOR
+    return poolReallocate(pointer, oldSize, newSize);
+#else
     if (newSize == 0) {
         free(pointer);
         return NULL;
@@ -19,6 +80,170 @@ void *reallocate(void *pointer, size_t oldSize, size_t newSize) {
     void *result = realloc(pointer, newSize);
     if (result == NULL) exit(1);
     return result;
+#endif
+}
+
+void *reallocate(void *pointer, size_t oldSize, size_t newSize) {
+    COUNT_ALLOCATION(oldSize, newSize);
+    vm.bytesAllocated += newSize - oldSize;
+    if (newSize > oldSize) {
+#ifdef DEBUG_STRESS_GC
+        collectGarbage();
+#endif
+        if (vm.bytesAllocated > vm.nextGC) {
+            collectGarbage();
+        }
+    }
+    return resize(pointer, oldSize, newSize);
+}
+
+void *reallocateUncollected(void *pointer, size_t oldSize, size_t newSize) {
+    COUNT_ALLOCATION(oldSize, newSize);
+    vm.bytesAllocated += newSize - oldSize;
+    return resize(pointer, oldSize, newSize);
+}
+
+void *reallocateScoped(void *pointer, size_t oldSize, size_t newSize) {
+#ifdef REGION_ALLOCATION
+    // Only new memory depends on whether the region is active. What it handed
+    // out stays its own, like the chunk that is freed after the script ran.
+    if (pointer != NULL ? Region_owns(&vm.region, pointer) : vm.regionActive) {
+        COUNT_ALLOCATION(oldSize, newSize);
+        return Region_reallocate(&vm.region, pointer, oldSize, newSize);
+    }
+#endif
+    return reallocate(pointer, oldSize, newSize);
+}
+
+void markObject(Obj *object) {
+    if (object == NULL) return;
+    if (object->isMarked) return;
+
+#ifdef DEBUG_LOG_GC
+    fprintf(stderr, "%p mark ", (void*)object);
+    Value_print(stderr, OBJ_VAL(object));
+    fprintf(stderr, "\n");
+#endif
+
+    object->isMarked = true;
+
+    if (vm.grayCapacity < vm.grayCount + 1) {
+        vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
+        // the gray stack is GC bookkeeping, so it must not go through reallocate()
+        vm.grayStack = (Obj**)realloc(vm.grayStack, sizeof(Obj*) * vm.grayCapacity);
+        if (vm.grayStack == NULL) exit(1);
+    }
+    vm.grayStack[vm.grayCount++] = object;
+}
+
+void markValue(Value value) {
+    if (IS_OBJ(value)) markObject(AS_OBJ(value));
+}
+
+static void blackenObject(Obj *object) {
+#ifdef DEBUG_LOG_GC
+    fprintf(stderr, "%p blacken ", (void*)object);
+    Value_print(stderr, OBJ_VAL(object));
+    fprintf(stderr, "\n");
+#endif
+
+    switch (object->type) {
+        case OBJ_STRING:
+            break; // strings reference nothing
+        case OBJ_ROPE: {
+            ObjRope *rope = (ObjRope *) object;
+            markValue(rope->left);
+            markValue(rope->right);
+            markObject((Obj *) rope->flat);
+            break;
+        }
+    }
+}
+
+static void markRoots() {
+    for (Value *slot = vm.stack; slot < vm.stackTop; slot++) {
+        markValue(*slot);
+    }
+    Table_mark(&vm.globals.slots);
+    for (int i = 0; i < vm.globals.count; ++i) {
+        markObject((Obj *) vm.globals.names[i]);
+        markValue(vm.globals.values[i]);
+    }
+    if (vm.chunk != NULL) {
+        for (int i = 0; i < vm.chunk->constants.count; ++i) {
+            markValue(vm.chunk->constants.values[i]);
+        }
+    }
+    for (VMProgram *program = vm.programs; program != NULL; program = program->next) {
+        for (int i = 0; i < program->chunk.constants.count; ++i) {
+            markValue(program->chunk.constants.values[i]);
+        }
+    }
+    markCompilerRoots();
+#ifdef REGION_ALLOCATION
+    // Region objects stay marked, so nothing would trace through them, but a
+    // rope in the region can be made of heap strings that nothing else holds.
+    for (Obj *object = vm.regionObjects; object != NULL; object = object->next) {
+        blackenObject(object);
+    }
+#endif
+}
+
+static void traceReferences() {
+    while (vm.grayCount > 0) {
+        Obj *object = vm.grayStack[--vm.grayCount];
+        blackenObject(object);
+    }
+}
+
+static void sweep() {
+    Obj *previous = NULL;
+    Obj *object = vm.objects;
+    while (object != NULL) {
+        if (object->isMarked) {
+            object->isMarked = false;
+            previous = object;
+            object = object->next;
+        } else {
+            Obj *unreached = object;
+            object = object->next;
+            if (previous != NULL) {
+                previous->next = object;
+            } else {
+                vm.objects = object;
+            }
+            freeObject(unreached);
+        }
+    }
+}
+
+void collectGarbage() {
+    double start = VM_now();
+    size_t before = vm.bytesAllocated;
+#ifdef DEBUG_LOG_GC
+    fprintf(stderr, "-- gc begin\n");
+#endif
+
+    markRoots();
+    traceReferences();
+    Table_removeWhite(&vm.strings); // interned strings are weak references
+    sweep();
+
+    vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+    if (vm.nextGC < GC_MIN_HEAP) vm.nextGC = GC_MIN_HEAP;
+
+    double pause = VM_now() - start;
+    GCStats *stats = &vm.gcStats;
+    stats->collections++;
+    stats->bytesCollected += before - vm.bytesAllocated;
+    stats->totalPause += pause;
+    if (pause > stats->maxPause) stats->maxPause = pause;
+
+#ifdef DEBUG_LOG_GC
+    fprintf(stderr, "-- gc end\n");
+    fprintf(stderr, "   collected %zu bytes (from %zu to %zu) next at %zu\n",
+            before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
+#endif
 }
 
 void freeObjects() {
@@ -28,15 +253,32 @@ void freeObjects() {
         freeObject(object);
         object = next;
     }
+    vm.objects = NULL;
+
+    free(vm.grayStack);
+    vm.grayStack = NULL;
+    vm.grayCapacity = 0;
+}
+
+void freeHeap() {
+#ifdef POOL_ALLOCATOR
+    Pool_freeAll();
+#endif
 }
 
 static void freeObject(Obj *object) {
+#ifdef DEBUG_LOG_GC
+    fprintf(stderr, "%p free type %d\n", (void*)object, object->type);
+#endif
+
     switch (object->type) {
         case OBJ_STRING: {
             ObjString* string = (ObjString*)object;
-            FREE_ARRAY(char, string->chars, string->length + 1);
-            FREE(ObjString, object);
+            reallocate(object, sizeof(ObjString) + string->length + 1, 0); // the characters included
             break;
         }
+        case OBJ_ROPE:
+            FREE(ObjRope, object);
+            break;
     }
 }
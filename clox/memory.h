@@ -6,6 +6,7 @@
 #define clox_memory_h
 
 #include "common.h"
+#include "value.h"
 
 #define ALLOCATE(type, count) \
     (type*)reallocate(NULL, 0, sizeof(type) * (count))
@@ -23,7 +24,28 @@
 #define FREE_ARRAY(type, pointer, oldCount) \
     reallocate(pointer, sizeof(type) * (oldCount), 0)
 
+// Scoped allocations only have to live as long as the current VM_interpret call,
+// unless they are promoted. With region allocation on they are bump-allocated
+// and released in bulk, otherwise they behave exactly like the macros above.
+#define ALLOCATE_SCOPED(type, count) \
+    (type*)reallocateScoped(NULL, 0, sizeof(type) * (count))
+
+#define GROW_SCOPED_ARRAY(type, pointer, oldCount, newCount) \
+    (type*)reallocateScoped(pointer, sizeof(type) * (oldCount), \
+        sizeof(type) * (newCount))
+
+#define FREE_SCOPED_ARRAY(type, pointer, oldCount) \
+    reallocateScoped(pointer, sizeof(type) * (oldCount), 0)
+
 void *reallocate(void *pointer, size_t oldSize, size_t newSize);
+void *reallocateScoped(void *pointer, size_t oldSize, size_t newSize);
+// Like reallocate, but never collects, for memory that grows while something
+// on its way into it is not reachable yet.
+void *reallocateUncollected(void *pointer, size_t oldSize, size_t newSize);
+void markObject(Obj *object);
+void markValue(Value value);
+void collectGarbage();
 void freeObjects();
+void freeHeap();
 
 #endif
\ No newline at end of file
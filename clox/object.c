@@ -3,6 +3,7 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "object.h"
@@ -14,58 +15,232 @@
     (type *)allocateObject(sizeof(type), objectType)
 
 static Obj *allocateObject(size_t size, ObjType type);
-static ObjString *allocateString(char *chars, int length, uint32_t hash);
+static ObjString *allocateString(int length);
+static ObjString *internString(ObjString *string, uint32_t hash);
 static uint32_t hashString(const char* key, int length);
+static uint32_t continueHash(uint32_t hash, const char *key, int length);
 
+// Shorter results are copied right away, which is cheap and keeps them interned.
+#define ROPE_MIN_LENGTH 64
 
-void Obj_print(Value value) {
+static void ropeChars(ObjRope *rope, char *chars);
+
+void Obj_print(FILE *out, Value value) {
     switch (OBJ_TYPE(value)) {
         case OBJ_STRING:
-            printf("%s", AS_CSTRING(value));
+            fprintf(out, "%s", AS_CSTRING(value));
+            break;
+        case OBJ_ROPE: {
+            // Printing must not allocate through the VM, since the GC log
+            // prints objects in the middle of a collection.
+            ObjRope *rope = AS_ROPE(value);
+            if (rope->flat != NULL) {
+                fprintf(out, "%s", rope->flat->chars);
+                break;
+            }
+            char *chars = malloc(rope->length);
+            if (chars == NULL) exit(1);
+            ropeChars(rope, chars);
+            fwrite(chars, 1, rope->length, out);
+            free(chars);
             break;
+        }
     }
 }
 
-ObjString *ObjString_takeFrom(char *chars, int length) {
+ObjString *ObjString_copyFrom(const char *chars, int length) {
     uint32_t hash = hashString(chars, length);
     ObjString *interned = Table_findString(&vm.strings, chars, length, hash);
-    if (interned != NULL) {
-        FREE_ARRAY(char, chars, length + 1);
-        return interned;
+    if (interned != NULL) return interned;
+
+    ObjString *string = allocateString(length);
+    memcpy(string->chars, chars, length);
+    return internString(string, hash);
+}
+
+Value ObjString_valueFrom(const char *chars, int length) {
+    if (ShortString_fits(chars, length)) return ShortString_make(chars, length);
+    return OBJ_VAL(ObjString_copyFrom(chars, length));
+}
+
+const char *ObjString_charsOf(Value value, char *buffer, int *length) {
+    if (IS_SHORT_STRING(value)) {
+        *length = ShortString_read(value, buffer);
+        return buffer;
     }
-    return allocateString(chars, length, hash);
+    *length = AS_STRING(value)->length;
+    return AS_CSTRING(value);
 }
 
-ObjString *ObjString_copyFrom(const char *chars, int length) {
-    uint32_t hash = hashString(chars, length);
-    ObjString *interned = Table_findString(&vm.strings, chars, length, hash);
-    if (interned != NULL) return interned;
+Value ObjString_concatenate(Value a, Value b) {
+    char aBuffer[SHORT_STRING_MAX];
+    char bBuffer[SHORT_STRING_MAX];
+    int aLength;
+    int bLength;
+    const char *aChars = ObjString_charsOf(a, aBuffer, &aLength);
+    const char *bChars = ObjString_charsOf(b, bBuffer, &bLength);
+    int length = aLength + bLength;
+
+    if (length <= SHORT_STRING_MAX) {
+        char chars[SHORT_STRING_MAX];
+        memcpy(chars, aChars, aLength);
+        memcpy(chars + aLength, bChars, bLength);
+        return ObjString_valueFrom(chars, length);
+    }
+
+    // The hash carries on from the left operand's, so the result can be
+    // looked up before anything is allocated for it.
+    uint32_t aHash = IS_SHORT_STRING(a) ? hashString(aChars, aLength) : AS_STRING(a)->hash;
+    uint32_t hash = continueHash(aHash, bChars, bLength);
+    ObjString *interned = Table_findConcatenation(&vm.strings, aChars, aLength, bChars, bLength, hash);
+    if (interned != NULL) return OBJ_VAL(interned);
+
+    ObjString *string = allocateString(length);
+    memcpy(string->chars, aChars, aLength);
+    memcpy(string->chars + aLength, bChars, bLength);
+    return OBJ_VAL(internString(string, hash));
+}
+
+// A flat rope is replaced by its string, so that ropes never chain through them.
+static Value ropePart(Value value) {
+    if (IS_ROPE(value) && AS_ROPE(value)->flat != NULL) return OBJ_VAL(AS_ROPE(value)->flat);
+    return value;
+}
+
+static int partLength(Value part) {
+    if (IS_SHORT_STRING(part)) {
+        char chars[SHORT_STRING_MAX];
+        return ShortString_read(part, chars);
+    }
+    return IS_STRING(part) ? AS_STRING(part)->length : AS_ROPE(part)->length;
+}
+
+Value ObjRope_concatenate(Value a, Value b) {
+    Value left = ropePart(a);
+    Value right = ropePart(b);
+    int length = partLength(left) + partLength(right);
+#ifdef ROPES
+    if (length >= ROPE_MIN_LENGTH) {
+        ObjRope *rope = ALLOCATE_OBJ(ObjRope, OBJ_ROPE);
+        rope->length = length;
+        rope->left = left;
+        rope->right = right;
+        rope->flat = NULL;
+        return OBJ_VAL(rope);
+    }
+#endif
+    // without ropes there are none to flatten, and a short result never has one for an operand
+    (void) length;
+    return ObjString_concatenate(left, right);
+}
+
+// Writes the characters of a rope that isn't flat yet, from the back, using
+// a stack of parts instead of recursion since a rope built in a loop is as
+// deep as the loop is long. The stack comes from malloc, which never collects.
+static void ropeChars(ObjRope *rope, char *chars) {
+    int capacity = 8;
+    int count = 0;
+    Value *parts = malloc(sizeof(Value) * capacity);
+    if (parts == NULL) exit(1);
+    parts[count++] = OBJ_VAL(rope);
+
+    int end = rope->length;
+    while (count > 0) {
+        Value part = ropePart(parts[--count]);
+        if (IS_FLAT_STRING(part)) {
+            char buffer[SHORT_STRING_MAX];
+            int length;
+            const char *partChars = ObjString_charsOf(part, buffer, &length);
+            end -= length;
+            memcpy(chars + end, partChars, length);
+            continue;
+        }
+
+        if (count + 2 > capacity) {
+            capacity *= 2;
+            parts = realloc(parts, sizeof(Value) * capacity);
+            if (parts == NULL) exit(1);
+        }
+        parts[count++] = AS_ROPE(part)->left;
+        parts[count++] = AS_ROPE(part)->right; // popped first, since it goes last
+    }
+    free(parts);
+}
+
+ObjString *ObjRope_flatten(ObjRope *rope) {
+    if (rope->flat != NULL) return rope->flat;
 
-    char *heapChars = ALLOCATE(char, length + 1); // +1 to include NULL char
-    memcpy(heapChars, chars, length);
-    heapChars[length] = '\0';
-    return allocateString(heapChars, length, hash);
+    // Put together in place, since looking it up takes its characters. When
+    // an equal string is interned already, this one is left to the collector.
+    ObjString *string = allocateString(rope->length);
+    ropeChars(rope, string->chars);
+    uint32_t hash = hashString(string->chars, string->length);
+    ObjString *interned = Table_findString(&vm.strings, string->chars, string->length, hash);
+    rope->flat = interned != NULL ? interned : internString(string, hash);
+    // the parts are garbage now, unless something else holds on to them
+    rope->left = NIL_VAL;
+    rope->right = NIL_VAL;
+    return rope->flat;
 }
 
-static ObjString *allocateString(char *chars, int length, uint32_t hash) {
-    ObjString *string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+bool ObjRope_equal(Value a, Value b) {
+    if (!IS_ANY_STRING(a) || !IS_ANY_STRING(b)) return false;
+    // the flat strings stay reachable through their ropes
+    if (IS_ROPE(a)) a = OBJ_VAL(ObjRope_flatten(AS_ROPE(a)));
+    if (IS_ROPE(b)) b = OBJ_VAL(ObjRope_flatten(AS_ROPE(b)));
+    return Value_equal(a, b);
+}
+
+// Not interned yet: the caller fills in the characters first.
+static ObjString *allocateString(int length) {
+    ObjString *string = (ObjString *) allocateObject(sizeof(ObjString) + length + 1, OBJ_STRING);
     string->length = length;
-    string->chars = chars;
+    string->chars[length] = '\0';
+    return string;
+}
+
+static ObjString *internString(ObjString *string, uint32_t hash) {
     string->hash = hash;
+    VM_push(OBJ_VAL(string)); // growing the table might collect the string
     Table_set(&vm.strings, string, NIL_VAL);
+    VM_pop();
     return string;
 }
 
 static Obj *allocateObject(size_t size, ObjType type) {
+#ifdef REGION_ALLOCATION
+    if (vm.regionActive) {
+        // Region objects are released with the region, so the collector must
+        // never free them. Keeping them marked makes it skip them entirely.
+        Obj *object = (Obj *) Region_alloc(&vm.region, size);
+        object->type = type;
+        object->isMarked = true;
+        object->isScoped = true;
+        object->next = vm.regionObjects;
+        vm.regionObjects = object;
+        return object;
+    }
+#endif
+
     Obj *object = (Obj *)reallocate(NULL, 0, size);
     object->type = type;
+    object->isMarked = false;
+    object->isScoped = false;
     object->next = vm.objects;
     vm.objects = object;
+
+#ifdef DEBUG_LOG_GC
+    fprintf(stderr, "%p allocate %zu for %d\n", (void*)object, size, type);
+#endif
     return object;
 }
 
 static uint32_t hashString(const char* key, int length) {
-    uint32_t hash = 2166136261u;
+    return continueHash(2166136261u, key, length);
+}
+
+// FNV-1a over the characters, starting from the hash of those before them.
+static uint32_t continueHash(uint32_t hash, const char *key, int length) {
     for (int i = 0; i < length; i++) {
         hash ^= (uint8_t)key[i];
         hash *= 16777619;
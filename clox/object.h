@@ -10,28 +10,63 @@
 
 #define OBJ_TYPE(value)        (AS_OBJ(value)->type)
 #define IS_STRING(value)       isObjType(value, OBJ_STRING)
+#define IS_ROPE(value)         isObjType(value, OBJ_ROPE)
+// A string whose characters are in one place: in an ObjString or in the value itself.
+#define IS_FLAT_STRING(value)  (IS_SHORT_STRING(value) || IS_STRING(value))
+#define IS_ANY_STRING(value)   (IS_FLAT_STRING(value) || IS_ROPE(value))
 #define AS_STRING(value)       ((ObjString*)AS_OBJ(value))
+#define AS_ROPE(value)         ((ObjRope*)AS_OBJ(value))
 #define AS_CSTRING(value)      (((ObjString*)AS_OBJ(value))->chars)
 
 typedef enum {
     OBJ_STRING,
+    OBJ_ROPE,
 } ObjType;
 
 struct Obj {
     ObjType type;
+    bool isMarked;
+    bool isScoped; // lives in the request region, see REGION_ALLOCATION
     struct Obj* next;
 };
 
+// The characters follow the header in the same allocation, NUL-terminated.
 struct ObjString {
     Obj obj;
     int length;
-    char *chars;
     uint32_t hash;
+    char chars[];
 };
 
-void Obj_print(Value value);
-ObjString *ObjString_takeFrom(char *chars, int length);
+// The concatenation of two strings, made without copying either, see ROPES.
+// Its characters are only put together, hashed and interned when something
+// needs the string itself, like comparing it. That makes it flat: from then on
+// it only stands for the resulting ObjString.
+typedef struct {
+    Obj obj;
+    int length;
+    Value left;      // a flat string or another rope, nil once flat
+    Value right;
+    ObjString *flat; // NULL until flattened
+} ObjRope;
+
+void Obj_print(FILE *out, Value value);
+// Interns a copy of the characters as an ObjString, however short, for use as a table key.
 ObjString* ObjString_copyFrom(const char *chars, int length);
+// A string value with a copy of the characters, short when they fit.
+Value ObjString_valueFrom(const char *chars, int length);
+// The characters of a flat string. Those of a short string are copied to
+// buffer, which has room for SHORT_STRING_MAX, and are not NUL-terminated.
+const char *ObjString_charsOf(Value value, char *buffer, int *length);
+// Concatenates two flat strings into one. Both must be reachable for the GC meanwhile.
+Value ObjString_concatenate(Value a, Value b);
+// Concatenates two strings or ropes into a rope, or into a string when ropes
+// are off or the result is short. Both must be reachable for the GC meanwhile.
+Value ObjRope_concatenate(Value a, Value b);
+// The rope must be reachable for the GC while it is flattened.
+ObjString *ObjRope_flatten(ObjRope *rope);
+// Whether two values are equal, where at least one of them is a rope.
+bool ObjRope_equal(Value a, Value b);
 
 static inline bool isObjType(Value value, ObjType type) {
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
@@ -0,0 +1,255 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#include "optimizer.h"
+#include "memory.h"
+
+// The chunk is decoded into one Instruction per opcode, rewritten there, and
+// encoded back. Jumps point at the instruction they land on rather than at an
+// offset, so instructions can be removed without breaking them, and each jump
+// gets the narrowest form that still reaches once the final layout is known.
+typedef struct {
+    OpCode op;
+    int operand; // constant, global or local index, or the target instruction of a jump
+    int line;
+    bool removed;
+    bool isTarget; // something jumps here, so it must not be fused into the instruction before it
+} Instruction;
+
+typedef struct {
+    Instruction *instructions;
+    int count;
+    int capacity;
+} Program;
+
+// Jumps are decoded into their short opcode; the width is chosen again on the way out.
+static OpCode shortJump(OpCode op) {
+    switch (op) {
+        case OP_JUMP_LONG: return OP_JUMP;
+        case OP_JUMP_IF_FALSE_LONG: return OP_JUMP_IF_FALSE;
+        case OP_LOOP_LONG: return OP_LOOP;
+        default: return op;
+    }
+}
+
+static OpCode longJump(OpCode op) {
+    switch (op) {
+        case OP_JUMP: return OP_JUMP_LONG;
+        case OP_JUMP_IF_FALSE: return OP_JUMP_IF_FALSE_LONG;
+        case OP_LOOP: return OP_LOOP_LONG;
+        default: return op;
+    }
+}
+
+static bool isJump(OpCode op) {
+    return op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_LOOP;
+}
+
+static Program decode(Chunk *chunk) {
+    Program program;
+    program.capacity = chunk->count + 1; // one spare entry stands for the end of the chunk
+    program.instructions = ALLOCATE_SCOPED(Instruction, program.capacity);
+    program.count = 0;
+    // maps the offset of each instruction to its index, and the end of the chunk to count
+    int *indexAt = ALLOCATE_SCOPED(int, chunk->count + 1);
+
+    int run = 0;
+    for (int offset = 0; offset < chunk->count;) {
+        while (run + 1 < chunk->lineCount && chunk->lines[run + 1].offset <= offset) run++;
+
+        OpCode op = chunk->code[offset];
+        int width = Chunk_operandWidth(op);
+        int operand = 0;
+        for (int i = 1; i <= width; ++i) {
+            operand = (operand << 8) | chunk->code[offset + i];
+        }
+        int next = offset + 1 + width;
+        if (op == OP_LOOP || op == OP_LOOP_LONG) {
+            operand = next - operand; // now the target offset, mapped to an index below
+        } else if (isJump(shortJump(op))) {
+            operand = next + operand;
+        }
+
+        indexAt[offset] = program.count;
+        program.instructions[program.count++] = (Instruction) {shortJump(op), operand, chunk->lines[run].line, false, false};
+        offset = next;
+    }
+    indexAt[chunk->count] = program.count;
+
+    for (int i = 0; i < program.count; ++i) {
+        Instruction *instruction = &program.instructions[i];
+        if (!isJump(instruction->op)) continue;
+        instruction->operand = indexAt[instruction->operand];
+        program.instructions[instruction->operand].isTarget = true;
+    }
+
+    FREE_SCOPED_ARRAY(int, indexAt, chunk->count + 1);
+    return program;
+}
+
+static int nextLive(Program *program, int index) {
+    do {
+        index++;
+    } while (index < program->count && program->instructions[index].removed);
+    return index;
+}
+
+// A jump that lands on an unconditional jump can go straight to where that
+// one goes, and a conditional jump that lands on another conditional jump
+// will take it too, since the condition is still the same value on the stack.
+static void threadJumps(Program *program, OptimizerStats *stats) {
+    for (int i = 0; i < program->count; ++i) {
+        Instruction *jump = &program->instructions[i];
+        if (jump->op != OP_JUMP && jump->op != OP_JUMP_IF_FALSE) continue;
+
+        int target = jump->operand;
+        while (target < program->count) {
+            OpCode op = program->instructions[target].op;
+            if (op != OP_JUMP && !(op == OP_JUMP_IF_FALSE && jump->op == OP_JUMP_IF_FALSE)) break;
+            target = program->instructions[target].operand; // forward jumps only, so this ends
+        }
+        if (target != jump->operand) {
+            jump->operand = target;
+            program->instructions[target].isTarget = true;
+            stats->threaded++;
+        }
+    }
+}
+
+static void fuse(Program *program, OptimizerStats *stats) {
+    Instruction *instructions = program->instructions;
+    for (int i = 0; i < program->count; i = nextLive(program, i)) {
+        int j = nextLive(program, i);
+        if (j >= program->count || instructions[j].isTarget) continue;
+        Instruction *first = &instructions[i];
+        Instruction *second = &instructions[j];
+
+        if (second->op == OP_NOT) {
+            switch (first->op) {
+                case OP_EQUAL: first->op = OP_NOT_EQUAL; break;
+                case OP_GREATER: first->op = OP_LESS_EQUAL; break;
+                case OP_LESS: first->op = OP_GREATER_EQUAL; break;
+                default: continue;
+            }
+            second->removed = true;
+            stats->fused++;
+            continue;
+        }
+
+        if ((first->op != OP_SET_LOCAL && first->op != OP_SET_LOCAL_LONG) || second->op != OP_POP) continue;
+        int k = nextLive(program, j);
+        Instruction *third = &instructions[k];
+        if (k < program->count && !third->isTarget && third->operand == first->operand &&
+            third->op == (first->op == OP_SET_LOCAL ? OP_GET_LOCAL : OP_GET_LOCAL_LONG)) {
+            // popping the value and reading it straight back leaves the stack as it was
+            second->removed = true;
+            third->removed = true;
+            stats->fused++;
+        } else if (first->op == OP_SET_LOCAL) {
+            first->op = OP_SET_LOCAL_POP;
+            second->removed = true;
+            stats->fused++;
+        }
+    }
+}
+
+// Run after the other passes, which can leave a jump landing on the instruction right after it.
+static void removeEmptyJumps(Program *program) {
+    for (int i = 0; i < program->count; ++i) {
+        Instruction *jump = &program->instructions[i];
+        if (jump->removed || (jump->op != OP_JUMP && jump->op != OP_JUMP_IF_FALSE)) continue;
+        int target = jump->operand;
+        if (target < program->count && program->instructions[target].removed) {
+            target = nextLive(program, target);
+        }
+        if (target == nextLive(program, i)) jump->removed = true;
+    }
+}
+
+static void encode(Chunk *chunk, Program *program) {
+    int count = program->count;
+    Instruction *instructions = program->instructions;
+
+    // a jump to a removed instruction lands on the next one still there
+    int *liveAt = ALLOCATE_SCOPED(int, count + 1);
+    liveAt[count] = count;
+    for (int i = count - 1; i >= 0; --i) {
+        liveAt[i] = instructions[i].removed ? liveAt[i + 1] : i;
+    }
+
+    // Start every jump short and widen the ones that don't reach until the
+    // layout settles. Widening only ever moves code further apart, so this ends.
+    int *offsets = ALLOCATE_SCOPED(int, count + 1);
+    bool *wide = ALLOCATE_SCOPED(bool, count);
+    for (int i = 0; i < count; ++i) wide[i] = false;
+    bool changed = true;
+    while (changed) {
+        int offset = 0;
+        for (int i = 0; i < count; ++i) {
+            offsets[i] = offset;
+            if (instructions[i].removed) continue;
+            offset += 1 + (wide[i] ? 3 : Chunk_operandWidth(instructions[i].op));
+        }
+        offsets[count] = offset;
+
+        changed = false;
+        for (int i = 0; i < count; ++i) {
+            Instruction *jump = &instructions[i];
+            if (jump->removed || !isJump(jump->op) || wide[i]) continue;
+            int next = offsets[i] + 3;
+            int target = offsets[liveAt[jump->operand]];
+            int distance = jump->op == OP_LOOP ? next - target : target - next;
+            if (distance > UINT16_MAX) {
+                wide[i] = true;
+                changed = true;
+            }
+        }
+    }
+
+    chunk->count = 0;
+    chunk->lineCount = 0;
+    for (int i = 0; i < count; ++i) {
+        Instruction *instruction = &instructions[i];
+        if (instruction->removed) continue;
+
+        int operand = instruction->operand;
+        int width = Chunk_operandWidth(instruction->op);
+        OpCode op = instruction->op;
+        if (isJump(op)) {
+            if (wide[i]) {
+                op = longJump(op);
+                width = 3;
+            }
+            int next = offsets[i] + 1 + width;
+            int target = offsets[liveAt[operand]];
+            operand = op == OP_LOOP || op == OP_LOOP_LONG ? next - target : target - next;
+        }
+
+        Chunk_write(chunk, op, instruction->line);
+        for (int shift = (width - 1) * 8; shift >= 0; shift -= 8) {
+            Chunk_write(chunk, (operand >> shift) & 0xFF, instruction->line);
+        }
+    }
+
+    FREE_SCOPED_ARRAY(bool, wide, count);
+    FREE_SCOPED_ARRAY(int, offsets, count + 1);
+    FREE_SCOPED_ARRAY(int, liveAt, count + 1);
+}
+
+OptimizerStats Optimizer_peephole(Chunk *chunk) {
+    OptimizerStats stats = {0, 0, 0, 0};
+    Program program = decode(chunk);
+    stats.instructionsBefore = program.count;
+
+    threadJumps(&program, &stats);
+    fuse(&program, &stats);
+    removeEmptyJumps(&program);
+    encode(chunk, &program);
+
+    for (int i = 0; i < program.count; ++i) {
+        if (!program.instructions[i].removed) stats.instructionsAfter++;
+    }
+    FREE_SCOPED_ARRAY(Instruction, program.instructions, program.capacity);
+    return stats;
+}
@@ -0,0 +1,20 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_OPTIMIZER_H
+#define CLOX_OPTIMIZER_H
+
+#include "chunk.h"
+
+typedef struct {
+    int instructionsBefore;
+    int instructionsAfter;
+    int fused;     // instruction pairs and triples replaced by a single instruction
+    int threaded;  // jumps retargeted past a chain of jumps
+} OptimizerStats;
+
+// Rewrites a finished chunk in place with a peephole pass over its instructions.
+OptimizerStats Optimizer_peephole(Chunk *chunk);
+
+#endif //CLOX_OPTIMIZER_H
@@ -0,0 +1,77 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#include <stdlib.h>
+
+#include "pool.h"
+
+// Every size class carves its blocks out of slabs of this size. A freed block is
+// pushed on its class' free list and handed out again before the slab is touched.
+#define SLAB_SIZE (64 * 1024)
+
+typedef struct FreeBlock {
+    struct FreeBlock *next;
+} FreeBlock;
+
+typedef struct Slab {
+    struct Slab *next;
+} Slab;
+
+typedef struct {
+    FreeBlock *freeList;
+    char *bump; // next never-used block in the newest slab
+    char *bumpEnd;
+} SizeClass;
+
+// Per thread, like the VM whose objects they hold.
+static _Thread_local SizeClass classes[POOL_CLASS_COUNT];
+static _Thread_local Slab *slabs = NULL;
+
+static void addSlab(SizeClass *sizeClass) {
+    Slab *slab = malloc(SLAB_SIZE);
+    if (slab == NULL) exit(1);
+    slab->next = slabs;
+    slabs = slab;
+
+    // blocks start after the slab header, aligned like malloc would align them
+    sizeClass->bump = (char *) slab + POOL_GRANULARITY;
+    sizeClass->bumpEnd = (char *) slab + SLAB_SIZE;
+}
+
+void *Pool_alloc(size_t size) {
+    SizeClass *sizeClass = &classes[POOL_CLASS(size)];
+    FreeBlock *block = sizeClass->freeList;
+    if (block != NULL) {
+        sizeClass->freeList = block->next;
+        return block;
+    }
+
+    size_t blockSize = (POOL_CLASS(size) + 1) * POOL_GRANULARITY;
+    if (sizeClass->bump == NULL || sizeClass->bump + blockSize > sizeClass->bumpEnd) {
+        addSlab(sizeClass);
+    }
+    void *result = sizeClass->bump;
+    sizeClass->bump += blockSize;
+    return result;
+}
+
+void Pool_free(void *pointer, size_t size) {
+    SizeClass *sizeClass = &classes[POOL_CLASS(size)];
+    FreeBlock *block = (FreeBlock *) pointer;
+    block->next = sizeClass->freeList;
+    sizeClass->freeList = block;
+}
+
+void Pool_freeAll() {
+    Slab *slab = slabs;
+    while (slab != NULL) {
+        Slab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    slabs = NULL;
+    for (int i = 0; i < POOL_CLASS_COUNT; ++i) {
+        classes[i] = (SizeClass){0};
+    }
+}
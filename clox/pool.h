@@ -0,0 +1,22 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_POOL_H
+#define CLOX_POOL_H
+
+#include "common.h"
+
+// Requests up to this many bytes are served from the size-class pools,
+// anything larger goes straight to the system allocator.
+#define POOL_MAX_SIZE 256
+#define POOL_GRANULARITY 16
+#define POOL_CLASS_COUNT (POOL_MAX_SIZE / POOL_GRANULARITY)
+
+#define POOL_CLASS(size) (((size) - 1) / POOL_GRANULARITY)
+
+void *Pool_alloc(size_t size);
+void Pool_free(void *pointer, size_t size);
+void Pool_freeAll();
+
+#endif //CLOX_POOL_H
@@ -0,0 +1,111 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "profiler.h"
+#include "debug.h"
+
+#define REPORTED_PAIRS 20
+
+_Thread_local Profiler profiler = {false, false, -1, 0, {0}, {0}, {{0}}};
+
+typedef struct {
+    int first;
+    int second;
+    uint64_t count;
+} Pair;
+
+void Profiler_start(bool timed) {
+    profiler.enabled = true;
+    profiler.timed = timed;
+    profiler.previous = -1;
+}
+
+static int compareOpcodes(const void *a, const void *b) {
+    uint64_t x = profiler.counts[*(const int *) a];
+    uint64_t y = profiler.counts[*(const int *) b];
+    return (x < y) - (x > y);
+}
+
+static int comparePairs(const void *a, const void *b) {
+    uint64_t x = ((const Pair *) a)->count;
+    uint64_t y = ((const Pair *) b)->count;
+    return (x < y) - (x > y);
+}
+
+static double percentOf(uint64_t part, uint64_t total) {
+    return total > 0 ? 100.0 * (double) part / (double) total : 0;
+}
+
+void Profiler_report(const char *path) {
+    int opcodes[OPCODE_COUNT];
+    uint64_t total = 0;
+    uint64_t totalCycles = 0;
+    for (int op = 0; op < OPCODE_COUNT; ++op) {
+        opcodes[op] = op;
+        total += profiler.counts[op];
+        totalCycles += profiler.cycles[op];
+    }
+    qsort(opcodes, OPCODE_COUNT, sizeof(int), compareOpcodes);
+
+    Pair *pairs = malloc(sizeof(Pair) * OPCODE_COUNT * OPCODE_COUNT);
+    if (pairs == NULL) exit(1);
+    int pairCount = 0;
+    for (int first = 0; first < OPCODE_COUNT; ++first) {
+        for (int second = 0; second < OPCODE_COUNT; ++second) {
+            uint64_t count = profiler.pairs[first][second];
+            if (count > 0) pairs[pairCount++] = (Pair) {first, second, count};
+        }
+    }
+    qsort(pairs, pairCount, sizeof(Pair), comparePairs);
+
+    fprintf(stderr, "-- opcode profile --\n");
+    fprintf(stderr, "%-24s %14s %7s", "opcode", "count", "%");
+    if (profiler.timed) fprintf(stderr, " %16s %7s %10s", "cycles", "%", "cycles/op");
+    fprintf(stderr, "\n");
+    for (int i = 0; i < OPCODE_COUNT; ++i) {
+        int op = opcodes[i];
+        uint64_t count = profiler.counts[op];
+        if (count == 0) break;
+        fprintf(stderr, "%-24s %14llu %6.2f%%", OpCode_name(op), (unsigned long long) count, percentOf(count, total));
+        if (profiler.timed) {
+            fprintf(stderr, " %16llu %6.2f%% %10.1f", (unsigned long long) profiler.cycles[op],
+                    percentOf(profiler.cycles[op], totalCycles), (double) profiler.cycles[op] / (double) count);
+        }
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, "-- most frequent opcode pairs --\n");
+    for (int i = 0; i < pairCount && i < REPORTED_PAIRS; ++i) {
+        fprintf(stderr, "%-24s %-24s %14llu %6.2f%%\n", OpCode_name(pairs[i].first), OpCode_name(pairs[i].second),
+                (unsigned long long) pairs[i].count, percentOf(pairs[i].count, total));
+    }
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not write the profile to \"%s\".\n", path);
+        free(pairs);
+        return;
+    }
+    fprintf(file, "{\n  \"timed\": %s,\n  \"total\": %llu,\n", profiler.timed ? "true" : "false",
+            (unsigned long long) total);
+    fprintf(file, "  \"opcodes\": [\n");
+    for (int i = 0; i < OPCODE_COUNT; ++i) {
+        int op = opcodes[i];
+        fprintf(file, "    {\"name\": \"%s\", \"count\": %llu, \"cycles\": %llu}%s\n", OpCode_name(op),
+                (unsigned long long) profiler.counts[op], (unsigned long long) profiler.cycles[op],
+                i == OPCODE_COUNT - 1 ? "" : ",");
+    }
+    fprintf(file, "  ],\n  \"pairs\": [\n");
+    for (int i = 0; i < pairCount; ++i) {
+        fprintf(file, "    {\"first\": \"%s\", \"second\": \"%s\", \"count\": %llu}%s\n",
+                OpCode_name(pairs[i].first), OpCode_name(pairs[i].second), (unsigned long long) pairs[i].count,
+                i == pairCount - 1 ? "" : ",");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    fprintf(stderr, "-- profile written to %s --\n", path);
+    free(pairs);
+}
@@ -0,0 +1,68 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_PROFILER_H
+#define CLOX_PROFILER_H
+
+#include "chunk.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Counts how often run() executes each opcode and each pair of consecutive
+// opcodes, and optionally the cycles spent from dispatching an opcode until
+// the next dispatch. run() only reports to it when built with PROFILE_OPS,
+// see CLOX_PROFILE_OPS, so other builds pay nothing for it.
+typedef struct {
+    bool enabled;
+    bool timed;
+    int previous; // the opcode dispatched last, or -1 outside of run()
+    uint64_t started;
+    uint64_t counts[OPCODE_COUNT];
+    uint64_t cycles[OPCODE_COUNT];
+    uint64_t pairs[OPCODE_COUNT][OPCODE_COUNT]; // [first][second]
+} Profiler;
+
+// Only counts what runs on the thread that started it.
+extern _Thread_local Profiler profiler;
+
+void Profiler_start(bool timed);
+// Prints the profile sorted by count to stderr and writes it to path as JSON.
+void Profiler_report(const char *path);
+
+// Ticks of the cheapest counter there is: the time stamp counter on x86, nanoseconds elsewhere.
+static inline uint64_t Profiler_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_nsec;
+#endif
+}
+
+static inline void Profiler_enter(uint8_t op) {
+    if (!profiler.enabled) return;
+    uint64_t now = profiler.timed ? Profiler_cycles() : 0;
+    if (profiler.previous >= 0) {
+        profiler.pairs[profiler.previous][op]++;
+        profiler.cycles[profiler.previous] += now - profiler.started;
+    }
+    profiler.counts[op]++;
+    profiler.previous = op;
+    profiler.started = now;
+}
+
+// Called when run() returns, to account for the last opcode it executed.
+static inline void Profiler_leave() {
+    if (!profiler.enabled || profiler.previous < 0) return;
+    uint64_t now = profiler.timed ? Profiler_cycles() : 0;
+    profiler.cycles[profiler.previous] += now - profiler.started;
+    profiler.previous = -1;
+}
+
+#endif //CLOX_PROFILER_H
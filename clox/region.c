@@ -0,0 +1,122 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "region.h"
+
+#define REGION_BLOCK_SIZE (64 * 1024)
+#define REGION_ALIGNMENT 16
+#define ALIGN(size) (((size) + REGION_ALIGNMENT - 1) & ~(size_t)(REGION_ALIGNMENT - 1))
+
+struct RegionBlock {
+    RegionBlock *next;
+    size_t capacity;
+    size_t used;
+    // keeps data aligned to REGION_ALIGNMENT on every platform we build for
+    _Alignas(REGION_ALIGNMENT) char data[];
+};
+
+static RegionBlock *newBlock(Region *region, size_t size) {
+    // reuse a spare block from an earlier request if it is big enough
+    RegionBlock **link = &region->spare;
+    while (*link != NULL) {
+        RegionBlock *block = *link;
+        if (block->capacity >= size) {
+            *link = block->next;
+            block->used = 0;
+            return block;
+        }
+        link = &block->next;
+    }
+
+    size_t capacity = size > REGION_BLOCK_SIZE ? size : REGION_BLOCK_SIZE;
+    RegionBlock *block = malloc(sizeof(RegionBlock) + capacity);
+    if (block == NULL) exit(1);
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+void Region_init(Region *region) {
+    region->blocks = NULL;
+    region->spare = NULL;
+    region->last = NULL;
+    region->bytesUsed = 0;
+    region->peakBytes = 0;
+}
+
+static void used(Region *region, size_t bytes) {
+    region->bytesUsed += bytes;
+    if (region->bytesUsed > region->peakBytes) region->peakBytes = region->bytesUsed;
+}
+
+void *Region_alloc(Region *region, size_t size) {
+    size = ALIGN(size);
+    RegionBlock *block = region->blocks;
+    if (block == NULL || block->used + size > block->capacity) {
+        block = newBlock(region, size);
+        block->next = region->blocks;
+        region->blocks = block;
+    }
+
+    void *result = block->data + block->used;
+    block->used += size;
+    used(region, size);
+    region->last = result;
+    return result;
+}
+
+void *Region_reallocate(Region *region, void *pointer, size_t oldSize, size_t newSize) {
+    if (newSize == 0) return NULL; // released with the rest of the region
+
+    // the newest allocation can grow or shrink in place when the block has room
+    RegionBlock *block = region->blocks;
+    if (pointer != NULL && pointer == region->last) {
+        size_t start = (size_t) ((char *) pointer - block->data);
+        if (start + ALIGN(newSize) <= block->capacity) {
+            used(region, ALIGN(newSize) - ALIGN(oldSize));
+            block->used = start + ALIGN(newSize);
+            return pointer;
+        }
+    }
+
+    void *result = Region_alloc(region, newSize);
+    if (pointer != NULL) {
+        memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+    }
+    return result;
+}
+
+bool Region_owns(Region *region, void *pointer) {
+    for (RegionBlock *block = region->blocks; block != NULL; block = block->next) {
+        if ((char *) pointer >= block->data && (char *) pointer < block->data + block->used) return true;
+    }
+    return false;
+}
+
+void Region_reset(Region *region) {
+    RegionBlock *block = region->blocks;
+    while (block != NULL) {
+        RegionBlock *next = block->next;
+        block->next = region->spare;
+        region->spare = block;
+        block = next;
+    }
+    region->blocks = NULL;
+    region->last = NULL;
+    region->bytesUsed = 0;
+}
+
+void Region_free(Region *region) {
+    Region_reset(region);
+    RegionBlock *block = region->spare;
+    while (block != NULL) {
+        RegionBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    Region_init(region);
+}
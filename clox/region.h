@@ -0,0 +1,29 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_REGION_H
+#define CLOX_REGION_H
+
+#include "common.h"
+
+typedef struct RegionBlock RegionBlock;
+
+// A bump allocator whose memory is only ever released all at once.
+typedef struct {
+    RegionBlock *blocks; // newest first, only the newest one is bumped
+    RegionBlock *spare; // blocks kept from earlier resets
+    void *last; // most recent allocation, the only one that can grow in place
+    size_t bytesUsed;
+    size_t peakBytes; // the most it has held at once since it was initialized
+} Region;
+
+void Region_init(Region *region);
+void *Region_alloc(Region *region, size_t size);
+void *Region_reallocate(Region *region, void *pointer, size_t oldSize, size_t newSize);
+// Whether pointer was handed out by the region since it was last reset.
+bool Region_owns(Region *region, void *pointer);
+void Region_reset(Region *region);
+void Region_free(Region *region);
+
+#endif //CLOX_REGION_H
@@ -0,0 +1,272 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#include "registers.h"
+#include "memory.h"
+
+// The stack code is lowered by simulating its stack at compile time. Each slot
+// of the simulated stack holds the operand its value can be read from: the
+// register of the same slot once the value is actually there, or a constant or
+// a local's register when it hasn't been copied yet. Reading a local or a
+// constant therefore costs nothing until something needs it in its own slot,
+// and an operator reads its operands straight from wherever they are.
+//
+// Jumps need every value in its own slot, since the code on the other side
+// can't know what was deferred. So the simulated stack is flushed before every
+// jump and at every jump target.
+typedef struct {
+    RegisterCode *code;
+    int line;
+    int *operands;
+    int height;
+    int capacity;
+    int nilConstant;
+    int trueConstant;
+    int falseConstant;
+} Lowering;
+
+void RegisterCode_init(RegisterCode *code) {
+    code->count = 0;
+    code->capacity = 0;
+    code->code = NULL;
+    code->lineCount = 0;
+    code->lineCapacity = 0;
+    code->lines = NULL;
+    code->frameSize = 0;
+}
+
+void RegisterCode_free(RegisterCode *code) {
+    FREE_SCOPED_ARRAY(RegisterInstruction, code->code, code->capacity);
+    FREE_SCOPED_ARRAY(LineStart, code->lines, code->lineCapacity);
+    RegisterCode_init(code);
+}
+
+int RegisterCode_getLine(RegisterCode *code, int instruction) {
+    return LineStart_find(code->lines, code->lineCount, instruction);
+}
+
+static void emit(Lowering *lowering, RegisterOpCode op, int a, int b, int c) {
+    RegisterCode *code = lowering->code;
+    if (code->count >= code->capacity) {
+        int oldCapacity = code->capacity;
+        code->capacity = GROW_CAPACITY(oldCapacity);
+        code->code = GROW_SCOPED_ARRAY(RegisterInstruction, code->code, oldCapacity, code->capacity);
+    }
+    code->code[code->count++] = (RegisterInstruction) {op, a, b, c};
+
+    if (code->lineCount > 0 && code->lines[code->lineCount - 1].line == lowering->line) return;
+    if (code->lineCount >= code->lineCapacity) {
+        int oldCapacity = code->lineCapacity;
+        code->lineCapacity = GROW_CAPACITY(oldCapacity);
+        code->lines = GROW_SCOPED_ARRAY(LineStart, code->lines, oldCapacity, code->lineCapacity);
+    }
+    code->lines[code->lineCount++] = (LineStart) {code->count - 1, lowering->line};
+}
+
+static void push(Lowering *lowering, int operand) {
+    if (lowering->height >= lowering->capacity) {
+        int oldCapacity = lowering->capacity;
+        lowering->capacity = GROW_CAPACITY(oldCapacity);
+        lowering->operands = GROW_SCOPED_ARRAY(int, lowering->operands, oldCapacity, lowering->capacity);
+    }
+    lowering->operands[lowering->height++] = operand;
+    if (lowering->height > lowering->code->frameSize) {
+        lowering->code->frameSize = lowering->height;
+    }
+}
+
+static int pop(Lowering *lowering) {
+    return lowering->operands[--lowering->height];
+}
+
+static void materialize(Lowering *lowering, int slot) {
+    if (lowering->operands[slot] == slot) return;
+    emit(lowering, REG_MOVE, slot, lowering->operands[slot], 0);
+    lowering->operands[slot] = slot;
+}
+
+static void flush(Lowering *lowering) {
+    for (int slot = 0; slot < lowering->height; ++slot) {
+        materialize(lowering, slot);
+    }
+}
+
+static void setLocal(Lowering *lowering, int slot) {
+    // anything still reading the old value has to get its copy first
+    for (int i = 0; i < lowering->height; ++i) {
+        if (i != slot && lowering->operands[i] == slot) materialize(lowering, i);
+    }
+    int value = lowering->operands[lowering->height - 1];
+    if (value != slot) emit(lowering, REG_MOVE, slot, value, 0);
+    lowering->operands[slot] = slot;
+}
+
+static int constant(Chunk *chunk, int *cached, Value value) {
+    if (*cached == -1) *cached = Chunk_addConstant(chunk, value);
+    return ~*cached;
+}
+
+static void binary(Lowering *lowering, RegisterOpCode op) {
+    int right = pop(lowering);
+    int left = pop(lowering);
+    int result = lowering->height;
+    emit(lowering, op, result, left, right);
+    push(lowering, result);
+}
+
+static void unary(Lowering *lowering, RegisterOpCode op) {
+    int operand = pop(lowering);
+    int result = lowering->height;
+    emit(lowering, op, result, operand, 0);
+    push(lowering, result);
+}
+
+static bool isLoop(OpCode op) {
+    return op == OP_LOOP || op == OP_LOOP_LONG;
+}
+
+static bool isJump(OpCode op) {
+    return op == OP_JUMP || op == OP_JUMP_LONG || op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_FALSE_LONG || isLoop(op);
+}
+
+static int readOperand(Chunk *chunk, int offset, int width) {
+    int operand = 0;
+    for (int i = 1; i <= width; ++i) {
+        operand = (operand << 8) | chunk->code[offset + i];
+    }
+    return operand;
+}
+
+void Registers_lower(Chunk *chunk, RegisterCode *code) {
+    Lowering lowering = {code, 0, NULL, 0, 0, -1, -1, -1};
+    // per offset of the stack code: where its register code starts, whether
+    // something jumps there, and the stack height forward jumps arrive with
+    int *labels = ALLOCATE_SCOPED(int, chunk->count + 1);
+    bool *isTarget = ALLOCATE_SCOPED(bool, chunk->count + 1);
+    int *heights = ALLOCATE_SCOPED(int, chunk->count + 1);
+    for (int offset = 0; offset <= chunk->count; ++offset) {
+        isTarget[offset] = false;
+        heights[offset] = -1;
+    }
+    for (int offset = 0; offset < chunk->count; offset += 1 + Chunk_operandWidth(chunk->code[offset])) {
+        if (isJump(chunk->code[offset])) isTarget[Chunk_jumpTarget(chunk, offset)] = true;
+    }
+
+    bool reachable = true;
+    int run = 0;
+    for (int offset = 0; offset < chunk->count;) {
+        while (run + 1 < chunk->lineCount && chunk->lines[run + 1].offset <= offset) run++;
+        lowering.line = chunk->lines[run].line;
+
+        OpCode op = chunk->code[offset];
+        int width = Chunk_operandWidth(op);
+        int operand = readOperand(chunk, offset, width);
+        int next = offset + 1 + width;
+
+        if (isTarget[offset]) {
+            if (reachable) {
+                flush(&lowering);
+            } else {
+                // Only reached by jumping, which leaves everything in its own slot. A
+                // forward jump tells us the height. Otherwise only a loop comes back
+                // here, like to a for loop's increment, and the stack is as the jump
+                // just before left it.
+                int height = heights[offset] >= 0 ? heights[offset] : lowering.height;
+                lowering.height = 0;
+                for (int slot = 0; slot < height; ++slot) push(&lowering, slot);
+                reachable = true;
+            }
+        }
+        labels[offset] = code->count;
+        if (!reachable) {
+            offset = next;
+            continue;
+        }
+
+        switch (op) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG: push(&lowering, ~operand); break;
+            case OP_NIL: push(&lowering, constant(chunk, &lowering.nilConstant, NIL_VAL)); break;
+            case OP_TRUE: push(&lowering, constant(chunk, &lowering.trueConstant, BOOL_VAL(true))); break;
+            case OP_FALSE: push(&lowering, constant(chunk, &lowering.falseConstant, BOOL_VAL(false))); break;
+            case OP_POP: pop(&lowering); break;
+            case OP_GET_LOCAL:
+            case OP_GET_LOCAL_LONG:
+                materialize(&lowering, operand); // the local's own slot may still be deferred
+                push(&lowering, operand);
+                break;
+            case OP_SET_LOCAL:
+            case OP_SET_LOCAL_LONG:
+                setLocal(&lowering, operand);
+                break;
+            case OP_SET_LOCAL_POP:
+                setLocal(&lowering, operand);
+                pop(&lowering);
+                break;
+            case OP_GET_GLOBAL:
+            case OP_GET_GLOBAL_LONG:
+                emit(&lowering, REG_GET_GLOBAL, lowering.height, operand, 0);
+                push(&lowering, lowering.height);
+                break;
+            case OP_DEFINE_GLOBAL:
+            case OP_DEFINE_GLOBAL_LONG:
+                emit(&lowering, REG_DEFINE_GLOBAL, operand, pop(&lowering), 0);
+                break;
+            case OP_SET_GLOBAL:
+            case OP_SET_GLOBAL_LONG:
+                emit(&lowering, REG_SET_GLOBAL, operand, lowering.operands[lowering.height - 1], 0);
+                break;
+            case OP_EQUAL: binary(&lowering, REG_EQUAL); break;
+            case OP_NOT_EQUAL: binary(&lowering, REG_NOT_EQUAL); break;
+            case OP_GREATER: binary(&lowering, REG_GREATER); break;
+            case OP_GREATER_EQUAL: binary(&lowering, REG_GREATER_EQUAL); break;
+            case OP_LESS: binary(&lowering, REG_LESS); break;
+            case OP_LESS_EQUAL: binary(&lowering, REG_LESS_EQUAL); break;
+            case OP_ADD: binary(&lowering, REG_ADD); break;
+            case OP_SUBTRACT: binary(&lowering, REG_SUBTRACT); break;
+            case OP_MULTIPLY: binary(&lowering, REG_MULTIPLY); break;
+            case OP_DIVIDE: binary(&lowering, REG_DIVIDE); break;
+            case OP_NOT: unary(&lowering, REG_NOT); break;
+            case OP_NEGATE: unary(&lowering, REG_NEGATE); break;
+            case OP_PRINT: emit(&lowering, REG_PRINT, pop(&lowering), 0, 0); break;
+            case OP_JUMP:
+            case OP_JUMP_LONG:
+            case OP_LOOP:
+            case OP_LOOP_LONG: {
+                int target = Chunk_jumpTarget(chunk, offset);
+                flush(&lowering);
+                emit(&lowering, REG_JUMP, 0, target, 0); // b is mapped to an instruction below
+                if (!isLoop(op)) heights[target] = lowering.height;
+                reachable = false;
+                break;
+            }
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_FALSE_LONG: {
+                int target = Chunk_jumpTarget(chunk, offset);
+                flush(&lowering);
+                emit(&lowering, REG_JUMP_IF_FALSE, lowering.height - 1, target, 0);
+                heights[target] = lowering.height;
+                break;
+            }
+            case OP_RETURN:
+                emit(&lowering, REG_RETURN, 0, 0, 0);
+                reachable = false;
+                break;
+        }
+        offset = next;
+    }
+    labels[chunk->count] = code->count;
+
+    for (int i = 0; i < code->count; ++i) {
+        RegisterInstruction *instruction = &code->code[i];
+        if (instruction->op == REG_JUMP || instruction->op == REG_JUMP_IF_FALSE) {
+            instruction->b = labels[instruction->b];
+        }
+    }
+
+    FREE_SCOPED_ARRAY(int, lowering.operands, lowering.capacity);
+    FREE_SCOPED_ARRAY(int, heights, chunk->count + 1);
+    FREE_SCOPED_ARRAY(bool, isTarget, chunk->count + 1);
+    FREE_SCOPED_ARRAY(int, labels, chunk->count + 1);
+}
@@ -0,0 +1,62 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_REGISTERS_H
+#define CLOX_REGISTERS_H
+
+#include "chunk.h"
+
+// Three-address instructions for the register VM. Registers are the slots of
+// the VM stack, so local variable n is register n, and temporaries live in the
+// slots above the locals just like they would on the stack. Operands marked RK
+// are either a register (>= 0) or a constant of the chunk (~index, < 0).
+typedef enum {
+    REG_MOVE,           // R[a] = RK(b)
+    REG_GET_GLOBAL,     // R[a] = globals[b]
+    REG_DEFINE_GLOBAL,  // globals[a] = RK(b)
+    REG_SET_GLOBAL,     // globals[a] = RK(b)
+    REG_EQUAL,          // R[a] = RK(b) == RK(c)
+    REG_NOT_EQUAL,
+    REG_GREATER,
+    REG_GREATER_EQUAL,  // !(RK(b) < RK(c)), like OP_GREATER_EQUAL
+    REG_LESS,
+    REG_LESS_EQUAL,     // !(RK(b) > RK(c)), like OP_LESS_EQUAL
+    REG_ADD,
+    REG_SUBTRACT,
+    REG_MULTIPLY,
+    REG_DIVIDE,
+    REG_NOT,            // R[a] = !RK(b)
+    REG_NEGATE,         // R[a] = -RK(b)
+    REG_PRINT,          // print RK(a)
+    REG_JUMP,           // continue at instruction b
+    REG_JUMP_IF_FALSE,  // continue at instruction b if RK(a) is falsy
+    REG_RETURN,
+} RegisterOpCode;
+
+typedef struct {
+    uint8_t op;
+    int a;
+    int b;
+    int c;
+} RegisterInstruction;
+
+typedef struct {
+    int count;
+    int capacity;
+    RegisterInstruction *code;
+    int lineCount;
+    int lineCapacity;
+    LineStart *lines; // offsets count instructions rather than bytes
+    int frameSize; // registers used, all of them at the bottom of the stack
+} RegisterCode;
+
+void RegisterCode_init(RegisterCode *code);
+void RegisterCode_free(RegisterCode *code);
+int RegisterCode_getLine(RegisterCode *code, int instruction);
+
+// Translates a compiled stack chunk into register code. The register code
+// shares the chunk's constants, which may gain nil, true and false.
+void Registers_lower(Chunk *chunk, RegisterCode *code);
+
+#endif //CLOX_REGISTERS_H
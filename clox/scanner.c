@@ -3,27 +3,85 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "common.h"
 #include "scanner.h"
 
+#if defined(SCANNER_SSE2) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_SSE2
+#endif
+
 typedef struct {
     const char *start;
     const char *current;
+    const char *end; // one past the last character; the source need not be NUL-terminated
     int line;
 } Scanner;
 
-Scanner scanner;
+_Thread_local Scanner scanner;
+
+#define CHAR_SPACE 1 // not counting newlines, which the scanner counts
+#define CHAR_ALPHA 2
+#define CHAR_DIGIT 4
+
+#define S CHAR_SPACE
+#define A CHAR_ALPHA
+#define D CHAR_DIGIT
+// Characters from 128 up are in no class.
+static const uint8_t charClass[256] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, S, 0, 0, 0, S, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,
+        0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+        A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A,
+        0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+        A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,
+};
+#undef S
+#undef A
+#undef D
+
+typedef struct {
+    const char *name;
+    int length;
+    TokenType type;
+} Keyword;
+
+// Indexed by keywordHash, which is different for every keyword, so an
+// identifier is only ever compared to one of them.
+#define KEYWORD_SLOTS 32
+static const Keyword keywords[KEYWORD_SLOTS] = {
+        [1] = {"nil", 3, TOKEN_NIL},
+        [2] = {"or", 2, TOKEN_OR},
+        [6] = {"and", 3, TOKEN_AND},
+        [7] = {"for", 3, TOKEN_FOR},
+        [8] = {"this", 4, TOKEN_THIS},
+        [9] = {"false", 5, TOKEN_FALSE},
+        [12] = {"else", 4, TOKEN_ELSE},
+        [13] = {"fun", 3, TOKEN_FUN},
+        [16] = {"while", 5, TOKEN_WHILE},
+        [18] = {"true", 4, TOKEN_TRUE},
+        [20] = {"class", 5, TOKEN_CLASS},
+        [21] = {"return", 6, TOKEN_RETURN},
+        [22] = {"if", 2, TOKEN_IF},
+        [25] = {"var", 3, TOKEN_VAR},
+        [26] = {"print", 5, TOKEN_PRINT},
+        [29] = {"super", 5, TOKEN_SUPER},
+};
 
-void Scanner_init(const char *source) {
+void Scanner_init(const char *source, size_t length) {
     scanner.start = source;
     scanner.current = source;
+    scanner.end = source + length;
     scanner.line = 1;
 }
 
 static bool isAtEnd() {
-    return *scanner.current == '\0';
+    return scanner.current >= scanner.end;
 }
 
 static Token makeToken(TokenType type) {
@@ -55,21 +113,63 @@ static bool match(char expected) {
     return true;
 }
 
+// Past the end reads as a NUL, which no token continues with.
 static char peek() {
+    if (isAtEnd()) return '\0';
     return *scanner.current;
 }
 
 
 static char peekNext() {
-    if (isAtEnd()) return '\0';
+    if (scanner.end - scanner.current < 2) return '\0';
     return scanner.current[1];
 }
 
+#ifdef SCAN_SSE2
+// How many bytes a run of matching ones covers, given the mask of which of
+// 16 bytes match. The bits above the 16th are set, so it is at most 16.
+static inline int runLength(int mask) {
+    return __builtin_ctz(~(unsigned) mask);
+}
+
+static inline int spaceRun(const char *chars) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *) chars);
+    return runLength(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '))));
+}
+
+// Letters, digits and underscores. Bytes from 128 up compare as negative,
+// which puts them outside every range.
+static inline int identifierRun(const char *chars) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *) chars);
+    __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                   _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+    __m128i underscore = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'));
+    return runLength(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore)));
+}
+#endif
+
+// Indentation is mostly spaces, so a run of them goes a block at a time.
+static void skipSpaces() {
+#ifdef SCAN_SSE2
+    while (scanner.end - scanner.current >= 16) {
+        int run = spaceRun(scanner.current);
+        scanner.current += run;
+        if (run < 16) return;
+    }
+#endif
+    while (peek() == ' ') scanner.current++;
+}
+
 static void skipWhitespace() {
     for (;;) {
         char c = peek();
         switch (c) {
             case ' ':
+                skipSpaces();
+                break;
             case '\r':
             case '\t':
                 advance();
@@ -81,7 +181,8 @@ static void skipWhitespace() {
             case '/':
                 if (peekNext() == '/') {
                     // A comment goes until the end of the line.
-                    while (peek() != '\n' && !isAtEnd()) advance();
+                    const char *newline = memchr(scanner.current, '\n', scanner.end - scanner.current);
+                    scanner.current = newline != NULL ? newline : scanner.end;
                 } else {
                     return;
                 }
@@ -93,10 +194,13 @@ static void skipWhitespace() {
 }
 
 static Token string() {
-    while (peek() != '"' && !isAtEnd()) {
-        if (peek() == '\n') scanner.line++;
-        advance();
+    const char *quote = memchr(scanner.current, '"', scanner.end - scanner.current);
+    const char *stop = quote != NULL ? quote : scanner.end;
+    for (const char *newline = scanner.current;
+         (newline = memchr(newline, '\n', stop - newline)) != NULL; newline++) {
+        scanner.line++;
     }
+    scanner.current = stop;
     if (isAtEnd()) return errorToken("Unterminated string.");
 
     advance(); // The closing quote.
@@ -104,7 +208,7 @@ static Token string() {
 }
 
 static bool isDigit(char c) {
-    return c >= '0' && c <= '9';
+    return charClass[(uint8_t) c] & CHAR_DIGIT;
 }
 
 static Token number() {
@@ -117,54 +221,33 @@ static Token number() {
 }
 
 static bool isAlpha(char c) {
-    return (c >= 'a' && c <= 'z') ||
-           (c >= 'A' && c <= 'Z') ||
-           c == '_';
+    return charClass[(uint8_t) c] & CHAR_ALPHA;
 }
 
-static TokenType checkKeyword(int start, int length, const char *rest, TokenType type) {
-    if (scanner.current - scanner.start == start + length && // token has correct length
-        memcmp(scanner.start + start, rest, length) == 0) { // the rest of the string matches
-        return type;
-    }
-    return TOKEN_IDENTIFIER;
+// Keywords are two to six characters long, so there is always a second one.
+static inline int keywordHash(const char *start, int length) {
+    return ((uint8_t) start[1] + (length << 3)) & (KEYWORD_SLOTS - 1);
 }
 
 static TokenType identifierType() {
-    switch (scanner.start[0]) {
-        case 'a': return checkKeyword(1, 2, "nd", TOKEN_AND);
-        case 'c': return checkKeyword(1, 4, "lass", TOKEN_CLASS);
-        case 'e': return checkKeyword(1, 3, "lse", TOKEN_ELSE);
-        case 'i': return checkKeyword(1, 1, "f", TOKEN_IF);
-        case 'n': return checkKeyword(1, 2, "il", TOKEN_NIL);
-        case 'o': return checkKeyword(1, 1, "r", TOKEN_OR);
-        case 'p': return checkKeyword(1, 4, "rint", TOKEN_PRINT);
-        case 'r': return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
-        case 's': return checkKeyword(1, 4, "uper", TOKEN_SUPER);
-        case 'v': return checkKeyword(1, 2, "ar", TOKEN_VAR);
-        case 'w': return checkKeyword(1, 4, "hile", TOKEN_WHILE);
-        case 'f':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'a': return checkKeyword(2, 3, "lse", TOKEN_FALSE);
-                    case 'o': return checkKeyword(2, 1, "r", TOKEN_FOR);
-                    case 'u': return checkKeyword(2, 1, "n", TOKEN_FUN);
-                }
-            }
-            break;
-        case 't':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'r': return checkKeyword(2, 2, "ue", TOKEN_TRUE);
-                    case 'h': return checkKeyword(2, 2, "is", TOKEN_THIS);
-                }
-            }
+    int length = (int) (scanner.current - scanner.start);
+    if (length < 2 || length > 6) return TOKEN_IDENTIFIER;
+    const Keyword *keyword = &keywords[keywordHash(scanner.start, length)];
+    if (keyword->length == length && memcmp(scanner.start, keyword->name, length) == 0) {
+        return keyword->type;
     }
     return TOKEN_IDENTIFIER;
 }
 
 static Token identifier() {
-    while (isAlpha(peek()) || isDigit(peek())) advance();
+#ifdef SCAN_SSE2
+    while (scanner.end - scanner.current >= 16) {
+        int run = identifierRun(scanner.current);
+        scanner.current += run;
+        if (run < 16) return makeToken(identifierType());
+    }
+#endif
+    while (charClass[(uint8_t) peek()] & (CHAR_ALPHA | CHAR_DIGIT)) advance();
     return makeToken(identifierType());
 }
 
@@ -210,3 +293,43 @@ Token Scanner_nextToken() {
 
     return errorToken("Unexpected character.");
 }
+
+// Number literals are digits with an optional fraction. When the digits, as
+// an integer, and the power of ten the fraction divides by are both exact as
+// doubles, a single division rounds correctly, just like strtod.
+#define MAX_EXACT_MANTISSA ((uint64_t) 1 << 53)
+#define MAX_EXACT_POWER 22
+
+static const double powersOfTen[MAX_EXACT_POWER + 1] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// The literal is copied out, since strtod would read on past its end into
+// whatever follows it in the source.
+static double parseSlowly(const char *start, int length) {
+    char *chars = malloc(length + 1);
+    if (chars == NULL) exit(1);
+    memcpy(chars, start, length);
+    chars[length] = '\0';
+    double number = strtod(chars, NULL);
+    free(chars);
+    return number;
+}
+
+double Scanner_parseNumber(const char *start, int length) {
+    uint64_t mantissa = 0;
+    int decimals = 0;
+    bool fraction = false;
+    for (int i = 0; i < length; ++i) {
+        if (start[i] == '.') {
+            fraction = true;
+            continue;
+        }
+        mantissa = mantissa * 10 + (uint64_t) (start[i] - '0');
+        if (mantissa > MAX_EXACT_MANTISSA) return parseSlowly(start, length);
+        if (fraction) decimals++;
+    }
+    if (decimals > MAX_EXACT_POWER) return parseSlowly(start, length);
+    return (double) mantissa / powersOfTen[decimals];
+}
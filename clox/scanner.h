@@ -5,6 +5,8 @@
 #ifndef CLOX_SCANNER_H
 #define CLOX_SCANNER_H
 
+#include "common.h"
+
 typedef enum {
     // Single-character tokens.
     TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
@@ -34,7 +36,10 @@ typedef struct {
     int line;
 } Token;
 
-void Scanner_init(const char *source);
+// Tokens point into source, which has to outlive them.
+void Scanner_init(const char *source, size_t length);
 Token Scanner_nextToken();
+// The value of a TOKEN_NUMBER.
+double Scanner_parseNumber(const char *start, int length);
 
 #endif //CLOX_SCANNER_H
@@ -0,0 +1,91 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.h"
+
+#define STREAM_BLOCK 65536
+
+bool SourceFile_load(const char *path, SourceFile *file) {
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0) return false;
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        close(descriptor);
+        return false;
+    }
+
+    if (!S_ISREG(status.st_mode)) {
+        FILE *stream = fdopen(descriptor, "rb");
+        if (stream == NULL) {
+            close(descriptor);
+            return false;
+        }
+        bool read = SourceFile_stream(stream, file);
+        fclose(stream);
+        return read;
+    }
+
+    // an empty file can not be mapped, and has nothing to map anyway
+    file->chars = "";
+    file->length = status.st_size;
+    file->mapping = NULL;
+    file->buffer = NULL;
+    if (file->length == 0) {
+        close(descriptor);
+        return true;
+    }
+    void *mapping = mmap(NULL, file->length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED) return false;
+    // the scanner reads it front to back, once
+    posix_madvise(mapping, file->length, POSIX_MADV_SEQUENTIAL);
+    file->mapping = mapping;
+    file->chars = mapping;
+    return true;
+}
+
+bool SourceFile_stream(FILE *stream, SourceFile *file) {
+    size_t capacity = STREAM_BLOCK;
+    size_t length = 0;
+    char *buffer = malloc(capacity);
+    if (buffer == NULL) return false;
+    for (;;) {
+        if (capacity - length < STREAM_BLOCK) {
+            capacity *= 2;
+            char *grown = realloc(buffer, capacity);
+            if (grown == NULL) {
+                free(buffer);
+                return false;
+            }
+            buffer = grown;
+        }
+        size_t read = fread(buffer + length, sizeof(char), capacity - length, stream);
+        length += read;
+        if (read == 0) break;
+    }
+    if (ferror(stream)) {
+        free(buffer);
+        return false;
+    }
+    file->chars = buffer;
+    file->length = length;
+    file->mapping = NULL;
+    file->buffer = buffer;
+    return true;
+}
+
+void SourceFile_unload(SourceFile *file) {
+    if (file->mapping != NULL) munmap(file->mapping, file->length);
+    free(file->buffer);
+    file->chars = NULL;
+    file->length = 0;
+    file->mapping = NULL;
+    file->buffer = NULL;
+}
@@ -0,0 +1,28 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+
+#ifndef CLOX_SOURCE_H
+#define CLOX_SOURCE_H
+
+#include <stdio.h>
+
+#include "common.h"
+
+// A script's source, which is not NUL-terminated. Regular files are mapped, so
+// that compiling starts without reading them first and tokens point straight
+// into the page cache. Anything else, like a pipe, is read into a buffer.
+typedef struct {
+    const char *chars;
+    size_t length;
+    void *mapping; // length bytes, when chars is mapped
+    char *buffer;  // when chars was read instead
+} SourceFile;
+
+// Fails if the file can not be opened or read.
+bool SourceFile_load(const char *path, SourceFile *file);
+// Reads stream to its end.
+bool SourceFile_stream(FILE *stream, SourceFile *file);
+void SourceFile_unload(SourceFile *file);
+
+#endif //CLOX_SOURCE_H
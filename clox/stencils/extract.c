@@ -0,0 +1,220 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Turns the object file stencils/stencils.c compiles to into stencils.h: the
+// machine code of every stencil_<opcode> function and the holes baseline.c
+// patches in it, which are its relocations. A tail call to HOLE_NEXT or
+// HOLE_TARGET is movabs rax, address; jmp rax, whose movabs baseline.c turns
+// into a direct jump, and the one that ends a stencil is cut off so that the
+// stencil falls through to the next one instead. Where the compiler has put
+// anything between the two, the hole stays an address to jump through, and so
+// do the stencil's other ones, in case it shares the jmp. Any relocation but
+// an absolute address of an undefined symbol stops the build, since baseline.c
+// has nothing else to patch it with.
+//
+//   clox-extract stencils.o stencils.h
+//
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STENCIL_PREFIX ".text.stencil_"
+#define MAX_HOLES 64
+
+typedef struct {
+    uint64_t offset;
+    const char *kind;
+    const char *function; // for a call, the function it calls
+    int jump;             // bytes of the movabs and jmp the hole is in, 0 if it is not a jump
+    int64_t addend;
+} Hole;
+
+typedef struct {
+    unsigned char *bytes;
+    size_t size;
+    Elf64_Shdr *sections;
+    int sectionCount;
+    const char *sectionNames;
+    Elf64_Sym *symbols;
+    const char *symbolNames;
+} Object;
+
+static void fail(const char *format, const char *detail) {
+    fprintf(stderr, "clox-extract: ");
+    fprintf(stderr, format, detail);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void load(const char *path, Object *object) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) fail("could not open \"%s\".", path);
+    fseek(file, 0, SEEK_END);
+    object->size = (size_t) ftell(file);
+    rewind(file);
+    object->bytes = malloc(object->size);
+    if (object->bytes == NULL || fread(object->bytes, 1, object->size, file) != object->size) {
+        fail("could not read \"%s\".", path);
+    }
+    fclose(file);
+
+    Elf64_Ehdr *header = (Elf64_Ehdr *) object->bytes;
+    if (object->size < sizeof(Elf64_Ehdr) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+        header->e_ident[EI_CLASS] != ELFCLASS64 || header->e_machine != EM_X86_64 || header->e_type != ET_REL) {
+        fail("\"%s\" is not an x86-64 ELF object file.", path);
+    }
+    object->sections = (Elf64_Shdr *) (object->bytes + header->e_shoff);
+    object->sectionCount = header->e_shnum;
+    object->sectionNames = (const char *) object->bytes + object->sections[header->e_shstrndx].sh_offset;
+    object->symbols = NULL;
+    for (int i = 0; i < object->sectionCount; ++i) {
+        if (object->sections[i].sh_type != SHT_SYMTAB) continue;
+        object->symbols = (Elf64_Sym *) (object->bytes + object->sections[i].sh_offset);
+        object->symbolNames = (const char *) object->bytes + object->sections[object->sections[i].sh_link].sh_offset;
+    }
+    if (object->symbols == NULL) fail("\"%s\" has no symbol table.", path);
+}
+
+static const char *holeKind(const char *symbol) {
+    if (strcmp(symbol, "HOLE_OPERAND") == 0) return "STENCIL_OPERAND";
+    if (strcmp(symbol, "HOLE_CONSTANT") == 0) return "STENCIL_CONSTANT";
+    if (strcmp(symbol, "HOLE_IP") == 0) return "STENCIL_IP";
+    if (strcmp(symbol, "HOLE_NEXT") == 0) return "STENCIL_NEXT";
+    if (strcmp(symbol, "HOLE_TARGET") == 0) return "STENCIL_TARGET";
+    return "STENCIL_FUNCTION";
+}
+
+// How many bytes the movabs into a register and the jmp through it take, if
+// the address at offset is the movabs's, and 0 otherwise.
+static int jumpLength(const unsigned char *code, size_t size, uint64_t offset) {
+    if (offset < 2 || offset + 10 > size) return 0;
+    unsigned char rex = code[offset - 2];
+    unsigned char movabs = code[offset - 1];
+    if ((rex != 0x48 && rex != 0x49) || movabs < 0xB8 || movabs > 0xBF) return 0;
+    int reg = movabs - 0xB8;
+    const unsigned char *jmp = &code[offset + 8];
+    if (rex == 0x48 && jmp[0] == 0xFF && jmp[1] == (0xE0 | reg)) return 12;
+    if (rex == 0x49 && offset + 11 <= size && jmp[0] == 0x41 && jmp[1] == 0xFF && jmp[2] == (0xE0 | reg)) return 13;
+    return 0;
+}
+
+static int compareHoles(const void *a, const void *b) {
+    uint64_t x = ((const Hole *) a)->offset;
+    uint64_t y = ((const Hole *) b)->offset;
+    return (x > y) - (x < y);
+}
+
+// Returns how many holes are left in it.
+static int writeStencil(FILE *out, Object *object, int index, const char *op) {
+    Elf64_Shdr *section = &object->sections[index];
+    const unsigned char *code = object->bytes + section->sh_offset;
+    size_t size = section->sh_size;
+
+    Hole holes[MAX_HOLES];
+    int holeCount = 0;
+    for (int i = 0; i < object->sectionCount; ++i) {
+        Elf64_Shdr *relocations = &object->sections[i];
+        if (relocations->sh_type == SHT_REL && relocations->sh_info == (Elf64_Word) index) {
+            fail("stencil_%s has relocations without addends.", op);
+        }
+        if (relocations->sh_type != SHT_RELA || relocations->sh_info != (Elf64_Word) index) continue;
+        Elf64_Rela *entries = (Elf64_Rela *) (object->bytes + relocations->sh_offset);
+        size_t count = relocations->sh_size / sizeof(Elf64_Rela);
+        for (size_t j = 0; j < count; ++j) {
+            Elf64_Sym *symbol = &object->symbols[ELF64_R_SYM(entries[j].r_info)];
+            const char *name = object->symbolNames + symbol->st_name;
+            if (ELF64_R_TYPE(entries[j].r_info) != R_X86_64_64) {
+                fail("stencil_%s has a relocation that is not a 64-bit absolute address.", op);
+            }
+            if (symbol->st_shndx != SHN_UNDEF) {
+                fail("stencil_%s refers to data or code of its own object file.", op);
+            }
+            if (holeCount == MAX_HOLES) fail("stencil_%s has too many holes.", op);
+            const char *kind = holeKind(name);
+            bool jump = strcmp(kind, "STENCIL_NEXT") == 0 || strcmp(kind, "STENCIL_TARGET") == 0;
+            holes[holeCount++] = (Hole) {
+                    entries[j].r_offset, kind, name,
+                    jump ? jumpLength(code, size, entries[j].r_offset) : 0, entries[j].r_addend};
+        }
+    }
+    qsort(holes, holeCount, sizeof(Hole), compareHoles);
+    for (int i = 0; i < holeCount; ++i) {
+        bool jump = strcmp(holes[i].kind, "STENCIL_NEXT") == 0 || strcmp(holes[i].kind, "STENCIL_TARGET") == 0;
+        if (!jump || holes[i].jump > 0) continue;
+        for (int j = 0; j < holeCount; ++j) holes[j].jump = 0;
+        break;
+    }
+
+    // the tail call that ends the stencil becomes falling through to the next one
+    if (holeCount > 0) {
+        Hole *last = &holes[holeCount - 1];
+        if (strcmp(last->kind, "STENCIL_NEXT") == 0 && last->jump > 0 && last->offset - 2 + last->jump == size) {
+            size = last->offset - 2;
+            holeCount--;
+        }
+    }
+
+    fprintf(out, "static const uint8_t %s_code[] = {", op);
+    for (size_t i = 0; i < size; ++i) {
+        fprintf(out, "%s0x%02x", i % 12 == 0 ? "\n        " : " ", code[i]);
+        if (i + 1 < size) fputc(',', out);
+    }
+    fprintf(out, "\n};\n");
+    if (holeCount > 0) {
+        fprintf(out, "static const StencilHole %s_holes[] = {\n", op);
+        for (int i = 0; i < holeCount; ++i) {
+            Hole *hole = &holes[i];
+            fprintf(out, "        {%llu, %s, %d, ", (unsigned long long) hole->offset, hole->kind, hole->jump);
+            if (strcmp(hole->kind, "STENCIL_FUNCTION") == 0) {
+                fprintf(out, "(void (*)(void)) %s, ", hole->function);
+            } else {
+                fprintf(out, "NULL, ");
+            }
+            fprintf(out, "%lld},\n", (long long) hole->addend);
+        }
+        fprintf(out, "};\n");
+    }
+    return holeCount;
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: clox-extract stencils.o stencils.h\n");
+        return 64;
+    }
+    Object object;
+    load(argv[1], &object);
+    FILE *out = fopen(argv[2], "w");
+    if (out == NULL) fail("could not write \"%s\".", argv[2]);
+
+    fprintf(out, "// Generated by clox-extract from %s, see stencils/extract.c. Do not edit.\n\n", argv[1]);
+    size_t prefixLength = strlen(STENCIL_PREFIX);
+    int *holeCounts = calloc(object.sectionCount, sizeof(int));
+    if (holeCounts == NULL) fail("%s", "out of memory.");
+    for (int i = 0; i < object.sectionCount; ++i) {
+        const char *name = object.sectionNames + object.sections[i].sh_name;
+        if (strncmp(name, STENCIL_PREFIX, prefixLength) != 0) continue;
+        holeCounts[i] = writeStencil(out, &object, i, name + prefixLength);
+    }
+
+    fprintf(out, "\nstatic const Stencil stencils[OPCODE_COUNT] = {\n");
+    for (int i = 0; i < object.sectionCount; ++i) {
+        const char *name = object.sectionNames + object.sections[i].sh_name;
+        if (strncmp(name, STENCIL_PREFIX, prefixLength) != 0) continue;
+        const char *op = name + prefixLength;
+        fprintf(out, "        [%s] = {%s_code, sizeof(%s_code), ", op, op, op);
+        if (holeCounts[i] > 0) {
+            fprintf(out, "%s_holes, sizeof(%s_holes) / sizeof(StencilHole)},\n", op, op);
+        } else {
+            fprintf(out, "NULL, 0},\n");
+        }
+    }
+    fprintf(out, "};\n");
+    fclose(out);
+    free(holeCounts);
+    free(object.bytes);
+    return 0;
+}
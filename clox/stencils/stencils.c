@@ -0,0 +1,145 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// The C every stencil of the baseline compiler is made from, one function per
+// opcode, see baseline.h. This is not part of clox itself: CMake compiles it
+// with -mcmodel=large, so that every hole below is a 64-bit absolute address
+// in the object file, and stencils/extract.c copies the code and the holes out
+// of it. So it can only call functions, never refer to data, and every path
+// through a stencil ends in a tail call or a return.
+//
+
+#include "baseline.h"
+
+// Patched with the instruction's operand, the constant it loads, and its
+// address in the chunk.
+extern char HOLE_OPERAND[];
+extern char HOLE_CONSTANT[];
+extern char HOLE_IP[];
+// Patched with the stencils that come after it and that it jumps to.
+extern int HOLE_NEXT(Value *sp, Value *stack, Value *globals);
+extern int HOLE_TARGET(Value *sp, Value *stack, Value *globals);
+
+#define OPERAND ((uint32_t) (uintptr_t) HOLE_OPERAND)
+#define CONSTANT ((Value) (uintptr_t) HOLE_CONSTANT)
+#define IP ((uint8_t *) HOLE_IP)
+#define NEXT() return HOLE_NEXT(sp, stack, globals)
+#define JUMP() return HOLE_TARGET(sp, stack, globals)
+#define SLOW(call) do { sp = (call); if (sp == NULL) return BASELINE_RUNTIME_ERROR; } while (false)
+
+#define STENCIL(op) int stencil_##op(Value *sp, Value *stack, Value *globals)
+#define IS_FALSY(value) ((value) == NIL_VAL || (value) == FALSE_VAL)
+
+#define CONSTANT_STENCIL(op) STENCIL(op) { *sp++ = CONSTANT; NEXT(); }
+CONSTANT_STENCIL(OP_CONSTANT)
+CONSTANT_STENCIL(OP_CONSTANT_LONG)
+
+STENCIL(OP_NIL) { *sp++ = NIL_VAL; NEXT(); }
+STENCIL(OP_TRUE) { *sp++ = TRUE_VAL; NEXT(); }
+STENCIL(OP_FALSE) { *sp++ = FALSE_VAL; NEXT(); }
+STENCIL(OP_POP) { sp--; NEXT(); }
+
+#define GET_GLOBAL_STENCIL(op) \
+    STENCIL(op) { \
+        Value value = globals[OPERAND]; \
+        if (IS_UNDEFINED(value)) return Baseline_undefinedVariable(IP, OPERAND); \
+        *sp++ = value; \
+        NEXT(); \
+    }
+GET_GLOBAL_STENCIL(OP_GET_GLOBAL)
+GET_GLOBAL_STENCIL(OP_GET_GLOBAL_LONG)
+
+#define DEFINE_GLOBAL_STENCIL(op) STENCIL(op) { globals[OPERAND] = *--sp; NEXT(); }
+DEFINE_GLOBAL_STENCIL(OP_DEFINE_GLOBAL)
+DEFINE_GLOBAL_STENCIL(OP_DEFINE_GLOBAL_LONG)
+
+#define SET_GLOBAL_STENCIL(op) \
+    STENCIL(op) { \
+        if (IS_UNDEFINED(globals[OPERAND])) return Baseline_undefinedVariable(IP, OPERAND); \
+        globals[OPERAND] = sp[-1]; \
+        NEXT(); \
+    }
+SET_GLOBAL_STENCIL(OP_SET_GLOBAL)
+SET_GLOBAL_STENCIL(OP_SET_GLOBAL_LONG)
+
+#define GET_LOCAL_STENCIL(op) STENCIL(op) { *sp = stack[OPERAND]; sp++; NEXT(); }
+GET_LOCAL_STENCIL(OP_GET_LOCAL)
+GET_LOCAL_STENCIL(OP_GET_LOCAL_LONG)
+
+#define SET_LOCAL_STENCIL(op) STENCIL(op) { stack[OPERAND] = sp[-1]; NEXT(); }
+SET_LOCAL_STENCIL(OP_SET_LOCAL)
+SET_LOCAL_STENCIL(OP_SET_LOCAL_LONG)
+STENCIL(OP_SET_LOCAL_POP) { stack[OPERAND] = *--sp; NEXT(); }
+
+#define EQUALITY_STENCIL(op, negated) \
+    STENCIL(op) { \
+        Value a = sp[-2]; \
+        Value b = sp[-1]; \
+        if (IS_NUMBER(a) && IS_NUMBER(b)) { \
+            sp[-2] = BOOL_VAL((AS_NUMBER(a) == AS_NUMBER(b)) != negated); \
+            sp--; \
+        } else { \
+            SLOW(Baseline_equal(sp, negated)); \
+        } \
+        NEXT(); \
+    }
+EQUALITY_STENCIL(OP_EQUAL, false)
+EQUALITY_STENCIL(OP_NOT_EQUAL, true)
+
+// Like run()'s BINARY_OP, and <= and >= stay !(a > b) and !(a < b) for NaN.
+#define BINARY_STENCIL(op, valueType, operator) \
+    STENCIL(op) { \
+        Value a = sp[-2]; \
+        Value b = sp[-1]; \
+        if (!IS_NUMBER(a) || !IS_NUMBER(b)) return Baseline_operandsError(IP); \
+        sp[-2] = valueType(AS_NUMBER(a) operator AS_NUMBER(b)); \
+        sp--; \
+        NEXT(); \
+    }
+#define NOT_BOOL_VAL(value) BOOL_VAL(!(value))
+BINARY_STENCIL(OP_GREATER, BOOL_VAL, >)
+BINARY_STENCIL(OP_GREATER_EQUAL, NOT_BOOL_VAL, <)
+BINARY_STENCIL(OP_LESS, BOOL_VAL, <)
+BINARY_STENCIL(OP_LESS_EQUAL, NOT_BOOL_VAL, >)
+BINARY_STENCIL(OP_SUBTRACT, NUMBER_VAL, -)
+BINARY_STENCIL(OP_MULTIPLY, NUMBER_VAL, *)
+BINARY_STENCIL(OP_DIVIDE, NUMBER_VAL, /)
+
+STENCIL(OP_ADD) {
+    Value a = sp[-2];
+    Value b = sp[-1];
+    if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        sp[-2] = NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(b));
+        sp--;
+    } else {
+        SLOW(Baseline_add(sp, IP));
+    }
+    NEXT();
+}
+
+STENCIL(OP_NEGATE) {
+    if (!IS_NUMBER(sp[-1])) return Baseline_operandError(IP);
+    sp[-1] ^= SIGN_BIT; // what negating the double does, without a constant to load
+    NEXT();
+}
+
+STENCIL(OP_NOT) { sp[-1] = BOOL_VAL(IS_FALSY(sp[-1])); NEXT(); }
+
+STENCIL(OP_PRINT) { sp = Baseline_print(sp); NEXT(); }
+
+#define JUMP_STENCIL(op) STENCIL(op) { JUMP(); }
+JUMP_STENCIL(OP_JUMP)
+JUMP_STENCIL(OP_JUMP_LONG)
+JUMP_STENCIL(OP_LOOP)
+JUMP_STENCIL(OP_LOOP_LONG)
+
+#define JUMP_IF_FALSE_STENCIL(op) STENCIL(op) { if (IS_FALSY(sp[-1])) JUMP(); NEXT(); }
+JUMP_IF_FALSE_STENCIL(OP_JUMP_IF_FALSE)
+JUMP_IF_FALSE_STENCIL(OP_JUMP_IF_FALSE_LONG)
+
+STENCIL(OP_RETURN) {
+    (void) sp;
+    (void) stack;
+    (void) globals;
+    return BASELINE_OK;
+}
@@ -6,54 +6,141 @@
 #include "memory.h"
 #include <string.h>
 
+#if defined(TABLE_SSE2) && defined(__SSE2__)
+#include <emmintrin.h>
+#define PROBE_SSE2
+#endif
+
 #define TABLE_MAX_LOAD 0.75
 
-static Entry *findEntry(Entry *entries, int capacity, ObjString *key);
+// Control bytes of entries that aren't full have the top bit set, those of
+// full ones hold the lowest seven bits of the key's hash.
+#define CONTROL_EMPTY   0x80
+#define CONTROL_DELETED 0xfe
+
+// One bit per control byte of a group, set where it matched.
+typedef uint32_t GroupMask;
 
+static int findEntry(Table *table, ObjString *key);
+static int findSlot(uint8_t *control, int capacity, uint32_t hash);
 static void adjustCapacity(Table *table, int capacity);
 
+static inline uint8_t hashControl(uint32_t hash) {
+    return hash & 0x7f;
+}
+
+// The first group to probe, which the bits not in the control byte pick.
+static inline int firstGroup(uint32_t hash, int capacity) {
+    return (int) ((hash >> 7) & (uint32_t) (capacity / TABLE_GROUP_SIZE - 1));
+}
+
+// Triangular steps visit every group, since their count is a power of two.
+static inline int nextGroup(int group, int step, int capacity) {
+    return (group + step) & (capacity / TABLE_GROUP_SIZE - 1);
+}
+
+static inline GroupMask matchByte(const uint8_t *group, uint8_t byte) {
+#ifdef PROBE_SSE2
+    __m128i bytes = _mm_loadu_si128((const __m128i *) group);
+    return (GroupMask) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) byte)));
+#else
+    GroupMask mask = 0;
+    for (int i = 0; i < TABLE_GROUP_SIZE; ++i) {
+        if (group[i] == byte) mask |= (GroupMask) 1 << i;
+    }
+    return mask;
+#endif
+}
+
+// Empty and deleted entries, which are the ones with the top bit set.
+static inline GroupMask matchAvailable(const uint8_t *group) {
+#ifdef PROBE_SSE2
+    return (GroupMask) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#else
+    GroupMask mask = 0;
+    for (int i = 0; i < TABLE_GROUP_SIZE; ++i) {
+        if (group[i] & 0x80) mask |= (GroupMask) 1 << i;
+    }
+    return mask;
+#endif
+}
+
+static inline int lowestBit(GroupMask mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
 void Table_init(Table *table) {
     table->count = 0;
     table->capacity = 0;
+    table->control = NULL;
     table->entries = NULL;
 }
 
 void Table_free(Table *table) {
+    FREE_ARRAY(uint8_t, table->control, table->capacity);
     FREE_ARRAY(Entry, table->entries, table->capacity);
     Table_init(table);
 }
 
+// Mostly deleted entries are only cleared out, which keeps a table that
+// things come and go from, like the interned strings, from growing forever.
+static int grownCapacity(Table *table) {
+    if (table->capacity == 0) return TABLE_GROUP_SIZE;
+    int full = 0;
+    for (int i = 0; i < table->capacity; ++i) {
+        if (table->entries[i].key != NULL) full++;
+    }
+    return (full + 1) * 2 <= table->capacity * TABLE_MAX_LOAD ? table->capacity : table->capacity * 2;
+}
+
 bool Table_set(Table *table, ObjString *key, Value value) {
     if ((table->count + 1) > table->capacity * TABLE_MAX_LOAD) {
-        int newCapacity = GROW_CAPACITY(table->capacity);
-        adjustCapacity(table, newCapacity);
+        adjustCapacity(table, grownCapacity(table));
+    }
+
+    int index = findEntry(table, key);
+    if (index >= 0) {
+        table->entries[index].value = value;
+        return false;
     }
 
-    Entry *entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
-    if (isNewKey && IS_NIL(entry->value)) table->count++;
-    entry->key = key;
-    entry->value = value;
-    return isNewKey;
+    index = findSlot(table->control, table->capacity, key->hash);
+    if (table->control[index] == CONTROL_EMPTY) table->count++;
+    table->control[index] = hashControl(key->hash);
+    table->entries[index].key = key;
+    table->entries[index].value = value;
+    return true;
 }
 
 bool Table_get(Table *table, ObjString *key, Value *value) {
     if (table->count == 0) return false;
-    Entry *entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key != key) {
-        return false;
-    }
-    *value = entry->value;
+    int index = findEntry(table, key);
+    if (index < 0) return false;
+    *value = table->entries[index].value;
     return true;
 }
 
-bool Table_delete(Table *table, ObjString *key) {
-    if (table->capacity == 0) return false;
-    Entry *entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key != key) return false;
+static void deleteAt(Table *table, int index) {
+    // still counted, so that probes keep finding an empty entry to stop at
+    table->control[index] = CONTROL_DELETED;
+    table->entries[index].key = NULL;
+    table->entries[index].value = NIL_VAL;
+}
 
-    entry->key = NULL;
-    entry->value = BOOL_VAL(true); // tombstone
+bool Table_delete(Table *table, ObjString *key) {
+    if (table->count == 0) return false;
+    int index = findEntry(table, key);
+    if (index < 0) return false;
+    deleteAt(table, index);
     return true;
 }
 
@@ -66,67 +153,98 @@ void Table_addAll(Table *src, Table *dst) {
     }
 }
 
+void Table_mark(Table *table) {
+    for (int i = 0; i < table->capacity; ++i) {
+        Entry *entry = table->entries + i;
+        markObject((Obj *) entry->key);
+        markValue(entry->value);
+    }
+}
+
+void Table_removeWhite(Table *table) {
+    for (int i = 0; i < table->capacity; ++i) {
+        Entry *entry = table->entries + i;
+        if (entry->key != NULL && !entry->key->obj.isMarked) {
+            deleteAt(table, i);
+        }
+    }
+}
+
 ObjString *Table_findString(Table *table, const char *chars, int length, uint32_t hash) {
+    return Table_findConcatenation(table, chars, length, "", 0, hash);
+}
+
+ObjString *Table_findConcatenation(Table *table, const char *prefix, int prefixLength,
+                                   const char *suffix, int suffixLength, uint32_t hash) {
     if (table->count == 0) return NULL;
 
-    uint32_t index = hash % table->capacity;
-    for (;;) {
-        Entry *entry = table->entries + index;
-        if (entry->key == NULL) {
-            if (IS_NIL(entry->value)) return NULL;
-        } else if (
-                entry->key->length == length &&
-                entry->key->hash == hash &&
-                memcmp(entry->key->chars, chars, length) == 0) {
-            return entry->key;
+    uint8_t control = hashControl(hash);
+    int group = firstGroup(hash, table->capacity);
+    for (int step = 1;; ++step) {
+        const uint8_t *bytes = table->control + group * TABLE_GROUP_SIZE;
+        for (GroupMask mask = matchByte(bytes, control); mask != 0; mask &= mask - 1) {
+            ObjString *key = table->entries[group * TABLE_GROUP_SIZE + lowestBit(mask)].key;
+            if (key->length == prefixLength + suffixLength &&
+                key->hash == hash &&
+                memcmp(key->chars, prefix, prefixLength) == 0 &&
+                memcmp(key->chars + prefixLength, suffix, suffixLength) == 0) {
+                return key;
+            }
         }
-        index = (index + 1) % table->capacity;
+        if (matchByte(bytes, CONTROL_EMPTY) != 0) return NULL;
+        group = nextGroup(group, step, table->capacity);
     }
 }
 
 static void adjustCapacity(Table *table, int capacity) {
-    // new, empty bucket buffer
-    Entry *newEntries = ALLOCATE(Entry, capacity);
+    uint8_t *control = ALLOCATE(uint8_t, capacity);
+    Entry *entries = ALLOCATE(Entry, capacity);
     for (int i = 0; i < capacity; ++i) {
-        newEntries[i].key = NULL;
-        newEntries[i].value = NIL_VAL;
+        control[i] = CONTROL_EMPTY;
+        entries[i].key = NULL;
+        entries[i].value = NIL_VAL;
     }
 
-    // move all the old values into the new buffer
+    // move the full entries over, which leaves the deleted ones behind
     table->count = 0;
     for (int i = 0; i < table->capacity; ++i) {
         Entry *src = table->entries + i;
         if (src->key == NULL) continue;
-        Entry *dst = findEntry(newEntries, capacity, src->key);
-        dst->key = src->key;
-        dst->value = src->value;
+        int index = findSlot(control, capacity, src->key->hash);
+        control[index] = hashControl(src->key->hash);
+        entries[index] = *src;
         table->count++;
     }
 
+    FREE_ARRAY(uint8_t, table->control, table->capacity);
     FREE_ARRAY(Entry, table->entries, table->capacity);
 
     table->capacity = capacity;
-    table->entries = newEntries;
-}
-
-static Entry *findEntry(Entry *entries, int capacity, ObjString *key) {
-    uint32_t index = key->hash % capacity;
-    Entry *tombstone = NULL;
-    for (;;) {
-        Entry *entry = entries + index;
-        if (entry->key == NULL) {
-            if (IS_NIL(entry->value)) {
-                return tombstone != NULL ? tombstone : entry;
-            } else {
-                if (tombstone == NULL) tombstone = entry;
-            }
-            if (entry->key == key || entry->key == NULL) {
-                return entry;
-            }
-        } else if (entry->key == key) {
-            return entry;
+    table->control = control;
+    table->entries = entries;
+}
+
+// The index of the entry with this key, or -1.
+static int findEntry(Table *table, ObjString *key) {
+    uint8_t control = hashControl(key->hash);
+    int group = firstGroup(key->hash, table->capacity);
+    for (int step = 1;; ++step) {
+        const uint8_t *bytes = table->control + group * TABLE_GROUP_SIZE;
+        for (GroupMask mask = matchByte(bytes, control); mask != 0; mask &= mask - 1) {
+            int index = group * TABLE_GROUP_SIZE + lowestBit(mask);
+            if (table->entries[index].key == key) return index;
         }
+        if (matchByte(bytes, CONTROL_EMPTY) != 0) return -1;
+        group = nextGroup(group, step, table->capacity);
+    }
+}
 
-        index = (index + 1) % capacity;
+// The first empty or deleted entry a key with this hash probes.
+static int findSlot(uint8_t *control, int capacity, uint32_t hash) {
+    int group = firstGroup(hash, capacity);
+    for (int step = 1;; ++step) {
+        GroupMask mask = matchAvailable(control + group * TABLE_GROUP_SIZE);
+        if (mask != 0) return group * TABLE_GROUP_SIZE + lowestBit(mask);
+        group = nextGroup(group, step, capacity);
     }
 }
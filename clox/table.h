@@ -13,9 +13,16 @@ typedef struct {
     Value value;
 } Entry;
 
+// Open addressing with a separate byte of control per entry, probed a group
+// of TABLE_GROUP_SIZE bytes at a time. A full entry's control byte holds seven
+// bits of its key's hash, so most probes never look at the entry itself. The
+// key of an entry that isn't full is NULL.
+#define TABLE_GROUP_SIZE 16
+
 typedef struct {
-    int count;
-    int capacity;
+    int count; // full and deleted entries
+    int capacity; // zero or a power of two, at least TABLE_GROUP_SIZE
+    uint8_t *control;
     Entry *entries;
 } Table;
 
@@ -25,7 +32,12 @@ bool Table_set(Table *table, ObjString *key, Value value);
 bool Table_get(Table *table, ObjString *key, Value *value);
 bool Table_delete(Table *table, ObjString *key);
 void Table_addAll(Table *src, Table *dst);
+void Table_mark(Table *table);
+void Table_removeWhite(Table *table);
 
 ObjString *Table_findString(Table *table, const char *chars, int length, uint32_t hash);
+// Finds the string made of prefix followed by suffix without putting them together.
+ObjString *Table_findConcatenation(Table *table, const char *prefix, int prefixLength,
+                                   const char *suffix, int suffixLength, uint32_t hash);
 
 #endif //CLOX_TABLE_H
@@ -0,0 +1,45 @@
+# Runs each of SCRIPTS with CLOX on its own, then all of them at once on a
+# pool of threads, and fails unless the batch reports the same output, errors
+# and exit status for every script, in order, and exits with the status of the
+# first one that failed. ARGS, if set, are passed to every run. A batch can't
+# read a script from stdin or profile one, so asking for either is a usage error.
+#
+#   cmake -DCLOX=<interpreter> "-DSCRIPTS=<script.lox;...>" [-DARGS=<options>] -P batch.cmake
+
+set(expected "")
+set(expectedResult 0)
+foreach (script ${SCRIPTS})
+    execute_process(COMMAND ${CLOX} ${ARGS} ${script}
+            OUTPUT_VARIABLE output ERROR_VARIABLE errors RESULT_VARIABLE result)
+    string(APPEND expected "== ${script}: exit ${result} in TIME ms\n${output}")
+    if (NOT errors STREQUAL "")
+        string(APPEND expected "-- stderr\n${errors}")
+    endif ()
+    if (expectedResult EQUAL 0)
+        set(expectedResult ${result})
+    endif ()
+endforeach ()
+
+execute_process(COMMAND ${CLOX} ${ARGS} --jobs 4 ${SCRIPTS}
+        OUTPUT_VARIABLE actual RESULT_VARIABLE actualResult)
+list(LENGTH SCRIPTS count)
+if (NOT actual MATCHES "== ${count} scripts, [0-9]+ failed, in [0-9.]+ ms on 4 threads: [0-9.]+ scripts/s\n$")
+    message(FATAL_ERROR "No summary for ${count} scripts on 4 threads:\n${actual}")
+endif ()
+string(REGEX REPLACE "== [0-9]+ scripts, [^\n]*\n$" "" actual "${actual}")
+string(REGEX REPLACE "(== [^\n]*: exit [0-9]+) in [0-9.]+ ms\n" "\\1 in TIME ms\n" actual "${actual}")
+
+if (NOT expected STREQUAL actual)
+    message(FATAL_ERROR "The batch reports differently:\n--- one at a time\n${expected}--- in a batch\n${actual}")
+endif ()
+if (NOT expectedResult STREQUAL actualResult)
+    message(FATAL_ERROR "Exit status differs: ${expectedResult} one at a time, ${actualResult} in a batch")
+endif ()
+
+foreach (options "-" "--profile-ops")
+    execute_process(COMMAND ${CLOX} ${ARGS} --jobs 4 ${SCRIPTS} ${options}
+            OUTPUT_QUIET ERROR_QUIET INPUT_FILE ${CMAKE_CURRENT_LIST_FILE} RESULT_VARIABLE usageResult)
+    if (NOT usageResult EQUAL 64)
+        message(FATAL_ERROR "A batch with ${options} exits with ${usageResult} rather than the usage error")
+    endif ()
+endforeach ()
@@ -0,0 +1,123 @@
+//
+// Created by Fredrik Bystam on 2026-10-17.
+//
+// Writes the cache for a script to the path it is given, then damages the
+// code in it one way at a time. Cache_load has to turn every damaged cache
+// down, so that it is compiled and written again, rather than run it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "compilers.h"
+#include "vm.h"
+
+static const char *SCRIPT =
+        "var total = 0;\n"
+        "{\n"
+        "  var step = 2;\n"
+        "  for (var i = 0; i < 10; i = i + 1) {\n"
+        "    if (i < 5) total = total + step;\n"
+        "  }\n"
+        "}\n"
+        "print total;\n";
+
+static const char *path;
+static uint8_t *original;
+static size_t size;
+
+// Where the first instruction with one of the opcodes starts in the file, or -1.
+static long find(const uint8_t *code, int count, long codeStart, OpCode first, OpCode second) {
+    for (int offset = 0; offset < count; offset += 1 + Chunk_operandWidth(code[offset])) {
+        if (code[offset] == first || code[offset] == second) return codeStart + offset;
+    }
+    return -1;
+}
+
+static bool writeFile(const uint8_t *bytes) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return false;
+    bool written = fwrite(bytes, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+// Writes the cache with the bytes at position replaced and checks that it doesn't load.
+static bool rejects(const char *damage, long position, const uint8_t *bytes, size_t count) {
+    if (position < 0) {
+        fprintf(stderr, "The script has no instruction to give %s.\n", damage);
+        return false;
+    }
+    uint8_t *damaged = malloc(size);
+    memcpy(damaged, original, size);
+    memcpy(damaged + position, bytes, count);
+    bool written = writeFile(damaged);
+    free(damaged);
+    if (!written) {
+        fprintf(stderr, "Could not write %s.\n", path);
+        return false;
+    }
+
+    Chunk chunk;
+    Chunk_init(&chunk);
+    CacheMapping mapping;
+    if (Cache_load(path, SCRIPT, strlen(SCRIPT), &chunk, &mapping)) {
+        Cache_unload(&chunk, &mapping);
+        fprintf(stderr, "A cache with %s was loaded.\n", damage);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: clox-cache <cache path>\n");
+        return 64;
+    }
+    path = argv[1];
+    VM_init();
+
+    Chunk chunk;
+    Chunk_init(&chunk);
+    if (!compile(SCRIPT, strlen(SCRIPT), &chunk) || !Cache_write(path, SCRIPT, strlen(SCRIPT), &chunk)) {
+        fprintf(stderr, "Could not write the cache.\n");
+        return 1;
+    }
+    Chunk_free(&chunk);
+
+    Chunk_init(&chunk);
+    CacheMapping mapping;
+    if (!Cache_load(path, SCRIPT, strlen(SCRIPT), &chunk, &mapping)) {
+        fprintf(stderr, "The cache as it was written did not load.\n");
+        return 1;
+    }
+    size = mapping.size;
+    original = malloc(size);
+    memcpy(original, mapping.mapping, size);
+    long codeStart = (long) (chunk.code - (uint8_t *) mapping.mapping);
+    long last = codeStart + chunk.count - 1;
+    long constant = find(chunk.code, chunk.count, codeStart, OP_CONSTANT, OP_CONSTANT);
+    long global = find(chunk.code, chunk.count, codeStart, OP_GET_GLOBAL, OP_SET_GLOBAL);
+    long local = find(chunk.code, chunk.count, codeStart, OP_GET_LOCAL, OP_GET_LOCAL);
+    long jump = find(chunk.code, chunk.count, codeStart, OP_JUMP, OP_JUMP_IF_FALSE);
+    long loop = find(chunk.code, chunk.count, codeStart, OP_LOOP, OP_LOOP);
+    Cache_unload(&chunk, &mapping);
+
+    static const uint8_t unknown[] = {0xFF};
+    static const uint8_t far[] = {0xFF, 0xFF};
+    static const uint8_t nil[] = {OP_NIL};
+    static const uint8_t wide[] = {OP_CONSTANT_LONG};
+    bool passed = rejects("an unknown opcode", codeStart, unknown, sizeof(unknown)) &&
+                  rejects("no OP_RETURN at the end", last, nil, sizeof(nil)) &&
+                  rejects("an operand past the end", last, wide, sizeof(wide)) &&
+                  rejects("a constant the pool doesn't have", constant + 1, unknown, sizeof(unknown)) &&
+                  rejects("a global the file doesn't name", global + 1, unknown, sizeof(unknown)) &&
+                  rejects("a local above the stack", local + 1, unknown, sizeof(unknown)) &&
+                  rejects("a jump past the end", jump + 1, far, sizeof(far)) &&
+                  rejects("a loop before the start", loop + 1, far, sizeof(far));
+    remove(path);
+    free(original);
+    VM_free();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+# Runs a copy of SCRIPT in WORK_DIR without the bytecode cache, then with it:
+# once writing the cache, once loading it, and once more after --compile wrote
+# it. Fails unless every run prints the same output and exits with the same
+# status, or if a script that compiles leaves no cache behind.
+#
+#   cmake -DCLOX=<interpreter> -DSCRIPT=<script.lox> -DWORK_DIR=<dir> -P cache.cmake
+
+get_filename_component(name ${SCRIPT} NAME_WE)
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(script ${WORK_DIR}/${name}.lox)
+set(cache ${WORK_DIR}/${name}.loxc)
+configure_file(${SCRIPT} ${script} COPYONLY)
+file(REMOVE ${cache})
+
+execute_process(COMMAND ${CLOX} --no-cache ${script}
+        OUTPUT_VARIABLE expectedOutput ERROR_VARIABLE expectedError RESULT_VARIABLE expectedResult)
+
+function(check run)
+    execute_process(COMMAND ${CLOX} ${script}
+            OUTPUT_VARIABLE actualOutput ERROR_VARIABLE actualError RESULT_VARIABLE actualResult)
+    if (NOT expectedOutput STREQUAL actualOutput)
+        message(FATAL_ERROR "Output differs ${run}:\n--- without cache\n${expectedOutput}--- with\n${actualOutput}")
+    endif ()
+    if (NOT expectedError STREQUAL actualError)
+        message(FATAL_ERROR "Errors differ ${run}:\n--- without cache\n${expectedError}--- with\n${actualError}")
+    endif ()
+    if (NOT expectedResult STREQUAL actualResult)
+        message(FATAL_ERROR "Exit status differs ${run}: ${expectedResult} without cache, ${actualResult} with")
+    endif ()
+    if (NOT expectedResult EQUAL 65 AND NOT EXISTS ${cache})
+        message(FATAL_ERROR "No cache was written ${run}")
+    endif ()
+endfunction()
+
+check("when writing the cache")
+check("when loading the cache")
+
+file(REMOVE ${cache})
+execute_process(COMMAND ${CLOX} --compile ${script} OUTPUT_QUIET ERROR_QUIET)
+check("when loading the cache from --compile")
@@ -0,0 +1,20 @@
+# Runs SCRIPT with CLOX twice, once as is and once with FLAG, and fails unless
+# both runs print the same output and exit with the same status. ARGS, if set,
+# are passed to both runs.
+#
+#   cmake -DCLOX=<interpreter> -DSCRIPT=<script.lox> -DFLAG=<option> [-DARGS=<options>] -P compare.cmake
+
+execute_process(COMMAND ${CLOX} ${ARGS} ${SCRIPT}
+        OUTPUT_VARIABLE expectedOutput ERROR_VARIABLE expectedError RESULT_VARIABLE expectedResult)
+execute_process(COMMAND ${CLOX} ${ARGS} ${FLAG} ${SCRIPT}
+        OUTPUT_VARIABLE actualOutput ERROR_VARIABLE actualError RESULT_VARIABLE actualResult)
+
+if (NOT expectedOutput STREQUAL actualOutput)
+    message(FATAL_ERROR "Output differs with ${FLAG}:\n--- without\n${expectedOutput}--- with\n${actualOutput}")
+endif ()
+if (NOT expectedError STREQUAL actualError)
+    message(FATAL_ERROR "Errors differ with ${FLAG}:\n--- without\n${expectedError}--- with\n${actualError}")
+endif ()
+if (NOT expectedResult STREQUAL actualResult)
+    message(FATAL_ERROR "Exit status differs with ${FLAG}: ${expectedResult} without, ${actualResult} with")
+endif ()
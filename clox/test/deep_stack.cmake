@@ -0,0 +1,43 @@
+# Generates a script that needs more stack than the VM starts with: LOCALS
+# locals in nested blocks of BLOCK, then an expression nested DEPTH deep on top
+# of them, more than the 65k slots the stack used to be limited to. It fails
+# unless CLOX runs it, with the given ARGS, and prints the right sum. The
+# blocks keep the compiler's check for redeclared locals short.
+#
+#   cmake -DCLOX=<interpreter> -DWORK_DIR=<dir> [-DARGS=<options>] -P deep_stack.cmake
+
+set(LOCALS 65000)
+set(BLOCK 100)
+set(DEPTH 1000)
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(script ${WORK_DIR}/deep_stack.lox)
+
+file(WRITE ${script} "")
+math(EXPR blocks "(${LOCALS} + ${BLOCK} - 1) / ${BLOCK}")
+math(EXPR lastBlock "${blocks} - 1")
+foreach (block RANGE ${lastBlock})
+    set(lines "{\n")
+    math(EXPR first "${block} * ${BLOCK}")
+    math(EXPR last "${first} + ${BLOCK} - 1")
+    foreach (i RANGE ${first} ${last})
+        string(APPEND lines "var l${i} = ${i};\n")
+    endforeach ()
+    file(APPEND ${script} "${lines}") # appending to one long string would take minutes
+endforeach ()
+set(expression "l0")
+set(expected 0)
+math(EXPR last "${DEPTH} - 1")
+foreach (i RANGE 1 ${last})
+    string(APPEND expression " + (l${i}")
+    math(EXPR expected "${expected} + ${i}")
+endforeach ()
+string(REPEAT ")" ${last} closing)
+string(REPEAT "}\n" ${blocks} blockEnds)
+file(APPEND ${script} "print ${expression}${closing};\n${blockEnds}")
+
+execute_process(COMMAND ${CLOX} ${ARGS} ${script}
+        OUTPUT_VARIABLE output ERROR_VARIABLE error RESULT_VARIABLE result)
+if (NOT result EQUAL 0 OR NOT output STREQUAL "${expected}\n")
+    message(FATAL_ERROR "Expected ${expected}, got exit status ${result}:\n${output}${error}")
+endif ()
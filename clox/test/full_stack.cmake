@@ -0,0 +1,28 @@
+# Generates scripts whose locals fill the stack right up to STACK_MIN, FROM to
+# TO of them, then concatenates two strings, which interns the result and so
+# pushes it above everything the chunk reserved. It fails unless CLOX runs
+# every script, with the given ARGS, and prints the concatenation: code that
+# holds on to the stack must not have it move under it.
+#
+#   cmake -DCLOX=<interpreter> -DWORK_DIR=<dir> [-DARGS=<options>] -P full_stack.cmake
+
+set(FROM 248)
+set(TO 260)
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+foreach (locals RANGE ${FROM} ${TO})
+    set(script ${WORK_DIR}/full_stack_${locals}.lox)
+    set(lines "{\n")
+    math(EXPR last "${locals} - 1")
+    foreach (i RANGE ${last})
+        string(APPEND lines "var v${i} = \"string ${i}\";\n")
+    endforeach ()
+    string(APPEND lines "var r = v0 + v1;\nprint r;\n}\n")
+    file(WRITE ${script} "${lines}")
+
+    execute_process(COMMAND ${CLOX} ${ARGS} ${script}
+            OUTPUT_VARIABLE output ERROR_VARIABLE error RESULT_VARIABLE result)
+    if (NOT result EQUAL 0 OR NOT output STREQUAL "string 0string 1\n")
+        message(FATAL_ERROR "With ${locals} locals, got exit status ${result}:\n${output}${error}")
+    endif ()
+endforeach ()
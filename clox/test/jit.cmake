@@ -0,0 +1,27 @@
+# Runs SCRIPT with CLOX once interpreted and once with --jit, and fails unless
+# both runs print the same output and errors and exit with the same status.
+# Then runs it with --jit-stats too, and fails unless the JIT compiled at least
+# one of its loops and ran it. ARGS, if set, are passed to every run.
+#
+#   cmake -DCLOX=<interpreter> -DSCRIPT=<script.lox> [-DARGS=<options>] -P jit.cmake
+
+execute_process(COMMAND ${CLOX} ${ARGS} ${SCRIPT}
+        OUTPUT_VARIABLE expectedOutput ERROR_VARIABLE expectedError RESULT_VARIABLE expectedResult)
+execute_process(COMMAND ${CLOX} ${ARGS} --jit ${SCRIPT}
+        OUTPUT_VARIABLE actualOutput ERROR_VARIABLE actualError RESULT_VARIABLE actualResult)
+
+if (NOT expectedOutput STREQUAL actualOutput)
+    message(FATAL_ERROR "Output differs with --jit:\n--- without\n${expectedOutput}--- with\n${actualOutput}")
+endif ()
+if (NOT expectedError STREQUAL actualError)
+    message(FATAL_ERROR "Errors differ with --jit:\n--- without\n${expectedError}--- with\n${actualError}")
+endif ()
+if (NOT expectedResult STREQUAL actualResult)
+    message(FATAL_ERROR "Exit status differs with --jit: ${expectedResult} without, ${actualResult} with")
+endif ()
+
+execute_process(COMMAND ${CLOX} ${ARGS} --jit --jit-stats ${SCRIPT}
+        OUTPUT_QUIET ERROR_VARIABLE stats)
+if (NOT stats MATCHES "traces compiled: [1-9]" OR NOT stats MATCHES "trace runs: +[1-9]")
+    message(FATAL_ERROR "No loop was compiled and run with --jit:\n${stats}")
+endif ()
@@ -0,0 +1,47 @@
+//
+// Created by Fredrik Bystam on 2026-10-17.
+//
+// Interprets a script whose loop makes a rope on every iteration and keeps
+// none of them, with CLOX_REGION_ALLOCATION. Only what compiling the script
+// allocates belongs in the request's region, so however long the loop runs,
+// the region has to stay about as big as the chunk.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "object.h"
+#include "vm.h"
+
+#define ITERATIONS 1000000
+#define REGION_LIMIT (256 * 1024)
+
+static const char *SCRIPT =
+        "var part = \"0123456789012345678901234567890123456789012345678901234567890123456789\";\n"
+        "var count = 0;\n"
+        "for (var i = 0; i < iterations; i = i + 1) {\n"
+        "  var rope = part + part;\n"
+        "  count = count + 1;\n"
+        "}\n";
+
+int main() {
+    VM_init();
+    char source[512];
+    int length = snprintf(source, sizeof(source), "var iterations = %d;\n%s", ITERATIONS, SCRIPT);
+    InterpretResult result = VM_interpret(source, length);
+    int slot = VM_globalSlot(ObjString_copyFrom("count", 5));
+    bool counted = result == INTERPRET_OK && IS_NUMBER(vm.globals.values[slot]) &&
+                   AS_NUMBER(vm.globals.values[slot]) == ITERATIONS;
+    size_t peak = vm.region.peakBytes;
+    VM_free();
+
+    if (!counted) {
+        fprintf(stderr, "The script did not run its loop to the end.\n");
+        return 1;
+    }
+    if (peak > REGION_LIMIT) {
+        fprintf(stderr, "The region grew to %zu bytes over %d iterations.\n", peak, ITERATIONS);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+# Types lines into the REPL of CLOX, which runs each of them as a request of
+# its own, and fails unless it prints the ropes they build. With
+# CLOX_REGION_ALLOCATION, the first line leaves a global that has been copied
+# out of its request's region, and the second one makes a rope in its region
+# from it and then drops the global, so only the rope keeps that string alive.
+# ARGS, if set, are passed to CLOX.
+#
+#   cmake -DCLOX=<interpreter> -DWORK_DIR=<dir> [-DARGS=<options>] -P region_ropes.cmake
+
+set(part "0123456789")
+string(REPEAT "${part}" 7 global)
+set(expected "${global}${global}")
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(session ${WORK_DIR}/region_ropes.txt)
+file(WRITE ${session}
+        "var g = \"${part}\" + \"${part}\" + \"${part}\" + \"${part}\" + \"${part}\" + \"${part}\" + \"${part}\";\n"
+        "var r = g + g; g = nil; print r;\n"
+        "print r + \"\";\n")
+
+execute_process(COMMAND ${CLOX} ${ARGS}
+        INPUT_FILE ${session}
+        OUTPUT_VARIABLE output ERROR_VARIABLE error RESULT_VARIABLE result)
+if (NOT result EQUAL 0 OR NOT output MATCHES "> ${expected}\n.*> ${expected}\n")
+    message(FATAL_ERROR "Expected ${expected} twice, got exit status ${result}:\n${output}${error}")
+endif ()
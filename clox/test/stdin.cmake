@@ -0,0 +1,21 @@
+# Runs SCRIPT with CLOX twice, once from its path and once piped to it on
+# stdin, and fails unless both runs print the same output and exit with the
+# same status. ARGS, if set, are passed to both runs.
+#
+#   cmake -DCLOX=<interpreter> -DSCRIPT=<script.lox> [-DARGS=<options>] -P stdin.cmake
+
+execute_process(COMMAND ${CLOX} ${ARGS} ${SCRIPT}
+        OUTPUT_VARIABLE expectedOutput ERROR_VARIABLE expectedError RESULT_VARIABLE expectedResult)
+execute_process(COMMAND ${CLOX} ${ARGS} -
+        INPUT_FILE ${SCRIPT}
+        OUTPUT_VARIABLE actualOutput ERROR_VARIABLE actualError RESULT_VARIABLE actualResult)
+
+if (NOT expectedOutput STREQUAL actualOutput)
+    message(FATAL_ERROR "Output differs on stdin:\n--- from the path\n${expectedOutput}--- from stdin\n${actualOutput}")
+endif ()
+if (NOT expectedError STREQUAL actualError)
+    message(FATAL_ERROR "Errors differ on stdin:\n--- from the path\n${expectedError}--- from stdin\n${actualError}")
+endif ()
+if (NOT expectedResult STREQUAL actualResult)
+    message(FATAL_ERROR "Exit status differs on stdin: ${expectedResult} from the path, ${actualResult} from stdin")
+endif ()
@@ -0,0 +1,78 @@
+//
+// Created by Fredrik Bystam on 2026-10-16.
+//
+// Runs a VM on each of a number of threads at the same time. Every thread
+// interprets a script that concatenates, interns and collects strings a number
+// of times that depends on the thread, and checks that it got its own answer.
+//
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "object.h"
+#include "vm.h"
+
+#define THREADS 8
+#define RUNS 4
+
+static const char *SCRIPT =
+        "var text = \"\";\n"
+        "var total = 0;\n"
+        "for (var i = 0; i < limit; i = i + 1) {\n"
+        "  text = text + \"ab\";\n"
+        "  var pair = \"a\" + \"b\";\n"
+        "  if (pair == \"ab\") total = total + i;\n"
+        "}\n"
+        "var same = text == text + \"\";\n";
+
+typedef struct {
+    int index;
+    bool passed;
+} Worker;
+
+static Value global(const char *name) {
+    int slot = VM_globalSlot(ObjString_copyFrom(name, (int) strlen(name)));
+    return vm.globals.values[slot];
+}
+
+static void *work(void *argument) {
+    Worker *worker = argument;
+    worker->passed = true;
+    for (int run = 0; run < RUNS; ++run) {
+        VM_init();
+        char source[512];
+        int limit = 2000 + 250 * worker->index + run;
+        int length = snprintf(source, sizeof(source), "var limit = %d;\n%s", limit, SCRIPT);
+
+        bool passed = VM_interpret(source, length) == INTERPRET_OK &&
+                      IS_NUMBER(global("total")) &&
+                      AS_NUMBER(global("total")) == (double) limit * (limit - 1) / 2 &&
+                      IS_BOOL(global("same")) && AS_BOOL(global("same"));
+        if (!passed) {
+            fprintf(stderr, "Thread %d got the wrong answer on run %d.\n", worker->index, run);
+            worker->passed = false;
+        }
+        VM_free();
+    }
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[THREADS];
+    Worker workers[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        workers[i].index = i;
+        if (pthread_create(&threads[i], NULL, work, &workers[i]) != 0) {
+            fprintf(stderr, "Could not start thread %d.\n", i);
+            return 1;
+        }
+    }
+
+    bool passed = true;
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+        passed = passed && workers[i].passed;
+    }
+    return passed ? 0 : 1;
+}
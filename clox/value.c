@@ -8,31 +8,113 @@
 #include <stdio.h>
 #include <string.h>
 
-void Value_print(Value value) {
+void Value_print(FILE *out, Value value) {
+#ifdef NAN_BOXING
+    if (IS_BOOL(value)) {
+        fprintf(out, AS_BOOL(value) ? "true" : "false");
+    } else if (IS_NIL(value)) {
+        fprintf(out, "nil");
+    } else if (IS_NUMBER(value)) {
+        fprintf(out, "%g", AS_NUMBER(value));
+    } else if (IS_OBJ(value)) {
+        Obj_print(out, value);
+    } else if (IS_UNDEFINED(value)) {
+        fprintf(out, "undefined");
+    } else if (IS_SHORT_STRING(value)) {
+        char chars[SHORT_STRING_MAX];
+        fprintf(out, "%.*s", ShortString_read(value, chars), chars);
+    }
+#else
     switch (value.type) {
         case VAL_NUMBER:
-            printf("%g", AS_NUMBER(value));
+            fprintf(out, "%g", AS_NUMBER(value));
             break;
         case VAL_BOOL:
-            printf(AS_BOOL(value) ? "true" : "false");
+            fprintf(out, AS_BOOL(value) ? "true" : "false");
             break;
         case VAL_NIL:
-            printf("nil");
+            fprintf(out, "nil");
             break;
         case VAL_OBJ:
-            Obj_print(value); break;
+            Obj_print(out, value); break;
+        case VAL_UNDEFINED:
+            fprintf(out, "undefined");
+            break;
+        case VAL_SHORT_STRING: {
+            char chars[SHORT_STRING_MAX];
+            fprintf(out, "%.*s", ShortString_read(value, chars), chars);
+            break;
+        }
     }
+#endif
 }
 
 bool Value_equal(Value a, Value b) {
+#ifdef NAN_BOXING
+    // compare numbers as doubles so that NaN != NaN like it does without boxing
+    if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        return AS_NUMBER(a) == AS_NUMBER(b);
+    }
+#ifdef ROPES
+    if (a != b && (IS_ROPE(a) || IS_ROPE(b))) return ObjRope_equal(a, b);
+#endif
+    return a == b;
+#else
     if (a.type != b.type) return false;
     switch (a.type) {
         case VAL_NIL: return true;
         case VAL_BOOL: return AS_BOOL(a) == AS_BOOL(b);
         case VAL_NUMBER: return AS_NUMBER(a) == AS_NUMBER(b);
-        case VAL_OBJ: return AS_OBJ(a) == AS_OBJ(b);
+        case VAL_OBJ:
+#ifdef ROPES
+            if (AS_OBJ(a) != AS_OBJ(b) && (IS_ROPE(a) || IS_ROPE(b))) return ObjRope_equal(a, b);
+#endif
+            return AS_OBJ(a) == AS_OBJ(b);
+        case VAL_UNDEFINED: return true;
+        case VAL_SHORT_STRING: return memcmp(a.as.shortString, b.as.shortString, sizeof(a.as.shortString)) == 0;
     }
     return false;
+#endif
+}
+
+bool ShortString_fits(const char *chars, int length) {
+#ifdef SHORT_STRINGS
+    return length <= SHORT_STRING_MAX && memchr(chars, '\0', length) == NULL;
+#else
+    (void) chars;
+    (void) length;
+    return false;
+#endif
+}
+
+Value ShortString_make(const char *chars, int length) {
+#ifdef NAN_BOXING
+    uint64_t bits = 0;
+    for (int i = 0; i < length; ++i) {
+        bits |= (uint64_t) (uint8_t) chars[i] << (8 * i);
+    }
+    return (Value) (QNAN | TAG_SHORT_STRING | bits);
+#else
+    Value value = {VAL_SHORT_STRING, {.shortString = {0}}};
+    memcpy(value.as.shortString, chars, length);
+    return value;
+#endif
+}
+
+int ShortString_read(Value value, char *chars) {
+    int length = 0;
+#ifdef NAN_BOXING
+    for (; length < SHORT_STRING_MAX; ++length) {
+        char c = (char) (value >> (8 * length));
+        if (c == '\0') break;
+        chars[length] = c;
+    }
+#else
+    for (; length < SHORT_STRING_MAX && value.as.shortString[length] != '\0'; ++length) {
+        chars[length] = value.as.shortString[length];
+    }
+#endif
+    return length;
 }
 
 void ValueArray_init(ValueArray *array) {
@@ -45,12 +127,12 @@ void ValueArray_write(ValueArray *array, Value value) {
     if (array->capacity <= array->count) {
         int oldCapacity = array->capacity;
         array->capacity = GROW_CAPACITY(array->capacity);;
-        array->values = GROW_ARRAY(Value, array->values, oldCapacity, array->capacity);
+        array->values = GROW_SCOPED_ARRAY(Value, array->values, oldCapacity, array->capacity);
     }
     array->values[array->count++] = value;
 }
 
 void ValueArray_free(ValueArray *array) {
-    FREE_ARRAY(Value, array->values, array->capacity);
+    FREE_SCOPED_ARRAY(Value, array->values, array->capacity);
     ValueArray_init(array);
 }
@@ -5,16 +5,80 @@
 #ifndef CLOX_VALUE_H
 #define CLOX_VALUE_H
 
+#include <stdio.h>
+
 #include "common.h"
 
+// Strings of up to this many bytes are stored in the Value itself instead of
+// in an ObjString, see SHORT_STRINGS. They are padded with NUL bytes, so a
+// string that contains one is never short.
+#define SHORT_STRING_MAX 6
+
 typedef struct Obj Obj;
 typedef struct ObjString ObjString;
 
+#ifdef NAN_BOXING
+
+#include <string.h>
+
+// A quiet NaN has the exponent bits and the top mantissa bit set. Anything
+// that is not a real double lives inside that NaN space: the singletons in
+// the lowest bits and object pointers in the lower 48 bits with the sign bit set.
+#define SIGN_BIT ((uint64_t)0x8000000000000000)
+#define QNAN     ((uint64_t)0x7ffc000000000000)
+
+#define TAG_NIL       1 // 001
+#define TAG_FALSE     2 // 010
+#define TAG_TRUE      3 // 011
+#define TAG_UNDEFINED 4 // 100
+// Short strings keep their bytes in the lower 48 bits, first byte lowest.
+#define TAG_SHORT_STRING ((uint64_t)1 << 49)
+
+typedef uint64_t Value;
+
+#define FALSE_VAL         ((Value)(uint64_t)(QNAN | TAG_FALSE))
+#define TRUE_VAL          ((Value)(uint64_t)(QNAN | TAG_TRUE))
+
+#define BOOL_VAL(b)       ((b) ? TRUE_VAL : FALSE_VAL)
+#define NIL_VAL           ((Value)(uint64_t)(QNAN | TAG_NIL))
+// UNDEFINED_VAL never reaches Lox code. It marks global slots that have been
+// referenced but not yet defined.
+#define UNDEFINED_VAL     ((Value)(uint64_t)(QNAN | TAG_UNDEFINED))
+#define NUMBER_VAL(num)   numToValue(num)
+#define OBJ_VAL(obj)      (Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj))
+
+#define AS_BOOL(value)    ((value) == TRUE_VAL)
+#define AS_NUMBER(value)  valueToNum(value)
+#define AS_OBJ(value)     ((Obj*)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
+
+#define IS_BOOL(value)    (((value) | 1) == TRUE_VAL)
+#define IS_NIL(value)     ((value) == NIL_VAL)
+#define IS_UNDEFINED(value) ((value) == UNDEFINED_VAL)
+#define IS_NUMBER(value)  (((value) & QNAN) != QNAN)
+#define IS_OBJ(value)     (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
+#define IS_SHORT_STRING(value) (((value) & (SIGN_BIT | QNAN | TAG_SHORT_STRING)) == (QNAN | TAG_SHORT_STRING))
+
+static inline double valueToNum(Value value) {
+    double num;
+    memcpy(&num, &value, sizeof(Value));
+    return num;
+}
+
+static inline Value numToValue(double num) {
+    Value value;
+    memcpy(&value, &num, sizeof(double));
+    return value;
+}
+
+#else
+
 typedef enum {
     VAL_BOOL,
     VAL_NIL,
     VAL_NUMBER,
     VAL_OBJ,
+    VAL_UNDEFINED,
+    VAL_SHORT_STRING,
 } ValueType;
 
 typedef struct {
@@ -23,11 +87,15 @@ typedef struct {
         bool boolean;
         double number;
         Obj *obj;
+        char shortString[8]; // SHORT_STRING_MAX bytes, the rest NUL
     } as;
 } Value;
 
 #define BOOL_VAL(value)   ((Value){VAL_BOOL, {.boolean = value}})
 #define NIL_VAL           ((Value){VAL_NIL, {.number = 0}})
+// UNDEFINED_VAL never reaches Lox code. It marks global slots that have been
+// referenced but not yet defined.
+#define UNDEFINED_VAL     ((Value){VAL_UNDEFINED, {.number = 0}})
 #define NUMBER_VAL(value) ((Value){VAL_NUMBER, {.number = value}})
 #define OBJ_VAL(value) ((Value){VAL_OBJ, {.obj = (Obj *)value}})
 
@@ -37,12 +105,24 @@ typedef struct {
 
 #define IS_BOOL(value)    ((value).type == VAL_BOOL)
 #define IS_NIL(value)     ((value).type == VAL_NIL)
+#define IS_UNDEFINED(value) ((value).type == VAL_UNDEFINED)
 #define IS_NUMBER(value)  ((value).type == VAL_NUMBER)
 #define IS_OBJ(value)  ((value).type == VAL_OBJ)
+#define IS_SHORT_STRING(value) ((value).type == VAL_SHORT_STRING)
 
-void Value_print(Value value);
+#endif
+
+void Value_print(FILE *out, Value value);
 bool Value_equal(Value a, Value b);
 
+// Whether these characters make a short string, which is never the case
+// when SHORT_STRINGS is off.
+bool ShortString_fits(const char *chars, int length);
+Value ShortString_make(const char *chars, int length);
+// Copies the characters of a short string into chars, which has room for
+// SHORT_STRING_MAX of them, and returns how many there are.
+int ShortString_read(Value value, char *chars);
+
 typedef struct {
     int capacity;
     int count;
@@ -3,214 +3,852 @@
 //
 
 #include "vm.h"
+#include "cache.h"
 #include "debug.h"
 #include "compilers.h"
 #include "object.h"
 #include "memory.h"
+#include "profiler.h"
+#include "jit.h"
+#include "baseline.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-VM vm;
+_Thread_local VM vm;
+
+static Value peek(int distance);
+static void stackPush(Value value);
+static Value stackPop();
+static bool isFalsy(Value value);
 
 static void resetStack() {
     vm.stackTop = vm.stack;
 }
 
+// Makes room for count more values above stackTop. That never collects:
+// VM_push grows the stack before the value it pushes is on it.
+static void reserveStack(int count) {
+    int height = (int) (vm.stackTop - vm.stack);
+    if (height + count <= vm.stackCapacity) return;
+    if (vm.stackPinned) {
+        fprintf(stderr, "The stack has to grow while running code points into it.\n");
+        abort();
+    }
+
+    int oldCapacity = vm.stackCapacity;
+    int capacity = oldCapacity < STACK_MIN ? STACK_MIN : oldCapacity;
+    while (capacity < height + count) capacity *= 2;
+    vm.stack = reallocateUncollected(vm.stack, sizeof(Value) * oldCapacity, sizeof(Value) * capacity);
+    vm.stackCapacity = capacity;
+    vm.stackTop = vm.stack + height;
+}
+
 void VM_init() {
+    vm.stack = NULL;
+    vm.stackCapacity = 0;
     resetStack();
+    vm.stackPinned = false;
+    vm.chunk = NULL;
+    vm.registers = NULL;
     vm.objects = NULL;
-    Table_init(&vm.globals);
+    vm.programs = NULL;
+
+    vm.bytesAllocated = 0;
+    vm.nextGC = 1024 * 1024;
+    vm.grayCount = 0;
+    vm.grayCapacity = 0;
+    vm.grayStack = NULL;
+    vm.gcStats = (GCStats){0};
+    vm.startTime = VM_now();
+    vm.out = stdout;
+    vm.err = stderr;
+#ifdef REGION_ALLOCATION
+    Region_init(&vm.region);
+    vm.regionActive = false;
+    vm.regionObjects = NULL;
+#endif
+
+#ifdef VM_COUNT_DISPATCH
+    vm.dispatchCount = 0;
+#endif
+#ifdef VM_COUNT_ALLOCATIONS
+    vm.allocationCount = 0;
+    vm.allocatedBytes = 0;
+#endif
+    Table_init(&vm.globals.slots);
+    vm.globals.count = 0;
+    vm.globals.capacity = 0;
+    vm.globals.values = NULL;
+    vm.globals.names = NULL;
     Table_init(&vm.strings);
 }
 
 void VM_free() {
+#ifdef DEBUG_GC_STATS
+    GCStats *stats = &vm.gcStats;
+    double elapsed = VM_now() - vm.startTime;
+    fprintf(stderr, "-- gc stats --\n");
+    fprintf(stderr, "collections:     %d\n", stats->collections);
+    fprintf(stderr, "bytes collected: %zu\n", stats->bytesCollected);
+    fprintf(stderr, "total pause:     %.3f ms (%.1f%% of %.3f ms)\n",
+            stats->totalPause * 1e3, elapsed > 0 ? 100 * stats->totalPause / elapsed : 0, elapsed * 1e3);
+    fprintf(stderr, "max pause:       %.3f ms\n", stats->maxPause * 1e3);
+    if (stats->collections > 0) {
+        fprintf(stderr, "mean pause:      %.3f ms\n", stats->totalPause * 1e3 / stats->collections);
+    }
+    if (stats->totalPause > 0) {
+        fprintf(stderr, "gc throughput:   %.1f MB/s collected\n",
+                (double) stats->bytesCollected / stats->totalPause / (1024 * 1024));
+    }
+#endif
+    while (vm.programs != NULL) VM_freeProgram(vm.programs);
+    FREE_ARRAY(Value, vm.stack, vm.stackCapacity);
     Table_free(&vm.strings);
-    Table_free(&vm.globals);
+    Table_free(&vm.globals.slots);
+    FREE_ARRAY(Value, vm.globals.values, vm.globals.capacity);
+    FREE_ARRAY(ObjString *, vm.globals.names, vm.globals.capacity);
     freeObjects();
+    freeHeap();
+#ifdef REGION_ALLOCATION
+    Region_free(&vm.region);
+#endif
+}
+
+void VM_push(Value value) {
+    reserveStack(1); // not from run(), so nothing has reserved room for it
+    stackPush(value);
+}
+
+Value VM_pop() {
+    return stackPop();
+}
+
+int VM_globalSlot(ObjString *name) {
+    Value slot;
+    if (Table_get(&vm.globals.slots, name, &slot)) {
+        return (int) AS_NUMBER(slot);
+    }
+
+    VM_push(OBJ_VAL(name)); // keep the name alive while the slot is added
+    if (vm.globals.capacity < vm.globals.count + 1) {
+        int oldCapacity = vm.globals.capacity;
+        vm.globals.capacity = GROW_CAPACITY(oldCapacity);
+        vm.globals.values = GROW_ARRAY(Value, vm.globals.values, oldCapacity, vm.globals.capacity);
+        vm.globals.names = GROW_ARRAY(ObjString *, vm.globals.names, oldCapacity, vm.globals.capacity);
+    }
+    int index = vm.globals.count++;
+    vm.globals.values[index] = UNDEFINED_VAL;
+    vm.globals.names[index] = name;
+    Table_set(&vm.globals.slots, name, NUMBER_VAL(index));
+    VM_pop();
+    return index;
+}
+
+double VM_now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
 }
 
-static Value peek(int distance);
-static void stackPush(Value value);
-static Value stackPop();
-static bool isFalsy(Value value);
-static ObjString *concatenate(ObjString *a, ObjString *b);
-static void runtimeError(const char* format, ...);
 
 static InterpretResult run() {
 #define READ_BYTE() (*vm.ip++)
 #define READ_SHORT() (vm.ip += 2, (uint16_t) *(vm.ip - 2) << 8 | *(vm.ip - 1))
+#define READ_LONG() (vm.ip += 3, (uint32_t) *(vm.ip - 3) << 16 | (uint32_t) *(vm.ip - 2) << 8 | *(vm.ip - 1))
 #define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
+#define READ_CONSTANT_LONG() (vm.chunk->constants.values[READ_LONG()])
 #define READ_STRING() AS_STRING(READ_CONSTANT())
 #define BINARY_OP(valueType, operator) \
     do { \
         if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
-            runtimeError("Operands must be numbers.");     \
+            VM_runtimeError("Operands must be numbers.");     \
             return INTERPRET_RUNTIME_ERROR; \
         }  \
         double b = AS_NUMBER(stackPop()); \
         double a = AS_NUMBER(stackPop()); \
         stackPush(valueType(a operator b)); \
     } while(false)
+// a <= b compiles to !(a > b), which its fused form has to keep for NaN
+#define NOT_BOOL_VAL(value) BOOL_VAL(!(value))
+#define DEFINE_GLOBAL(readSlot) \
+    do { \
+        uint32_t slot = readSlot; \
+        vm.globals.values[slot] = stackPop(); \
+    } while (false)
+#define GET_GLOBAL(readSlot) \
+    do { \
+        uint32_t slot = readSlot; \
+        Value value = vm.globals.values[slot]; \
+        if (IS_UNDEFINED(value)) { \
+            VM_runtimeError("Undefined variable: '%s'.", vm.globals.names[slot]->chars); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+        stackPush(value); \
+    } while (false)
+#define SET_GLOBAL(readSlot) \
+    do { \
+        uint32_t slot = readSlot; \
+        if (IS_UNDEFINED(vm.globals.values[slot])) { \
+            VM_runtimeError("Undefined variable: '%s'.", vm.globals.names[slot]->chars); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+        vm.globals.values[slot] = peek(0); \
+    } while (false)
 
-    for (;;) {
 #ifdef DEBUG_TRACE_EXECUTION
-        Chunk_disassembleInstruction(vm.chunk, (int) (vm.ip - vm.chunk->code));
-        printf("          ");
-        for (Value *slot = vm.stack; slot < vm.stackTop; slot++) {
-            printf("[ ");
-            Value_print(*slot);
-            printf(" ]");
-        }
-        printf("\n");
+#define TRACE_INSTRUCTION() \
+    do { \
+        Chunk_disassembleInstruction(vm.chunk, (int) (vm.ip - vm.chunk->code)); \
+        printf("          "); \
+        for (Value *slot = vm.stack; slot < vm.stackTop; slot++) { \
+            printf("[ "); \
+            Value_print(stdout, *slot); \
+            printf(" ]"); \
+        } \
+        printf("\n"); \
+    } while (false)
+#else
+#define TRACE_INSTRUCTION() do {} while (false)
+#endif
+
+#ifdef VM_COUNT_DISPATCH
+#define COUNT_DISPATCH() (vm.dispatchCount++)
+#else
+#define COUNT_DISPATCH() ((void)0)
+#endif
+
+#ifdef PROFILE_OPS
+#define PROFILE_INSTRUCTION() Profiler_enter(*vm.ip)
+#else
+#define PROFILE_INSTRUCTION() ((void)0)
+#endif
+
+#ifdef JIT
+#define BACK_EDGE() do { if (compilerOptions.jit) vm.ip = Jit_backEdge(vm.ip); } while (false)
+#else
+#define BACK_EDGE() ((void)0)
 #endif
-        uint8_t instruction;
-        switch (instruction = READ_BYTE()) {
-            case OP_CONSTANT: {
+
+#ifdef THREADED_DISPATCH
+    // Every handler ends with its own indirect jump to the next handler, which
+    // gives the branch predictor one history per opcode instead of a single
+    // shared one at the top of a switch.
+    static void *dispatchTable[] = {
+            [OP_CONSTANT] = &&op_OP_CONSTANT,
+            [OP_CONSTANT_LONG] = &&op_OP_CONSTANT_LONG,
+            [OP_NIL] = &&op_OP_NIL,
+            [OP_TRUE] = &&op_OP_TRUE,
+            [OP_FALSE] = &&op_OP_FALSE,
+            [OP_POP] = &&op_OP_POP,
+            [OP_GET_GLOBAL] = &&op_OP_GET_GLOBAL,
+            [OP_GET_GLOBAL_LONG] = &&op_OP_GET_GLOBAL_LONG,
+            [OP_GET_LOCAL] = &&op_OP_GET_LOCAL,
+            [OP_GET_LOCAL_LONG] = &&op_OP_GET_LOCAL_LONG,
+            [OP_DEFINE_GLOBAL] = &&op_OP_DEFINE_GLOBAL,
+            [OP_DEFINE_GLOBAL_LONG] = &&op_OP_DEFINE_GLOBAL_LONG,
+            [OP_SET_GLOBAL] = &&op_OP_SET_GLOBAL,
+            [OP_SET_GLOBAL_LONG] = &&op_OP_SET_GLOBAL_LONG,
+            [OP_SET_LOCAL] = &&op_OP_SET_LOCAL,
+            [OP_SET_LOCAL_LONG] = &&op_OP_SET_LOCAL_LONG,
+            [OP_SET_LOCAL_POP] = &&op_OP_SET_LOCAL_POP,
+            [OP_EQUAL] = &&op_OP_EQUAL,
+            [OP_NOT_EQUAL] = &&op_OP_NOT_EQUAL,
+            [OP_GREATER] = &&op_OP_GREATER,
+            [OP_GREATER_EQUAL] = &&op_OP_GREATER_EQUAL,
+            [OP_LESS] = &&op_OP_LESS,
+            [OP_LESS_EQUAL] = &&op_OP_LESS_EQUAL,
+            [OP_ADD] = &&op_OP_ADD,
+            [OP_SUBTRACT] = &&op_OP_SUBTRACT,
+            [OP_MULTIPLY] = &&op_OP_MULTIPLY,
+            [OP_DIVIDE] = &&op_OP_DIVIDE,
+            [OP_NOT] = &&op_OP_NOT,
+            [OP_NEGATE] = &&op_OP_NEGATE,
+            [OP_PRINT] = &&op_OP_PRINT,
+            [OP_JUMP] = &&op_OP_JUMP,
+            [OP_JUMP_LONG] = &&op_OP_JUMP_LONG,
+            [OP_JUMP_IF_FALSE] = &&op_OP_JUMP_IF_FALSE,
+            [OP_JUMP_IF_FALSE_LONG] = &&op_OP_JUMP_IF_FALSE_LONG,
+            [OP_LOOP] = &&op_OP_LOOP,
+            [OP_LOOP_LONG] = &&op_OP_LOOP_LONG,
+            [OP_RETURN] = &&op_OP_RETURN,
+    };
+#define DISPATCH() \
+    do { \
+        TRACE_INSTRUCTION(); \
+        COUNT_DISPATCH(); \
+        PROFILE_INSTRUCTION(); \
+        goto *dispatchTable[READ_BYTE()]; \
+    } while (false)
+#define CASE(opcode) op_##opcode
+#define NEXT() DISPATCH()
+
+    DISPATCH();
+#else
+#define CASE(opcode) case opcode
+#define NEXT() break
+
+    for (;;) {
+        TRACE_INSTRUCTION();
+        COUNT_DISPATCH();
+        PROFILE_INSTRUCTION();
+        switch (READ_BYTE()) {
+#endif
+            CASE(OP_CONSTANT): {
                 Value constant = READ_CONSTANT();
                 stackPush(constant);
-                break;
+                NEXT();
             }
-            case OP_NIL: stackPush(NIL_VAL); break;
-            case OP_TRUE: stackPush(BOOL_VAL(true)); break;
-            case OP_FALSE: stackPush(BOOL_VAL(false)); break;
-            case OP_POP: stackPop(); break;
-
-            case OP_DEFINE_GLOBAL: {
-                ObjString *name = READ_STRING();
-                Table_set(&vm.globals, name, peek(0));
-                stackPop();
-                break;
-            }
-            case OP_GET_GLOBAL: {
-                ObjString *name = READ_STRING();
-                Value value;
-                if (!Table_get(&vm.globals, name, &value)) {
-                    runtimeError("Undefined variable: '%s'.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                stackPush(value);
-                break;
-            }
-            case OP_SET_GLOBAL: {
-                ObjString *name = READ_STRING();
-                if (Table_set(&vm.globals, name, peek(0))) {
-                    Table_delete(&vm.globals, name);
-                    runtimeError("Undefined variable: '%s'.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                break;
+            CASE(OP_CONSTANT_LONG): {
+                Value constant = READ_CONSTANT_LONG();
+                stackPush(constant);
+                NEXT();
             }
+            CASE(OP_NIL): stackPush(NIL_VAL); NEXT();
+            CASE(OP_TRUE): stackPush(BOOL_VAL(true)); NEXT();
+            CASE(OP_FALSE): stackPush(BOOL_VAL(false)); NEXT();
+            CASE(OP_POP): stackPop(); NEXT();
+
+            CASE(OP_DEFINE_GLOBAL): DEFINE_GLOBAL(READ_BYTE()); NEXT();
+            CASE(OP_DEFINE_GLOBAL_LONG): DEFINE_GLOBAL(READ_LONG()); NEXT();
+            CASE(OP_GET_GLOBAL): GET_GLOBAL(READ_BYTE()); NEXT();
+            CASE(OP_GET_GLOBAL_LONG): GET_GLOBAL(READ_LONG()); NEXT();
+            CASE(OP_SET_GLOBAL): SET_GLOBAL(READ_BYTE()); NEXT();
+            CASE(OP_SET_GLOBAL_LONG): SET_GLOBAL(READ_LONG()); NEXT();
 
-            case OP_GET_LOCAL: {
+            CASE(OP_GET_LOCAL): {
                 uint8_t local = READ_BYTE();
                 Value value = vm.stack[local];
                 stackPush(value);
-                break;
+                NEXT();
             }
-            case OP_SET_LOCAL: {
+            CASE(OP_GET_LOCAL_LONG): {
+                uint16_t local = READ_SHORT();
+                Value value = vm.stack[local];
+                stackPush(value);
+                NEXT();
+            }
+            CASE(OP_SET_LOCAL): {
                 uint8_t local = READ_BYTE();
                 vm.stack[local] = peek(0);
-                break;
-            }
-
-            case OP_EQUAL: {
-                Value b = stackPop();
-                Value a = stackPop();
-                stackPush(BOOL_VAL(Value_equal(a, b)));
-                break;
-            }
-            case OP_LESS:     BINARY_OP(BOOL_VAL, <); break;
-            case OP_GREATER:  BINARY_OP(BOOL_VAL, >); break;
-            case OP_ADD: {
-                if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
-                    ObjString *b = AS_STRING(stackPop());
-                    ObjString *a = AS_STRING(stackPop());
-                    stackPush(OBJ_VAL(concatenate(a, b)));
+                NEXT();
+            }
+            CASE(OP_SET_LOCAL_LONG): {
+                uint16_t local = READ_SHORT();
+                vm.stack[local] = peek(0);
+                NEXT();
+            }
+            CASE(OP_SET_LOCAL_POP): {
+                uint8_t local = READ_BYTE();
+                vm.stack[local] = stackPop();
+                NEXT();
+            }
+
+            CASE(OP_EQUAL): {
+                // comparing a rope flattens it, so both operands stay on the stack meanwhile
+                bool equal = Value_equal(peek(1), peek(0));
+                stackPop();
+                stackPop();
+                stackPush(BOOL_VAL(equal));
+                NEXT();
+            }
+            CASE(OP_NOT_EQUAL): {
+                bool equal = Value_equal(peek(1), peek(0));
+                stackPop();
+                stackPop();
+                stackPush(BOOL_VAL(!equal));
+                NEXT();
+            }
+            CASE(OP_LESS):     BINARY_OP(BOOL_VAL, <); NEXT();
+            CASE(OP_LESS_EQUAL): BINARY_OP(NOT_BOOL_VAL, >); NEXT();
+            CASE(OP_GREATER):  BINARY_OP(BOOL_VAL, >); NEXT();
+            CASE(OP_GREATER_EQUAL): BINARY_OP(NOT_BOOL_VAL, <); NEXT();
+            CASE(OP_ADD): {
+                if (IS_ANY_STRING(peek(0)) && IS_ANY_STRING(peek(1))) {
+                    // keep both operands on the stack while the result is allocated
+                    Value result = ObjRope_concatenate(peek(1), peek(0));
+                    stackPop();
+                    stackPop();
+                    stackPush(result);
                 } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
                     double b = AS_NUMBER(stackPop());
                     double a = AS_NUMBER(stackPop());
                     stackPush(NUMBER_VAL(a + b));
                 } else {
-                    runtimeError("Operands must be two numbers or two strings.");
+                    VM_runtimeError("Operands must be two numbers or two strings.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                break;
+                NEXT();
             }
-            case OP_SUBTRACT: BINARY_OP(NUMBER_VAL, -); break;
-            case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
-            case OP_DIVIDE:   BINARY_OP(NUMBER_VAL, /); break;
-            case OP_NEGATE: {
+            CASE(OP_SUBTRACT): BINARY_OP(NUMBER_VAL, -); NEXT();
+            CASE(OP_MULTIPLY): BINARY_OP(NUMBER_VAL, *); NEXT();
+            CASE(OP_DIVIDE):   BINARY_OP(NUMBER_VAL, /); NEXT();
+            CASE(OP_NEGATE): {
                 if (!IS_NUMBER(peek(0))) {
-                    runtimeError("Operand must be a number.");
+                    VM_runtimeError("Operand must be a number.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
 
                 stackPush(NUMBER_VAL(-AS_NUMBER(stackPop())));
-                break;
+                NEXT();
             }
 
-            case OP_NOT: {
+            CASE(OP_NOT): {
                 Value value = stackPop();
                 stackPush(BOOL_VAL(isFalsy(value)));
-                break;
+                NEXT();
             }
 
-            case OP_PRINT: {
-                Value_print(stackPop());
-                printf("\n");
-                break;
+            CASE(OP_PRINT): {
+                Value_print(vm.out, stackPop());
+                fputc('\n', vm.out);
+                NEXT();
             }
 
-            case OP_JUMP: {
+            CASE(OP_JUMP): {
                 uint16_t offset = READ_SHORT();
                 vm.ip += offset;
-                break;
+                NEXT();
             }
-            case OP_JUMP_IF_FALSE: {
+            CASE(OP_JUMP_LONG): {
+                uint32_t offset = READ_LONG();
+                vm.ip += offset;
+                NEXT();
+            }
+            CASE(OP_JUMP_IF_FALSE): {
                 uint16_t offset = READ_SHORT();
                 if (isFalsy(peek(0))) {
                     vm.ip += offset;
                 }
-                break;
+                NEXT();
             }
-            case OP_LOOP: {
+            CASE(OP_JUMP_IF_FALSE_LONG): {
+                uint32_t offset = READ_LONG();
+                if (isFalsy(peek(0))) {
+                    vm.ip += offset;
+                }
+                NEXT();
+            }
+            CASE(OP_LOOP): {
                 uint16_t offset = READ_SHORT();
                 vm.ip -= offset;
-                break;
+                BACK_EDGE();
+                NEXT();
+            }
+            CASE(OP_LOOP_LONG): {
+                uint32_t offset = READ_LONG();
+                vm.ip -= offset;
+                BACK_EDGE();
+                NEXT();
             }
 
-            case OP_RETURN: {
+            CASE(OP_RETURN): {
                 return INTERPRET_OK;
             }
+#ifndef THREADED_DISPATCH
         }
     }
+#endif
 
 #undef READ_BYTE
 #undef READ_SHORT
+#undef READ_LONG
+#undef READ_CONSTANT_LONG
 #undef READ_STRING
 #undef READ_CONSTANT
 #undef BINARY_OP
+#undef NOT_BOOL_VAL
+#undef DEFINE_GLOBAL
+#undef GET_GLOBAL
+#undef SET_GLOBAL
+#undef TRACE_INSTRUCTION
+#undef COUNT_DISPATCH
+#undef PROFILE_INSTRUCTION
+#undef BACK_EDGE
+#undef DISPATCH
+#undef CASE
+#undef NEXT
 }
 
-InterpretResult VM_interpret(const char *source) {
+static InterpretResult runRegisters() {
+    RegisterInstruction *code = vm.registers->code;
+    Value *registers = vm.stack;
+    Value *constants = vm.chunk->constants.values;
+    // every register is a GC root, so they can't hold anything stale
+    for (int i = 0; i < vm.registers->frameSize; ++i) {
+        registers[i] = NIL_VAL;
+    }
+    vm.stackTop = vm.stack + vm.registers->frameSize;
+
+#define RK(operand) ((operand) >= 0 ? registers[operand] : constants[~(operand)])
+#define BINARY_OP(valueType, operator) \
+    do { \
+        Value b = RK(instruction->b); \
+        Value c = RK(instruction->c); \
+        if (!IS_NUMBER(b) || !IS_NUMBER(c)) { \
+            VM_runtimeError("Operands must be numbers."); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+        registers[instruction->a] = valueType(AS_NUMBER(b) operator AS_NUMBER(c)); \
+    } while (false)
+#define NOT_BOOL_VAL(value) BOOL_VAL(!(value))
+#define CHECK_GLOBAL(slot) \
+    do { \
+        if (IS_UNDEFINED(vm.globals.values[slot])) { \
+            VM_runtimeError("Undefined variable: '%s'.", vm.globals.names[slot]->chars); \
+            return INTERPRET_RUNTIME_ERROR; \
+        } \
+    } while (false)
+
+#ifdef VM_COUNT_DISPATCH
+#define COUNT_DISPATCH() (vm.dispatchCount++)
+#else
+#define COUNT_DISPATCH() ((void)0)
+#endif
+
+    RegisterInstruction *instruction;
+#ifdef THREADED_DISPATCH
+    static void *dispatchTable[] = {
+            [REG_MOVE] = &&reg_REG_MOVE,
+            [REG_GET_GLOBAL] = &&reg_REG_GET_GLOBAL,
+            [REG_DEFINE_GLOBAL] = &&reg_REG_DEFINE_GLOBAL,
+            [REG_SET_GLOBAL] = &&reg_REG_SET_GLOBAL,
+            [REG_EQUAL] = &&reg_REG_EQUAL,
+            [REG_NOT_EQUAL] = &&reg_REG_NOT_EQUAL,
+            [REG_GREATER] = &&reg_REG_GREATER,
+            [REG_GREATER_EQUAL] = &&reg_REG_GREATER_EQUAL,
+            [REG_LESS] = &&reg_REG_LESS,
+            [REG_LESS_EQUAL] = &&reg_REG_LESS_EQUAL,
+            [REG_ADD] = &&reg_REG_ADD,
+            [REG_SUBTRACT] = &&reg_REG_SUBTRACT,
+            [REG_MULTIPLY] = &&reg_REG_MULTIPLY,
+            [REG_DIVIDE] = &&reg_REG_DIVIDE,
+            [REG_NOT] = &&reg_REG_NOT,
+            [REG_NEGATE] = &&reg_REG_NEGATE,
+            [REG_PRINT] = &&reg_REG_PRINT,
+            [REG_JUMP] = &&reg_REG_JUMP,
+            [REG_JUMP_IF_FALSE] = &&reg_REG_JUMP_IF_FALSE,
+            [REG_RETURN] = &&reg_REG_RETURN,
+    };
+#define DISPATCH() \
+    do { \
+        COUNT_DISPATCH(); \
+        instruction = vm.pc++; \
+        goto *dispatchTable[instruction->op]; \
+    } while (false)
+#define CASE(opcode) reg_##opcode
+#define NEXT() DISPATCH()
+
+    DISPATCH();
+#else
+#define CASE(opcode) case opcode
+#define NEXT() break
+
+    for (;;) {
+        COUNT_DISPATCH();
+        instruction = vm.pc++;
+        switch (instruction->op) {
+#endif
+            CASE(REG_MOVE): registers[instruction->a] = RK(instruction->b); NEXT();
+            CASE(REG_GET_GLOBAL): {
+                CHECK_GLOBAL(instruction->b);
+                registers[instruction->a] = vm.globals.values[instruction->b];
+                NEXT();
+            }
+            CASE(REG_DEFINE_GLOBAL): vm.globals.values[instruction->a] = RK(instruction->b); NEXT();
+            CASE(REG_SET_GLOBAL): {
+                CHECK_GLOBAL(instruction->a);
+                vm.globals.values[instruction->a] = RK(instruction->b);
+                NEXT();
+            }
+            CASE(REG_EQUAL): {
+                registers[instruction->a] = BOOL_VAL(Value_equal(RK(instruction->b), RK(instruction->c)));
+                NEXT();
+            }
+            CASE(REG_NOT_EQUAL): {
+                registers[instruction->a] = BOOL_VAL(!Value_equal(RK(instruction->b), RK(instruction->c)));
+                NEXT();
+            }
+            CASE(REG_GREATER): BINARY_OP(BOOL_VAL, >); NEXT();
+            CASE(REG_GREATER_EQUAL): BINARY_OP(NOT_BOOL_VAL, <); NEXT();
+            CASE(REG_LESS): BINARY_OP(BOOL_VAL, <); NEXT();
+            CASE(REG_LESS_EQUAL): BINARY_OP(NOT_BOOL_VAL, >); NEXT();
+            CASE(REG_ADD): {
+                Value b = RK(instruction->b);
+                Value c = RK(instruction->c);
+                if (IS_ANY_STRING(b) && IS_ANY_STRING(c)) {
+                    // both operands are in registers or constants, which keeps them alive
+                    registers[instruction->a] = ObjRope_concatenate(b, c);
+                } else if (IS_NUMBER(b) && IS_NUMBER(c)) {
+                    registers[instruction->a] = NUMBER_VAL(AS_NUMBER(b) + AS_NUMBER(c));
+                } else {
+                    VM_runtimeError("Operands must be two numbers or two strings.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                NEXT();
+            }
+            CASE(REG_SUBTRACT): BINARY_OP(NUMBER_VAL, -); NEXT();
+            CASE(REG_MULTIPLY): BINARY_OP(NUMBER_VAL, *); NEXT();
+            CASE(REG_DIVIDE): BINARY_OP(NUMBER_VAL, /); NEXT();
+            CASE(REG_NOT): registers[instruction->a] = BOOL_VAL(isFalsy(RK(instruction->b))); NEXT();
+            CASE(REG_NEGATE): {
+                Value value = RK(instruction->b);
+                if (!IS_NUMBER(value)) {
+                    VM_runtimeError("Operand must be a number.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                registers[instruction->a] = NUMBER_VAL(-AS_NUMBER(value));
+                NEXT();
+            }
+            CASE(REG_PRINT): {
+                Value_print(vm.out, RK(instruction->a));
+                fputc('\n', vm.out);
+                NEXT();
+            }
+            CASE(REG_JUMP): vm.pc = code + instruction->b; NEXT();
+            CASE(REG_JUMP_IF_FALSE): {
+                if (isFalsy(RK(instruction->a))) vm.pc = code + instruction->b;
+                NEXT();
+            }
+            CASE(REG_RETURN): {
+                resetStack();
+                return INTERPRET_OK;
+            }
+#ifndef THREADED_DISPATCH
+        }
+    }
+#endif
+
+#undef RK
+#undef BINARY_OP
+#undef NOT_BOOL_VAL
+#undef CHECK_GLOBAL
+#undef COUNT_DISPATCH
+#undef DISPATCH
+#undef CASE
+#undef NEXT
+}
+
+#ifdef REGION_ALLOCATION
+static Value promote(Value value) {
+    if (!IS_OBJ(value)) return value;
+    switch (OBJ_TYPE(value)) {
+        case OBJ_STRING: {
+            if (!AS_OBJ(value)->isScoped) return value;
+            ObjString *string = AS_STRING(value);
+            return OBJ_VAL(ObjString_copyFrom(string->chars, string->length));
+        }
+        case OBJ_ROPE:
+            // Even a rope on the heap can be made of the script's constants. The
+            // region is inactive, so the flat string is allocated on the heap
+            // unless it already was flat.
+            return promote(OBJ_VAL(ObjRope_flatten(AS_ROPE(value))));
+    }
+    return value;
+}
+
+// Everything compiling the request allocated is about to go away in one piece.
+// Only globals can outlive the request, so whatever they reference is copied
+// out to the collected heap first.
+static void releaseRegion() {
+    vm.regionActive = false;
+
+    for (Obj *object = vm.regionObjects; object != NULL; object = object->next) {
+        if (object->type == OBJ_STRING) {
+            Table_delete(&vm.strings, (ObjString *) object);
+        }
+    }
+
+    for (int i = 0; i < vm.globals.count; ++i) {
+        vm.globals.names[i] = AS_STRING(promote(OBJ_VAL(vm.globals.names[i])));
+        vm.globals.values[i] = promote(vm.globals.values[i]);
+    }
+    for (int i = 0; i < vm.globals.slots.capacity; ++i) {
+        Entry *entry = vm.globals.slots.entries + i;
+        if (entry->key == NULL) continue;
+        // a promoted key has the same hash, so it can take over the entry in place
+        entry->key = AS_STRING(promote(OBJ_VAL(entry->key)));
+    }
+
+    vm.regionObjects = NULL;
+    Region_reset(&vm.region);
+}
+#endif
+
+#ifdef BASELINE
+// Compiles the chunk with the baseline compiler and runs that. Returns false,
+// for run() to interpret the chunk instead, if it could not be compiled.
+static bool runBaseline(Chunk *chunk, InterpretResult *result) {
+    BaselineCode code;
+    if (!Baseline_compile(chunk, &code)) return false;
+
+    // the native code keeps the stack in registers, and the chunk has reserved
+    // all it needs, with headroom for what the helpers it calls push
+    vm.stackPinned = true;
+    int status = code.function(vm.stackTop, vm.stack, vm.globals.values);
+    vm.stackPinned = false;
+    Baseline_free(&code);
+    if (status == BASELINE_OK) {
+        // the stencils only set stackTop for the collector, and the script
+        // has popped everything by the time it returns
+        resetStack();
+        *result = INTERPRET_OK;
+    } else {
+        *result = INTERPRET_RUNTIME_ERROR; // whose report has emptied the stack
+    }
+    return true;
+}
+#endif
+
+// Runs a compiled chunk, or the register code lowered from it when given.
+static InterpretResult runChunk(Chunk *chunk, RegisterCode *registers) {
+    vm.chunk = chunk;
+    InterpretResult result;
+    if (registers != NULL) {
+        // the registers are the stack, so it cannot move under them
+        reserveStack(registers->frameSize + STACK_HEADROOM);
+        vm.stackPinned = true;
+        vm.registers = registers;
+        vm.pc = registers->code;
+        result = runRegisters();
+        vm.registers = NULL;
+        vm.stackPinned = false;
+    } else {
+        reserveStack(chunk->maxStack + STACK_HEADROOM);
+#ifdef BASELINE
+        if (compilerOptions.baseline && runBaseline(chunk, &result)) {
+            vm.chunk = NULL;
+            return result;
+        }
+#endif
+        vm.ip = vm.chunk->code;
+        result = run();
+#ifdef PROFILE_OPS
+        Profiler_leave();
+#endif
+#ifdef JIT
+        Jit_reset();
+#endif
+    }
+    vm.chunk = NULL;
+    return result;
+}
+
+InterpretResult VM_interpret(const char *source, size_t length) {
+#ifdef REGION_ALLOCATION
+    vm.regionActive = true;
+#endif
     Chunk chunk;
     Chunk_init(&chunk);
+    RegisterCode registers;
+    RegisterCode_init(&registers);
 
-    if (!compile(source, &chunk)) {
-        Chunk_free(&chunk);
-        return INTERPRET_COMPILE_ERROR;
+    bool compiled = compilerOptions.registerVM
+                    ? compileRegisters(source, length, &chunk, &registers)
+                    : compile(source, length, &chunk);
+#ifdef REGION_ALLOCATION
+    // what the script allocates while it runs is collected as usual, for as long as it runs
+    vm.regionActive = false;
+#endif
+    InterpretResult result = INTERPRET_COMPILE_ERROR;
+    if (compiled) {
+        result = runChunk(&chunk, compilerOptions.registerVM ? &registers : NULL);
     }
 
-    vm.chunk = &chunk;
-    vm.ip = vm.chunk->code;
+    RegisterCode_free(&registers);
+    Chunk_free(&chunk);
+#ifdef REGION_ALLOCATION
+    releaseRegion();
+#endif
+    return result;
+}
+
+InterpretResult VM_interpretCached(const char *source, size_t length, const char *cachePath) {
+#ifdef REGION_ALLOCATION
+    vm.regionActive = true;
+#endif
+    Chunk chunk;
+    Chunk_init(&chunk);
+    RegisterCode registers;
+    RegisterCode_init(&registers);
+    CacheMapping mapping;
 
-    InterpretResult result = run();
+    vm.chunk = &chunk; // the constants are GC roots while they are loaded
+    bool cached = Cache_load(cachePath, source, length, &chunk, &mapping);
+    vm.chunk = NULL;
+    bool compiled = cached || compile(source, length, &chunk);
+    InterpretResult result = INTERPRET_COMPILE_ERROR;
+    if (compiled) {
+        if (!cached) Cache_write(cachePath, source, length, &chunk);
+        if (compilerOptions.registerVM) {
+            vm.chunk = &chunk;
+            Registers_lower(&chunk, &registers);
+        }
+#ifdef REGION_ALLOCATION
+        vm.regionActive = false;
+#endif
+        result = runChunk(&chunk, compilerOptions.registerVM ? &registers : NULL);
+    }
 
-    Chunk_free(&chunk);
+    RegisterCode_free(&registers);
+    if (cached) {
+        Cache_unload(&chunk, &mapping);
+    } else {
+        Chunk_free(&chunk);
+    }
+#ifdef REGION_ALLOCATION
+    releaseRegion();
+#endif
     return result;
 }
 
+VMProgram *VM_compileProgram(const char *source, size_t length) {
+    VMProgram *program = ALLOCATE(VMProgram, 1);
+    Chunk_init(&program->chunk);
+    RegisterCode_init(&program->registers);
+    program->registerVM = compilerOptions.registerVM;
+    // linked first, so that its constants are roots from the moment they exist
+    program->previous = NULL;
+    program->next = vm.programs;
+    if (vm.programs != NULL) vm.programs->previous = program;
+    vm.programs = program;
+
+    bool compiled = program->registerVM
+                    ? compileRegisters(source, length, &program->chunk, &program->registers)
+                    : compile(source, length, &program->chunk);
+    if (!compiled) {
+        VM_freeProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+// The program was compiled outside of any request, so there is no region to
+// release: everything it allocates is collected.
+InterpretResult VM_runProgram(VMProgram *program) {
+    return runChunk(&program->chunk, program->registerVM ? &program->registers : NULL);
+}
+
+void VM_freeProgram(VMProgram *program) {
+    if (program->previous != NULL) {
+        program->previous->next = program->next;
+    } else {
+        vm.programs = program->next;
+    }
+    if (program->next != NULL) program->next->previous = program->previous;
+    RegisterCode_free(&program->registers);
+    Chunk_free(&program->chunk);
+    FREE(VMProgram, program);
+}
+
+void VM_resetGlobals() {
+    for (int i = 0; i < vm.globals.count; ++i) {
+        vm.globals.values[i] = UNDEFINED_VAL;
+    }
+}
+
 static void stackPush(Value value) {
     *(vm.stackTop++) = value;
 }
@@ -227,24 +865,20 @@ static bool isFalsy(Value value) {
     return IS_NIL(value) || (IS_BOOL(value) && AS_BOOL(value) == false);
 }
 
-static ObjString *concatenate(ObjString *a, ObjString *b) {
-    int length = a->length + b->length;
-    char *heapChars = ALLOCATE(char, length + 1);
-    memcpy(heapChars, a->chars, a->length);
-    memcpy(heapChars + a->length, b->chars, b->length);
-    heapChars[length] = '\0';
-    return ObjString_takeFrom(heapChars, length);
-}
-
-static void runtimeError(const char* format, ...) {
+void VM_runtimeError(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    vfprintf(vm.err, format, args);
     va_end(args);
-    fputs("\n", stderr);
+    fputs("\n", vm.err);
 
-    size_t instruction = vm.ip - vm.chunk->code - 1;
-    int line = vm.chunk->lines[instruction];
-    fprintf(stderr, "[line %d] in script\n", line);
+    int line;
+    if (vm.registers != NULL) {
+        line = RegisterCode_getLine(vm.registers, (int) (vm.pc - vm.registers->code - 1));
+    } else {
+        size_t instruction = vm.ip - vm.chunk->code - 1;
+        line = Chunk_getLine(vm.chunk, (int) instruction);
+    }
+    fprintf(vm.err, "[line %d] in script\n", line);
     resetStack();
 }
\ No newline at end of file
@@ -6,19 +6,81 @@
 #define CLOX_VM_H
 
 #include "chunk.h"
+#include "registers.h"
 #include "value.h"
 #include "table.h"
+#include "region.h"
 
-#define STACK_MAX 256
+// The stack starts out this big and grows before running a chunk that needs more.
+#define STACK_MIN 256
+// Room a running chunk leaves above its own values for the VM's: interning a
+// string keeps it on the stack while the table grows.
+#define STACK_HEADROOM 1
+
+typedef struct {
+    int collections;
+    size_t bytesCollected;
+    double totalPause;
+    double maxPause;
+} GCStats;
+
+// Globals are resolved to slots when they are compiled, so the VM only has to
+// index an array. The table is what maps a name to its slot, for the compiler
+// and for names that are used before they are defined.
+typedef struct {
+    Table slots; // name -> NUMBER_VAL(slot)
+    int count;
+    int capacity;
+    Value *values; // UNDEFINED_VAL until the global is defined
+    ObjString **names;
+} Globals;
+
+// A script compiled once, to be run any number of times. Its constants stay
+// alive for as long as it does.
+typedef struct VMProgram {
+    Chunk chunk;
+    RegisterCode registers; // lowered from chunk when it was compiled for the register VM
+    bool registerVM;
+    struct VMProgram *previous;
+    struct VMProgram *next;
+} VMProgram;
 
 typedef struct {
     Chunk *chunk;
     uint8_t *ip;
-    Value stack[STACK_MAX];
+    RegisterCode *registers; // set while running register code instead of the chunk's own
+    RegisterInstruction *pc;
+    // Pushes are unchecked, so every chunk reserves its maxStack before it runs.
+    Value *stack;
+    int stackCapacity;
     Value *stackTop;
-    Table globals;
+    bool stackPinned; // while running code that holds pointers into the stack, which must not move
+    Globals globals;
     Table strings;
     Obj *objects;
+    VMProgram *programs; // every program that has not been freed
+
+    size_t bytesAllocated;
+    size_t nextGC;
+    int grayCount;
+    int grayCapacity;
+    Obj **grayStack;
+    GCStats gcStats;
+    double startTime;
+    FILE *out; // what print writes to, stdout unless the VM's output is captured
+    FILE *err; // compile and runtime errors, stderr unless captured
+#ifdef REGION_ALLOCATION
+    Region region;
+    bool regionActive; // while compiling a request, whose chunk and constants go in the region
+    Obj *regionObjects;
+#endif
+#ifdef VM_COUNT_DISPATCH
+    uint64_t dispatchCount;
+#endif
+#ifdef VM_COUNT_ALLOCATIONS
+    uint64_t allocationCount; // every allocation or growth, scoped ones included
+    uint64_t allocatedBytes;  // what those asked for on top of what was already there
+#endif
 } VM;
 
 typedef enum {
@@ -27,10 +89,30 @@ typedef enum {
     INTERPRET_RUNTIME_ERROR
 } InterpretResult;
 
-extern VM vm;
+// Every thread has a VM of its own, and compiles with a compiler and scanner of
+// its own, so interpreters on different threads share nothing but compilerOptions.
+extern _Thread_local VM vm;
 
 void VM_init();
 void VM_free();
-InterpretResult VM_interpret(const char *source);
+InterpretResult VM_interpret(const char *source, size_t length);
+// Like VM_interpret, but runs the chunk cached at cachePath if it was compiled
+// from this source, and otherwise compiles it and caches it there.
+InterpretResult VM_interpretCached(const char *source, size_t length, const char *cachePath);
+// Compiles source for VM_runProgram, or returns NULL if it does not compile.
+// VM_free frees the programs that are left.
+VMProgram *VM_compileProgram(const char *source, size_t length);
+InterpretResult VM_runProgram(VMProgram *program);
+void VM_freeProgram(VMProgram *program);
+// Makes every global undefined again. They keep their slots, so programs that
+// were compiled against them still run.
+void VM_resetGlobals();
+void VM_push(Value value);
+Value VM_pop();
+int VM_globalSlot(ObjString *name);
+double VM_now();
+// Reports an error on the line of the instruction vm.ip (or vm.pc) has just
+// read, and empties the stack.
+void VM_runtimeError(const char *format, ...);
 
 #endif //CLOX_VM_H